@@ -1 +1 @@
-clang++ -O0 -g -gcodeview -gno-column-info sim86.cpp -o sim8086.exe
+clang++ -I..\haversine\reference -O0 -g -gcodeview -gno-column-info sim86.cpp -o sim8086.exe
@@ -21,25 +21,5 @@ typedef int16_t i16;
 typedef int32_t i32;
 typedef int64_t i64;
 
-static struct StringArena {
-	char *base;
-	char *head;
-	u32 size;
-} strArena{};
-
-static void initStrArena() {
-	strArena.base = (char *) malloc(sizeof(char) * 64 * 1024);
-	strArena.head = strArena.base;
-	strArena.size = 64 * 1024;
-}
-
-static void destroyStrArena() {
-	free(strArena.base);
-}
-
-static char *allocStr(u32 size) {
-	assert(((u32) (strArena.head - strArena.base)) + size <= strArena.size);
-	char *str = strArena.head;
-	strArena.head += size;
-	return str;
-}
+typedef float  f32;
+typedef double f64;
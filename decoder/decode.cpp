@@ -1,5 +1,7 @@
 #include "decode.h"
 
+DecodeStats decodeStats;
+
 struct InstrDecode {
     bool w;
     bool d;
@@ -237,23 +239,30 @@ u32 decodeNextInstr(Instr *instr, sim_ptr offset, InstrDefTable defTable) {
     u8 bytes[6];
     readMem(bytes, offset, 6);
 
-    u32 bytesConsumed;
+    u32 bytesConsumed = 0;
     InstrDecode decodeData;
-    InstrDef def{};
-    bool defFound = false;
-    for (InstrDef maybeDef : defTable) {
-        if ((bytesConsumed = tryInstrDef(&decodeData, maybeDef, bytes)) > 0) {
-            defFound = true;
-            def = maybeDef;
+    u32 defIndex = 0;
+    for ( ; defIndex < defTable.size(); defIndex++) {
+        if ((bytesConsumed = tryInstrDef(&decodeData, defTable[defIndex], bytes)) > 0) {
             break;
         }
     }
 
-    if (!defFound) {
+    if (defIndex == defTable.size()) {
         fprintf(stderr, "No definition found!\n");
         exit(1);
     }
 
+    InstrDef &def = defTable[defIndex];
+
+    decodeStats.instrs++;
+    decodeStats.perOp[def.op]++;
+    decodeStats.perLength[bytesConsumed <= MAX_INSTR_LENGTH ? bytesConsumed : 0]++;
+    if (defIndex < MAX_INSTR_DEFS) {
+        decodeStats.perDef[defIndex]++;
+    }
+    decodeStats.failedAttempts += defIndex;
+
     instr->op = def.op;
     instr->wide = decodeData.w;
 
@@ -299,6 +308,17 @@ u32 decodeNextInstr(Instr *instr, sim_ptr offset, InstrDefTable defTable) {
         }
     }
 
+    if (decodeData.hasMod) {
+        switch (decodeData.mod) {
+            case 0b00: decodeStats.perMod[MOD_DISP]++; break;
+            case 0b01: decodeStats.perMod[MOD_DISP8]++; break;
+            case 0b10: decodeStats.perMod[MOD_DISP16]++; break;
+            case 0b11: decodeStats.perMod[MOD_REG]++; break;
+        }
+    } else {
+        decodeStats.perMod[MOD_NONE]++;
+    }
+
     if (decodeData.hasMod) {
         Arg rmArg;
         if (decodeData.mod == 0b11) { // Register
@@ -315,6 +335,10 @@ u32 decodeNextInstr(Instr *instr, sim_ptr offset, InstrDefTable defTable) {
             rmArg.eac.disp = decodeData.disp;
         }
 
+        if (rmArg.type == ARG_MEM) {
+            decodeStats.perEAB[rmArg.eac.base]++;
+        }
+
         if (instr->src.type != ARG_NONE) {
             instr->dst = rmArg;
         } else {
@@ -329,3 +353,86 @@ u32 decodeNextInstr(Instr *instr, sim_ptr offset, InstrDefTable defTable) {
 
     return bytesConsumed;
 }
+
+static const char *MOD_STAT_NAMES[] = { "none", "reg", "mem", "mem+disp8", "mem+disp16" };
+static const char *EAB_STAT_NAMES[] = {
+    "none", "direct", "bx+si", "bx+di", "bp+si", "bp+di", "si", "di", "bp", "bx",
+};
+
+static inline f64 percentOf(u64 count, u64 total) {
+    return total ? 100.0 * count / total : 0.0;
+}
+
+void printDecodeStats(FILE *out, InstrDefTable &defTable) {
+    u64 total = decodeStats.instrs;
+
+    fprintf(out, "Decoded instructions: %llu\n", (unsigned long long) total);
+    fprintf(out, "Failed tryInstrDef attempts: %llu (%.2f per instruction)\n",
+            (unsigned long long) decodeStats.failedAttempts,
+            total ? (f64) decodeStats.failedAttempts / total : 0.0);
+
+    fprintf(out, "\nBy op:\n");
+    for (u32 op = 0; op < OP_NONE; op++) {
+        if (decodeStats.perOp[op]) {
+            fprintf(out, "  %-8s %12llu %6.2f%%\n", OP_STRINGS[op],
+                    (unsigned long long) decodeStats.perOp[op], percentOf(decodeStats.perOp[op], total));
+        }
+    }
+
+    fprintf(out, "\nBy mod:\n");
+    for (u32 mod = 0; mod <= MOD_DISP16; mod++) {
+        fprintf(out, "  %-10s %12llu %6.2f%%\n", MOD_STAT_NAMES[mod],
+                (unsigned long long) decodeStats.perMod[mod], percentOf(decodeStats.perMod[mod], total));
+    }
+
+    fprintf(out, "\nBy effective address:\n");
+    for (u32 eab = EAB_DIRECT; eab <= EAB_BX; eab++) {
+        fprintf(out, "  %-10s %12llu %6.2f%%\n", EAB_STAT_NAMES[eab],
+                (unsigned long long) decodeStats.perEAB[eab], percentOf(decodeStats.perEAB[eab], total));
+    }
+
+    fprintf(out, "\nBy length:\n");
+    for (u32 length = 1; length <= MAX_INSTR_LENGTH; length++) {
+        fprintf(out, "  %u bytes %12llu %6.2f%%\n", length,
+                (unsigned long long) decodeStats.perLength[length], percentOf(decodeStats.perLength[length], total));
+    }
+
+    fprintf(out, "\nBy table row:\n");
+    fprintf(out, "  %5s %-8s %12s %8s %14s %12s\n", "line", "op", "count", "share", "misses/match", "missed");
+    u64 matchedSoFar = 0;
+    for (u32 i = 0; i < defTable.size() && i < MAX_INSTR_DEFS; i++) {
+        matchedSoFar += decodeStats.perDef[i];
+        u64 missed = decodeStats.instrs - matchedSoFar;
+        if (decodeStats.perDef[i] || missed) {
+            fprintf(out, "  %5u %-8s %12llu %7.2f%% %14u %12llu\n",
+                    defTable[i].line, OP_STRINGS[defTable[i].op],
+                    (unsigned long long) decodeStats.perDef[i], percentOf(decodeStats.perDef[i], total), i,
+                    (unsigned long long) missed);
+        }
+    }
+}
+
+void writeDecodeStatsCsv(FILE *out, InstrDefTable &defTable) {
+    fprintf(out, "kind,key,count,failed_attempts\n");
+    fprintf(out, "total,instrs,%llu,%llu\n",
+            (unsigned long long) decodeStats.instrs, (unsigned long long) decodeStats.failedAttempts);
+    for (u32 op = 0; op < OP_NONE; op++) {
+        fprintf(out, "op,%s,%llu,\n", OP_STRINGS[op], (unsigned long long) decodeStats.perOp[op]);
+    }
+    for (u32 mod = 0; mod <= MOD_DISP16; mod++) {
+        fprintf(out, "mod,%s,%llu,\n", MOD_STAT_NAMES[mod], (unsigned long long) decodeStats.perMod[mod]);
+    }
+    for (u32 eab = EAB_DIRECT; eab <= EAB_BX; eab++) {
+        fprintf(out, "eab,%s,%llu,\n", EAB_STAT_NAMES[eab], (unsigned long long) decodeStats.perEAB[eab]);
+    }
+    for (u32 length = 1; length <= MAX_INSTR_LENGTH; length++) {
+        fprintf(out, "length,%u,%llu,\n", length, (unsigned long long) decodeStats.perLength[length]);
+    }
+    u64 matchedSoFar = 0;
+    for (u32 i = 0; i < defTable.size() && i < MAX_INSTR_DEFS; i++) {
+        matchedSoFar += decodeStats.perDef[i];
+        fprintf(out, "line,%u,%llu,%llu\n", defTable[i].line,
+                (unsigned long long) decodeStats.perDef[i],
+                (unsigned long long) (decodeStats.instrs - matchedSoFar));
+    }
+}
@@ -9,3 +9,37 @@
  * and return the number of bytes consumed.
  */
 u32 decodeNextInstr(Instr *instr, sim_ptr offset, InstrDefTable defTable);
+
+#define MAX_INSTR_LENGTH 6
+#define MAX_INSTR_DEFS 256
+
+/**
+ * Counters updated on every decoded instruction.  These are plain
+ * increments into fixed tables, so they stay on in every build.
+ */
+struct DecodeStats {
+    u64 instrs;
+    u64 perOp[OP_NONE + 1];
+    u64 perMod[MOD_DISP16 + 1];
+    u64 perEAB[EAB_BX + 1];
+    u64 perLength[MAX_INSTR_LENGTH + 1];
+
+    // Indexed by position in the InstrDefTable.  The table is searched in
+    // order, so row i missed on every instruction that matched after it,
+    // which is instrs minus the matches on rows 0..i
+    u64 perDef[MAX_INSTR_DEFS];
+    u64 failedAttempts;
+};
+
+extern DecodeStats decodeStats;
+
+/**
+ * Print the counters as tables, skipping empty rows
+ */
+void printDecodeStats(FILE *out, InstrDefTable &defTable);
+
+/**
+ * Write the counters as CSV, one `kind,key,count[,failed]` row each.  For
+ * `line` rows, failed is how many instructions tried that row and missed
+ */
+void writeDecodeStatsCsv(FILE *out, InstrDefTable &defTable);
@@ -1,5 +1,7 @@
 #include "instTable.h"
 
+#include <algorithm>
+
 static char *loadInstTable() {
     FILE *fp;
     long lSize;
@@ -80,12 +82,21 @@ static InstrPart decodeInstrPart(char *str) {
 std::vector<InstrDef> getInstTable() {
     char *instTableStr = loadInstTable();
 
+    // Find line starts before strtok overwrites the newlines, so each
+    // definition can be traced back to its line in the table
+    std::vector<char *> lineStarts = { instTableStr };
+    for (char *c = instTableStr; *c; c++) {
+        if (*c == '\n') lineStarts.push_back(c + 1);
+    }
+
     char *line, *lineTokCtx;
     line = strtok_s(instTableStr, "\r\n", &lineTokCtx);
     std::vector<InstrDef> defs;
 
     do {
         InstrDef def{};
+        def.line = std::upper_bound(lineStarts.begin(), lineStarts.end(), line) - lineStarts.begin();
+
         char *token = strtok(line, " ");
         def.op = decodeOpStr(token);
 
@@ -42,6 +42,7 @@ struct InstrPart {
 
 struct InstrDef {
     Op op;
+    u32 line; // Line in 8086_inst_table.txt, starting at 1
     std::vector<InstrPart> parts;
 };
 
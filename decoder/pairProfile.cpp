@@ -0,0 +1,132 @@
+#include "pairProfile.h"
+
+#include <algorithm>
+#include <vector>
+
+static inline bool isConditionalJump(Op op) {
+    switch (op) {
+        case OP_JE:
+        case OP_JL:
+        case OP_JLE:
+        case OP_JB:
+        case OP_JBE:
+        case OP_JP:
+        case OP_JO:
+        case OP_JS:
+        case OP_JNE:
+        case OP_JNL:
+        case OP_JG:
+        case OP_JNB:
+        case OP_JA:
+        case OP_JNP:
+        case OP_JNO:
+        case OP_JNS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static inline bool isArithmetic(Op op) {
+    switch (op) {
+        case OP_ADD:
+        case OP_ADC:
+        case OP_SUB:
+        case OP_SBB:
+        case OP_CMP:
+        case OP_AND:
+        case OP_TEST:
+        case OP_OR:
+        case OP_XOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static inline bool isPrefix(Op op) {
+    return op == OP_REP || op == OP_LOCK || op == OP_SEGMENT;
+}
+
+static inline bool usesReg(Arg arg, Register reg) {
+    return arg.type == ARG_REG && arg.reg == reg;
+}
+
+FusionKind getFusionKind(Instr *first, Instr *second) {
+    if ((first->op == OP_CMP || first->op == OP_TEST) &&
+        isConditionalJump(second->op)) {
+        return FUSE_CMP_JCC;
+    }
+
+    // LOOP does its own decrement, so DEC/INC + LOOP is not a counter pair.
+    // JCXZ reads CX rather than the flags, so it only pairs with DEC/INC CX
+    if ((first->op == OP_DEC || first->op == OP_INC) &&
+        (isConditionalJump(second->op) ||
+         (second->op == OP_JCXZ && usesReg(first->dst, REG_CX)))) {
+        return FUSE_DEC_JCC;
+    }
+
+    if (first->op == OP_MOV &&
+        first->dst.type == ARG_REG && first->src.type == ARG_MEM &&
+        isArithmetic(second->op) &&
+        (usesReg(second->dst, first->dst.reg) || usesReg(second->src, first->dst.reg))) {
+        return FUSE_LOAD_ALU;
+    }
+
+    return FUSE_NONE;
+}
+
+void recordInstrPair(PairProfile *profile, Instr *instr) {
+    if (isPrefix(instr->op)) {
+        return;
+    }
+
+    if (profile->hasPrev) {
+        profile->counts[profile->prev.op][instr->op]++;
+        profile->fusionCounts[getFusionKind(&profile->prev, instr)]++;
+        profile->totalPairs++;
+    }
+
+    profile->prev = *instr;
+    profile->hasPrev = true;
+}
+
+void printPairProfile(PairProfile *profile, u32 maxRows) {
+    struct PairRow {
+        Op first;
+        Op second;
+        u64 count;
+    };
+
+    std::vector<PairRow> rows;
+    for (u32 first = 0; first < OP_NONE; first++) {
+        for (u32 second = 0; second < OP_NONE; second++) {
+            if (profile->counts[first][second] > 0) {
+                rows.push_back({ (Op) first, (Op) second, profile->counts[first][second] });
+            }
+        }
+    }
+
+    std::sort(rows.begin(), rows.end(), [](const PairRow &a, const PairRow &b) {
+        return a.count > b.count;
+    });
+
+    f64 total = profile->totalPairs ? (f64) profile->totalPairs : 1.0;
+
+    fprintf(stderr, "Instruction pairs: %llu\n", (unsigned long long) profile->totalPairs);
+    for (u32 i = 0; i < rows.size() && i < maxRows; i++) {
+        fprintf(stderr, "  %-8s %-8s %10llu (%6.2f%%)\n",
+                OP_STRINGS[rows[i].first],
+                OP_STRINGS[rows[i].second],
+                (unsigned long long) rows[i].count,
+                100.0 * rows[i].count / total);
+    }
+
+    fprintf(stderr, "Fusion candidates:\n");
+    for (u32 kind = FUSE_NONE + 1; kind < FUSE_COUNT; kind++) {
+        fprintf(stderr, "  %-8s %10llu (%6.2f%%)\n",
+                FUSION_KIND_STRINGS[kind],
+                (unsigned long long) profile->fusionCounts[kind],
+                100.0 * profile->fusionCounts[kind] / total);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.h"
+#include "sim86.h"
+
+/**
+ * Kinds of adjacent instruction pairs that are candidates for being
+ * fused into a single superinstruction handler.
+ *
+ * FUSE_DEC_JCC covers the DEC/INC counter pairs.  LOOP is not one of them:
+ * it decrements CX itself, so a DEC/INC in front of it is a separate
+ * update and there is nothing to fuse.  JCXZ only counts after DEC/INC CX,
+ * since it tests CX and not the flags the DEC/INC set.
+ */
+enum FusionKind {
+    FUSE_NONE = 0,
+    FUSE_CMP_JCC,  // CMP/TEST followed by a conditional jump
+    FUSE_DEC_JCC,  // DEC/INC followed by a conditional jump, or DEC/INC CX + JCXZ
+    FUSE_LOAD_ALU, // MOV reg, [mem] followed by an ALU op using that reg
+
+    FUSE_COUNT,
+};
+
+static const char *FUSION_KIND_STRINGS[] = {
+    "none",
+    "cmp+jcc",
+    "dec+jcc",
+    "load+alu",
+};
+
+struct PairProfile {
+    u64 counts[OP_NONE + 1][OP_NONE + 1];
+    u64 fusionCounts[FUSE_COUNT];
+    u64 totalPairs;
+
+    bool hasPrev;
+    Instr prev;
+};
+
+/**
+ * Classify the pair (`first`, `second`) as a fusion candidate, or
+ * FUSE_NONE if the pair has no fused form.
+ */
+FusionKind getFusionKind(Instr *first, Instr *second);
+
+/**
+ * Record `instr` against the previously recorded instruction.  Prefix
+ * pseudo-ops (REP, LOCK, SEGMENT) are not counted as pair members.
+ */
+void recordInstrPair(PairProfile *profile, Instr *instr);
+
+/**
+ * Print the `maxRows` most frequent pairs, and the totals per fusion kind.
+ */
+void printPairProfile(PairProfile *profile, u32 maxRows);
@@ -0,0 +1,173 @@
+#include "pipeline.h"
+
+#include <chrono>
+#include <thread>
+
+typedef std::chrono::steady_clock PipelineClock;
+
+// Pushed once to every formatter after the last batch.  It isn't a real
+// batch, so the decoder never waits on a free batch just to shut down
+#define END_OF_STREAM ((InstrBatch *) nullptr)
+
+struct StageStats {
+    const char *name;
+    u32 index;
+    u64 busyNanos;
+    u64 batches;
+};
+
+struct Pipeline {
+    u32 formatterCount;
+
+    SpscQueue<InstrBatch *, PIPELINE_QUEUE_SIZE> toFormat[MAX_PIPELINE_FORMATTERS];
+    SpscQueue<InstrBatch *, PIPELINE_QUEUE_SIZE> toWrite[MAX_PIPELINE_FORMATTERS];
+    SpscQueue<InstrBatch *, PIPELINE_QUEUE_SIZE * MAX_PIPELINE_FORMATTERS * 2> freeBatches;
+
+    StageStats decodeStats;
+    StageStats formatStats[MAX_PIPELINE_FORMATTERS];
+    StageStats writeStats;
+};
+
+template <typename T, u32 N>
+static inline void pushWait(SpscQueue<T, N> *queue, T item) {
+    while (!queue->push(item)) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename T, u32 N>
+static inline T popWait(SpscQueue<T, N> *queue) {
+    T item;
+    while (!queue->pop(&item)) {
+        std::this_thread::yield();
+    }
+    return item;
+}
+
+static inline u64 nanosSince(PipelineClock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(PipelineClock::now() - start).count();
+}
+
+static void decodeStage(Pipeline *pipeline, DecodeBatchFn decodeBatch, void *context) {
+    u64 batchIndex = 0;
+    while (true) {
+        InstrBatch *batch = popWait(&pipeline->freeBatches);
+
+        auto start = PipelineClock::now();
+        batch->instrCount = decodeBatch(batch->instrs, PIPELINE_BATCH_SIZE, context);
+        pipeline->decodeStats.busyNanos += nanosSince(start);
+
+        if (batch->instrCount == 0) {
+            pushWait(&pipeline->freeBatches, batch);
+            break;
+        }
+
+        pipeline->decodeStats.batches++;
+        pushWait(&pipeline->toFormat[batchIndex++ % pipeline->formatterCount], batch);
+    }
+
+    for (u32 i = 0; i < pipeline->formatterCount; i++) {
+        pushWait(&pipeline->toFormat[batchIndex++ % pipeline->formatterCount], END_OF_STREAM);
+    }
+}
+
+static void formatStage(Pipeline *pipeline, u32 index) {
+    StageStats *stats = &pipeline->formatStats[index];
+    while (true) {
+        InstrBatch *batch = popWait(&pipeline->toFormat[index]);
+        if (batch != END_OF_STREAM) {
+            auto start = PipelineClock::now();
+            char *text = batch->text;
+            for (u32 i = 0; i < batch->instrCount; i++) {
+                text += formatInstr(text, batch->instrs[i]);
+            }
+            batch->textSize = text - batch->text;
+            stats->busyNanos += nanosSince(start);
+            stats->batches++;
+        }
+
+        pushWait(&pipeline->toWrite[index], batch);
+        if (batch == END_OF_STREAM) {
+            break;
+        }
+    }
+}
+
+static void writeStage(Pipeline *pipeline, FILE *out) {
+    u64 batchIndex = 0;
+    while (true) {
+        InstrBatch *batch = popWait(&pipeline->toWrite[batchIndex++ % pipeline->formatterCount]);
+        if (batch == END_OF_STREAM) {
+            break;
+        }
+
+        auto start = PipelineClock::now();
+        fwrite(batch->text, 1, batch->textSize, out);
+        pipeline->writeStats.busyNanos += nanosSince(start);
+        pipeline->writeStats.batches++;
+
+        pushWait(&pipeline->freeBatches, batch);
+    }
+
+    auto start = PipelineClock::now();
+    fflush(out);
+    pipeline->writeStats.busyNanos += nanosSince(start);
+}
+
+static void printStageStats(StageStats *stats, u64 wallNanos) {
+    char name[32];
+    if (stats->index) {
+        sprintf(name, "%s %u", stats->name, stats->index - 1);
+    } else {
+        sprintf(name, "%s", stats->name);
+    }
+    fprintf(stderr, "  %-12s %10.3fms busy %6.2f%% (%llu batches)\n",
+            name,
+            stats->busyNanos / 1e6,
+            wallNanos ? 100.0 * stats->busyNanos / wallNanos : 0.0,
+            (unsigned long long) stats->batches);
+}
+
+void runPipeline(u32 formatterCount, DecodeBatchFn decodeBatch, void *context, FILE *out) {
+    assert(formatterCount >= 1 && formatterCount <= MAX_PIPELINE_FORMATTERS);
+
+    Pipeline *pipeline = new Pipeline();
+    pipeline->formatterCount = formatterCount;
+    pipeline->decodeStats.name = "decode";
+    pipeline->writeStats.name = "write";
+
+    // Enough batches to keep every queue full, plus one in flight per stage
+    u32 batchCount = PIPELINE_QUEUE_SIZE * formatterCount + formatterCount + 2;
+    InstrBatch *batches = new InstrBatch[batchCount];
+    for (u32 i = 0; i < batchCount; i++) {
+        pushWait(&pipeline->freeBatches, &batches[i]);
+    }
+
+    auto start = PipelineClock::now();
+
+    std::thread formatters[MAX_PIPELINE_FORMATTERS];
+    for (u32 i = 0; i < formatterCount; i++) {
+        pipeline->formatStats[i].name = "format";
+        pipeline->formatStats[i].index = i + 1;
+        formatters[i] = std::thread(formatStage, pipeline, i);
+    }
+    std::thread writer(writeStage, pipeline, out);
+
+    decodeStage(pipeline, decodeBatch, context);
+
+    for (u32 i = 0; i < formatterCount; i++) {
+        formatters[i].join();
+    }
+    writer.join();
+
+    u64 wallNanos = nanosSince(start);
+    fprintf(stderr, "Pipeline: %.3fms wall, %u formatter(s)\n", wallNanos / 1e6, formatterCount);
+    printStageStats(&pipeline->decodeStats, wallNanos);
+    for (u32 i = 0; i < formatterCount; i++) {
+        printStageStats(&pipeline->formatStats[i], wallNanos);
+    }
+    printStageStats(&pipeline->writeStats, wallNanos);
+
+    delete[] batches;
+    delete pipeline;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "common.h"
+#include "sim86.h"
+#include "print.h"
+
+#include <atomic>
+
+/**
+ * Pipelined disassembly: one thread decodes instructions into batches,
+ * `formatterCount` threads turn batches into text, and a writer thread
+ * flushes the text.  Batch N always goes to formatter N % formatterCount,
+ * and the writer drains the formatters in that same order, so every
+ * queue is single producer / single consumer and output stays in order.
+ */
+
+#define PIPELINE_BATCH_SIZE 4096
+#define PIPELINE_QUEUE_SIZE 8
+#define MAX_PIPELINE_FORMATTERS 16
+
+/**
+ * Bounded lock-free single producer / single consumer ring.
+ */
+template <typename T, u32 N>
+struct SpscQueue {
+    static_assert((N & (N - 1)) == 0, "Queue size must be a power of two");
+
+    T items[N];
+    alignas(64) std::atomic<u32> head{0}; // Next slot to pop
+    alignas(64) std::atomic<u32> tail{0}; // Next slot to push
+
+    bool push(T item) {
+        u32 t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items[t % N] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T *item) {
+        u32 h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *item = items[h % N];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+struct InstrBatch {
+    Instr instrs[PIPELINE_BATCH_SIZE];
+    u32 instrCount;
+
+    char text[PIPELINE_BATCH_SIZE * MAX_INSTR_STR];
+    u64 textSize;
+};
+
+/**
+ * Fill `instrs` with up to `maxCount` decoded instructions, and return
+ * how many were decoded.  Returning 0 ends the stream.
+ */
+typedef u32 (*DecodeBatchFn)(Instr *instrs, u32 maxCount, void *context);
+
+/**
+ * Run the pipeline until `decodeBatch` is exhausted, writing to `out`, and
+ * print the utilization of each stage to stderr.
+ */
+void runPipeline(u32 formatterCount, DecodeBatchFn decodeBatch, void *context, FILE *out);
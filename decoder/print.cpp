@@ -56,20 +56,18 @@ static inline const char *getSegmentPrefix(Register segment) {
     }
 }
 
-static inline const char *getMemoryPrefix(Register segment, bool wide, bool isDst) {
+static inline void getMemoryPrefix(char *ret, Register segment, bool wide, bool isDst) {
     if (isDst) {
-        char *ret = allocStr(16);
         sprintf(ret, "%s%s",
                 wide ? "word " : "byte ",
                 getSegmentPrefix(segment));
-        return ret;
     } else {
-        return getSegmentPrefix(segment);
+        sprintf(ret, "%s", getSegmentPrefix(segment));
     }
 }
 
-static const char *getArgStr(Arg arg, bool wide, bool isDst) {
-    char *ret = allocStr(32);
+static void getArgStr(char *ret, Arg arg, bool wide, bool isDst) {
+    char prefix[16];
 
     switch (arg.type) {
         case ARG_IMM:
@@ -82,18 +80,15 @@ static const char *getArgStr(Arg arg, bool wide, bool isDst) {
             sprintf(ret, "%s", getRegStr(arg.reg));
             break;
         case ARG_MEM:
+            getMemoryPrefix(prefix, arg.eac.segment, wide, isDst);
             if (arg.eac.base == EAB_DIRECT) {
-                sprintf(ret, "%s[%d]",
-                        getMemoryPrefix(arg.eac.segment, wide, isDst),
-                        arg.eac.disp);
+                sprintf(ret, "%s[%d]", prefix, arg.eac.disp);
             } else {
                 if (arg.eac.disp == 0) {
-                    sprintf(ret, "%s[%s]",
-                            getMemoryPrefix(arg.eac.segment, wide, isDst),
-                            getEABStr(arg.eac.base));
+                    sprintf(ret, "%s[%s]", prefix, getEABStr(arg.eac.base));
                 } else {
                     sprintf(ret, "%s[%s %s %d]",
-                            getMemoryPrefix(arg.eac.segment, wide, isDst),
+                            prefix,
                             getEABStr(arg.eac.base),
                             arg.eac.disp < 0 ? "-" : "+",
                             abs(arg.eac.disp));
@@ -104,15 +99,13 @@ static const char *getArgStr(Arg arg, bool wide, bool isDst) {
             fprintf(stderr, "Attempted to print ARG_NONE!\n");
             exit(1);
     }
-
-    return ret;
 }
 
 static inline void strToLower(char *p) {
     for ( ; *p; ++p) *p = tolower(*p);
 }
 
-void printInstr(Instr instr) {
+u32 formatInstr(char *out, Instr instr) {
     char opName[8];
     strcpy(opName, OP_STRINGS[instr.op]);
     strToLower(opName);
@@ -127,33 +120,42 @@ void printInstr(Instr instr) {
     }
 
     if (instr.op == OP_SEGMENT) {
-        return;
+        out[0] = '\0';
+        return 0;
     }
 
     if (instr.op == OP_REP || instr.op == OP_LOCK) {
-        printf("%s ", opName);
-        return;
+        return sprintf(out, "%s ", opName);
     }
 
+    char dst[MAX_ARG_STR];
+    char src[MAX_ARG_STR];
+
     if (instr.dst.type == ARG_NONE) {
-        printf("%s", opName);
         // These require w/b appended depending on the instr width
+        const char *suffix = "";
         switch (instr.op) {
             case OP_MOVS:
             case OP_CMPS:
             case OP_SCAS:
             case OP_LODS:
             case OP_STOS:
-                printf("%s", instr.wide ? "w" : "b");
+                suffix = instr.wide ? "w" : "b";
             default: break;
         }
-        printf("\n");
+        return sprintf(out, "%s%s\n", opName, suffix);
     } else if (instr.src.type == ARG_NONE) {
-        printf("%s %s\n", opName, getArgStr(instr.dst, instr.wide, true));
+        getArgStr(dst, instr.dst, instr.wide, true);
+        return sprintf(out, "%s %s\n", opName, dst);
     } else {
-        printf("%s %s, %s\n",
-               opName,
-               getArgStr(instr.dst, instr.wide, true),
-               getArgStr(instr.src, instr.wide, false));
+        getArgStr(dst, instr.dst, instr.wide, true);
+        getArgStr(src, instr.src, instr.wide, false);
+        return sprintf(out, "%s %s, %s\n", opName, dst, src);
     }
 }
+
+void printInstr(Instr instr) {
+    char text[MAX_INSTR_STR];
+    formatInstr(text, instr);
+    fputs(text, stdout);
+}
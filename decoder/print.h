@@ -1,5 +1,14 @@
 #include "sim86.h"
 
+#define MAX_ARG_STR 48
+#define MAX_INSTR_STR 128
+
+/**
+ * Format instruction in intel notation into `out`, which must hold at
+ * least MAX_INSTR_STR bytes.  Returns the length of the text.
+ */
+u32 formatInstr(char *out, Instr instr);
+
 /**
  * Print out instruction formatted in intel notation
  */
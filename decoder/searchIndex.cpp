@@ -0,0 +1,319 @@
+#include "searchIndex.h"
+
+#include <algorithm>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char *REG_KEY_NAMES[] = {
+    "", "al", "ax", "cl", "cx", "dl", "dx", "bl", "bx", "ah", "sp",
+    "ch", "bp", "dh", "si", "bh", "di", "es", "cs", "ss", "ds",
+};
+
+static const char *EAB_KEY_NAMES[] = {
+    "", "direct", "bx_si", "bx_di", "bp_si", "bp_di", "si", "di", "bp", "bx",
+};
+
+static const char *ARG_KEY_NAMES[] = {
+    "none", "reg", "mem", "imm", "rel",
+};
+
+static inline void addPosting(IndexBuilder *builder, u32 key, u32 id) {
+    std::vector<u32> &list = builder->postings[key];
+    // An instruction can hit the same key twice (e.g. `mov ax, ax`)
+    if (list.empty() || list.back() != id) {
+        list.push_back(id);
+    }
+}
+
+static void addArgKeys(IndexBuilder *builder, Arg arg, u32 id) {
+    if (arg.type == ARG_REG) {
+        addPosting(builder, INDEX_KEY(KEY_REG, arg.reg), id);
+    } else if (arg.type == ARG_MEM) {
+        addPosting(builder, INDEX_KEY(KEY_EAB, arg.eac.base), id);
+        if (arg.eac.segment != REG_NONE) {
+            addPosting(builder, INDEX_KEY(KEY_SEG, arg.eac.segment), id);
+        }
+    }
+}
+
+void addInstrToIndex(IndexBuilder *builder, u32 fileId, u32 offset, Instr *instr) {
+    u32 id = (u32) builder->entries.size();
+    builder->entries.push_back({ fileId, offset });
+
+    addPosting(builder, INDEX_KEY(KEY_OP, instr->op), id);
+    addPosting(builder, INDEX_KEY(KEY_DST_TYPE, instr->dst.type), id);
+    addPosting(builder, INDEX_KEY(KEY_SRC_TYPE, instr->src.type), id);
+    addArgKeys(builder, instr->dst, id);
+    addArgKeys(builder, instr->src, id);
+}
+
+static void writeOrDie(FILE *fp, const void *data, u64 size) {
+    if (size > 0 && fwrite(data, size, 1, fp) != 1) {
+        PANIC("Failed to write index");
+    }
+}
+
+void writeIndex(IndexBuilder *builder, const char *path) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        PANIC("Failed to open index file %s", path);
+    }
+
+    std::vector<IndexKey> keys;
+    u64 postingCount = 0;
+    for (u32 key = 0; key < KEY_KIND_COUNT * INDEX_KEY_VALUES; key++) {
+        u32 count = (u32) builder->postings[key].size();
+        if (count > 0) {
+            keys.push_back({ key, count, postingCount });
+            postingCount += count;
+        }
+    }
+
+    IndexHeader header{};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.fileCount = (u32) builder->names.size();
+    header.keyCount = (u32) keys.size();
+    header.instrCount = (u32) builder->entries.size();
+    header.keysOffset = sizeof(IndexHeader);
+    header.postingsOffset = header.keysOffset + keys.size() * sizeof(IndexKey);
+    header.entriesOffset = header.postingsOffset + postingCount * sizeof(u32);
+    // Keep the entries 8 byte aligned
+    header.entriesOffset = (header.entriesOffset + 7) & ~7ull;
+    header.namesOffset = header.entriesOffset + builder->entries.size() * sizeof(IndexEntry);
+
+    writeOrDie(fp, &header, sizeof(header));
+    writeOrDie(fp, keys.data(), keys.size() * sizeof(IndexKey));
+    for (IndexKey key : keys) {
+        writeOrDie(fp, builder->postings[key.key].data(), key.count * sizeof(u32));
+    }
+    u8 padding[8] = {};
+    writeOrDie(fp, padding,
+               header.entriesOffset - (header.postingsOffset + postingCount * sizeof(u32)));
+    writeOrDie(fp, builder->entries.data(), builder->entries.size() * sizeof(IndexEntry));
+    for (const char *name : builder->names) {
+        writeOrDie(fp, name, strlen(name) + 1);
+    }
+
+    fclose(fp);
+}
+
+/**
+ * Whether `count` items of `size` bytes starting at `offset` end at or
+ * before `limit`, without overflowing on values read from the file.
+ */
+static bool rangeFits(u64 offset, u64 count, u64 size, u64 limit) {
+    return offset <= limit && count <= (limit - offset) / size;
+}
+
+SearchIndex openIndex(const char *path) {
+    SearchIndex index{};
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        PANIC("Failed to open index file %s", path);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    index.mapping = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    index.mappingSize = size.QuadPart;
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        PANIC("Failed to open index file %s", path);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    index.mappingSize = st.st_size;
+    index.mapping = mmap(NULL, index.mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (index.mapping == MAP_FAILED) {
+        index.mapping = NULL;
+    }
+    close(fd);
+#endif
+
+    if (!index.mapping || index.mappingSize < sizeof(IndexHeader)) {
+        PANIC("Failed to map index file %s", path);
+    }
+
+    u8 *base = (u8 *) index.mapping;
+    index.header = (IndexHeader *) base;
+    IndexHeader *header = index.header;
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != INDEX_VERSION) {
+        PANIC("%s is not a valid index file", path);
+    }
+
+    // The file comes from disk, so every section has to fit inside the
+    // mapping, in order, before anything in it gets dereferenced
+    if (header->keysOffset < sizeof(IndexHeader) ||
+        header->keysOffset % alignof(IndexKey) != 0 ||
+        header->entriesOffset % alignof(IndexEntry) != 0 ||
+        !rangeFits(header->keysOffset, header->keyCount, sizeof(IndexKey), header->postingsOffset) ||
+        header->postingsOffset > header->entriesOffset ||
+        !rangeFits(header->entriesOffset, header->instrCount, sizeof(IndexEntry), header->namesOffset) ||
+        header->namesOffset > index.mappingSize) {
+        PANIC("%s has a corrupt header", path);
+    }
+
+    u64 postingsSize = header->entriesOffset - header->postingsOffset;
+    index.keys = (IndexKey *) (base + header->keysOffset);
+    index.postings = (u32 *) (base + header->postingsOffset);
+    index.entries = (IndexEntry *) (base + header->entriesOffset);
+
+    for (u32 i = 0; i < header->keyCount; i++) {
+        IndexKey *key = &index.keys[i];
+        if (!rangeFits(0, key->first, sizeof(u32), postingsSize) ||
+            !rangeFits(key->first * sizeof(u32), key->count, sizeof(u32), postingsSize)) {
+            PANIC("%s has postings outside the file", path);
+        }
+    }
+
+    index.names = (const char **) malloc(sizeof(char *) * header->fileCount);
+    const char *name = (const char *) (base + header->namesOffset);
+    const char *namesEnd = (const char *) base + index.mappingSize;
+    for (u32 i = 0; i < header->fileCount; i++) {
+        const char *nameEnd = name < namesEnd ? (const char *) memchr(name, 0, namesEnd - name) : NULL;
+        if (!nameEnd) {
+            PANIC("%s has a truncated name table", path);
+        }
+        index.names[i] = name;
+        name = nameEnd + 1;
+    }
+
+    return index;
+}
+
+void closeIndex(SearchIndex *index) {
+#ifdef _WIN32
+    UnmapViewOfFile(index->mapping);
+#else
+    munmap(index->mapping, index->mappingSize);
+#endif
+    free(index->names);
+    *index = {};
+}
+
+static bool lookupName(const char *value, const char **names, u32 nameCount, u32 *result) {
+    for (u32 i = 0; i < nameCount; i++) {
+        if (strcmp(value, names[i]) == 0) {
+            *result = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseQueryTerm(const char *term, u32 *key) {
+    char buf[32];
+    const char *colon = strchr(term, ':');
+    if (!colon || strlen(colon + 1) >= sizeof(buf)) {
+        return false;
+    }
+
+    u32 kindLength = (u32) (colon - term);
+    const char *value = colon + 1;
+    u32 v = 0;
+
+    if (strncmp(term, "op", kindLength) == 0 && kindLength == 2) {
+        strcpy(buf, value);
+        for (char *p = buf; *p; p++) *p = toupper(*p);
+        Op op = decodeOpStr(buf);
+        if (op == OP_NONE) return false;
+        *key = INDEX_KEY(KEY_OP, op);
+    } else if (strncmp(term, "reg", kindLength) == 0 && kindLength == 3) {
+        if (!lookupName(value, REG_KEY_NAMES, REG_DS + 1, &v) || v == REG_NONE) return false;
+        *key = INDEX_KEY(KEY_REG, v);
+    } else if (strncmp(term, "eab", kindLength) == 0 && kindLength == 3) {
+        if (!lookupName(value, EAB_KEY_NAMES, EAB_BX + 1, &v) || v == EAB_NONE) return false;
+        *key = INDEX_KEY(KEY_EAB, v);
+    } else if (strncmp(term, "seg", kindLength) == 0 && kindLength == 3) {
+        if (!lookupName(value, REG_KEY_NAMES, REG_DS + 1, &v) || v < REG_ES) return false;
+        *key = INDEX_KEY(KEY_SEG, v);
+    } else if (strncmp(term, "dst", kindLength) == 0 && kindLength == 3) {
+        if (!lookupName(value, ARG_KEY_NAMES, ARG_REL_IMM + 1, &v)) return false;
+        *key = INDEX_KEY(KEY_DST_TYPE, v);
+    } else if (strncmp(term, "src", kindLength) == 0 && kindLength == 3) {
+        if (!lookupName(value, ARG_KEY_NAMES, ARG_REL_IMM + 1, &v)) return false;
+        *key = INDEX_KEY(KEY_SRC_TYPE, v);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static IndexKey *findKey(SearchIndex *index, u32 key) {
+    IndexKey *begin = index->keys;
+    IndexKey *end = index->keys + index->header->keyCount;
+    IndexKey *found = std::lower_bound(begin, end, key, [](const IndexKey &k, u32 v) {
+        return k.key < v;
+    });
+    return (found != end && found->key == key) ? found : NULL;
+}
+
+std::vector<u32> queryIndex(SearchIndex *index, u32 *keys, u32 keyCount) {
+    std::vector<u32> result;
+    if (keyCount == 0) {
+        return result;
+    }
+
+    std::vector<IndexKey *> lists;
+    for (u32 i = 0; i < keyCount; i++) {
+        IndexKey *key = findKey(index, keys[i]);
+        if (!key) {
+            return result;
+        }
+        lists.push_back(key);
+    }
+
+    // Drive the intersection from the shortest list, and binary search the
+    // rest so long lists are only touched where they could match
+    std::sort(lists.begin(), lists.end(), [](IndexKey *a, IndexKey *b) {
+        return a->count < b->count;
+    });
+
+    std::vector<u32 *> cursors;
+    for (IndexKey *key : lists) {
+        cursors.push_back(index->postings + key->first);
+    }
+
+    u32 *shortest = cursors[0];
+    u32 *shortestEnd = shortest + lists[0]->count;
+    for (u32 *id = shortest; id < shortestEnd; id++) {
+        bool matches = true;
+        for (u32 i = 1; i < lists.size(); i++) {
+            u32 *end = index->postings + lists[i]->first + lists[i]->count;
+            cursors[i] = std::lower_bound(cursors[i], end, *id);
+            if (cursors[i] == end) {
+                return result;
+            }
+            if (*cursors[i] != *id) {
+                matches = false;
+                break;
+            }
+        }
+        if (matches) {
+            if (*id >= index->header->instrCount ||
+                index->entries[*id].fileId >= index->header->fileCount) {
+                PANIC("Index posting %u is outside the index", *id);
+            }
+            result.push_back(*id);
+        }
+    }
+
+    return result;
+}
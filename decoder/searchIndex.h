@@ -0,0 +1,106 @@
+#pragma once
+
+#include "common.h"
+#include "sim86.h"
+
+#include <vector>
+
+/**
+ * Inverted index over decoded instructions.  Every instruction gets an id,
+ * and each key (an Op, a register operand, an effective address base, a
+ * segment override, or an operand type) maps to the sorted list of ids
+ * that have it.
+ *
+ * On disk the index is laid out as:
+ *   IndexHeader
+ *   IndexKey[keyCount]        sorted by key
+ *   u32 postings[]            instruction ids, sorted within each key
+ *   IndexEntry[instrCount]    where each instruction lives
+ *   char names[]              NUL terminated program paths
+ * so it can be mapped and queried without any parsing.
+ */
+
+#define INDEX_MAGIC "SIM86IDX"
+#define INDEX_VERSION 2
+
+enum IndexKeyKind {
+    KEY_OP = 0,
+    KEY_REG,
+    KEY_EAB,
+    KEY_DST_TYPE,
+    KEY_SRC_TYPE,
+    KEY_SEG,
+
+    KEY_KIND_COUNT,
+};
+
+#define INDEX_KEY_VALUES 128
+#define INDEX_KEY(kind, value) ((u32) (kind) * INDEX_KEY_VALUES + (u32) (value))
+
+struct IndexHeader {
+    char magic[8];
+    u32 version;
+    u32 fileCount;
+    u32 keyCount;
+    u32 instrCount;
+    u64 keysOffset;
+    u64 postingsOffset;
+    u64 entriesOffset;
+    u64 namesOffset;
+};
+
+struct IndexKey {
+    u32 key;
+    u32 count;
+    u64 first; // Index of the first posting for this key
+};
+
+struct IndexEntry {
+    u32 fileId;
+    u32 offset;
+};
+
+struct IndexBuilder {
+    std::vector<u32> postings[KEY_KIND_COUNT * INDEX_KEY_VALUES];
+    std::vector<IndexEntry> entries;
+    std::vector<const char *> names;
+};
+
+struct SearchIndex {
+    void *mapping;
+    u64 mappingSize;
+
+    IndexHeader *header;
+    IndexKey *keys;
+    u32 *postings;
+    IndexEntry *entries;
+    const char **names;
+};
+
+/**
+ * Add a decoded instruction at `offset` in program `fileId` to the index.
+ */
+void addInstrToIndex(IndexBuilder *builder, u32 fileId, u32 offset, Instr *instr);
+
+/**
+ * Serialize the index to `path`.
+ */
+void writeIndex(IndexBuilder *builder, const char *path);
+
+/**
+ * Map an index written by `writeIndex` into memory.
+ */
+SearchIndex openIndex(const char *path);
+void closeIndex(SearchIndex *index);
+
+/**
+ * Parse a query term of the form `kind:value`, such as `op:out`, `reg:dx`,
+ * `eab:bp_di`, `seg:es`, `dst:mem` or `src:imm`.  Returns false if the term
+ * is invalid.
+ */
+bool parseQueryTerm(const char *term, u32 *key);
+
+/**
+ * Return the ids of all instructions matching every key in `keys`.
+ */
+std::vector<u32> queryIndex(SearchIndex *index, u32 *keys, u32 keyCount);
@@ -1,18 +1,36 @@
 #include "common.h"
+
+// The profiler times every decoded and printed instruction, so it is only
+// compiled in when asked for with -DPROFILER=1.  profiler.h is the one in
+// haversine/reference, build.bat puts that directory on the include path
+#ifndef PROFILER
+#define PROFILER 0
+#endif
+#include "profiler.h"
+
 #include "sim86.h"
 #include "instTable.h"
 #include "decode.h"
 #include "print.h"
+#include "pairProfile.h"
+#include "searchIndex.h"
+#include "watch.h"
+#include "pipeline.h"
 
 #include "instTable.cpp"
 #include "decode.cpp"
 #include "print.cpp"
+#include "pairProfile.cpp"
+#include "searchIndex.cpp"
+#include "watch.cpp"
+#include "pipeline.cpp"
 
 #include <stdio.h>
+#include <chrono>
 
 #define MEMORY_SIZE (64 * 1024 * 1024)
 
-u8 memory[MEMORY_SIZE];
+alignas(WATCH_PAGE_SIZE) u8 memory[MEMORY_SIZE];
 
 /**
  * Read `size` bytes from simulation memory, into `dst`
@@ -47,6 +65,8 @@ static void loadProgram(const char *progFile) {
     lSize = ftell(fp);
     rewind(fp);
 
+    TimeBandwidth("load", lSize);
+
     u8 progData[lSize];
 
     int res = fread(progData, lSize, 1, fp);
@@ -84,28 +104,283 @@ static void handleFlags(InstrFlags *flags, Instr *instr) {
     }
 }
 
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: .\\sim8086.exe [program]\n");
-        exit(1);
+enum Mode {
+    MODE_DISASSEMBLE = 0,
+    MODE_INDEX,
+    MODE_QUERY,
+};
+
+struct Options {
+    Mode mode;
+    const char *progFile;
+    bool pairProfile;
+    std::vector<const char *> watchSpecs;
+    u32 formatterCount; // 0 disables the pipeline
+    bool printStats;
+    const char *statsFile;
+    bool printProfile;
+
+    // MODE_INDEX: programs to index, MODE_QUERY: query terms
+    const char *indexFile;
+    char **inputs;
+    u32 inputCount;
+};
+
+static void printUsage() {
+    fprintf(stderr, "Usage: .\\sim8086.exe [options] [program]\n");
+    fprintf(stderr, "       .\\sim8086.exe --index [index file] [programs...]\n");
+    fprintf(stderr, "       .\\sim8086.exe --query [index file] [kind:value...]\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --pairs    Print adjacent instruction pair profile to stderr\n");
+    fprintf(stderr, "  --watch start:size[:r|w|rw]\n");
+    fprintf(stderr, "             Log accesses to a range of simulation memory\n");
+    fprintf(stderr, "  --pipeline [formatter threads]\n");
+    fprintf(stderr, "             Decode, format and write on separate threads\n");
+    fprintf(stderr, "  --stats    Print decoder counters to stderr\n");
+    fprintf(stderr, "  --stats-csv [file]\n");
+    fprintf(stderr, "             Write decoder counters as CSV\n");
+    fprintf(stderr, "  --profile  Print load, decode and print times to stderr\n");
+    fprintf(stderr, "             (per stage times need a build with -DPROFILER=1)\n");
+    fprintf(stderr, "Query terms:\n");
+    fprintf(stderr, "  op:mov reg:dx eab:bp_di seg:es dst:mem src:imm (type is none/reg/mem/imm/rel)\n");
+    fprintf(stderr, "  reg: matches register operands, seg: matches segment overrides on memory operands\n");
+    exit(1);
+}
+
+static Options parseOptions(int argc, char **argv) {
+    Options options{};
+
+    if (argc >= 3 && (strcmp(argv[1], "--index") == 0 || strcmp(argv[1], "--query") == 0)) {
+        options.mode = strcmp(argv[1], "--index") == 0 ? MODE_INDEX : MODE_QUERY;
+        options.indexFile = argv[2];
+        options.inputs = argv + 3;
+        options.inputCount = argc - 3;
+        if (options.inputCount == 0) {
+            printUsage();
+        }
+        return options;
     }
 
-    initStrArena();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pairs") == 0) {
+            options.pairProfile = true;
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            options.watchSpecs.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options.printStats = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options.printProfile = true;
+        } else if (strcmp(argv[i], "--stats-csv") == 0 && i + 1 < argc) {
+            options.statsFile = argv[++i];
+        } else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            options.formatterCount = atoi(argv[++i]);
+            if (options.formatterCount < 1 || options.formatterCount > MAX_PIPELINE_FORMATTERS) {
+                printUsage();
+            }
+        } else if (argv[i][0] == '-' || options.progFile) {
+            printUsage();
+        } else {
+            options.progFile = argv[i];
+        }
+    }
 
-    InstrDefTable defTable = getInstTable();
+    if (!options.progFile) {
+        printUsage();
+    }
+
+    return options;
+}
 
-    loadProgram(argv[1]);
+static f64 millisecondsSince(std::chrono::steady_clock::time_point start) {
+    std::chrono::duration<f64, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
 
-    u32 programOffset = 0;
-    u8 nextByte = 0;
-    Instr instr;
-    InstrFlags flags;
-    while (nextByte != 0x0f) {
-        programOffset += decodeNextInstr(&instr, programOffset, defTable);
-        handleFlags(&flags, &instr);
-        printInstr(instr);
+/**
+ * Decode every program in `options->inputs` and write an index of
+ * the decoded instructions to `options->indexFile`
+ */
+static void buildIndex(Options *options, InstrDefTable &defTable) {
+    auto start = std::chrono::steady_clock::now();
+
+    static IndexBuilder builder;
+    for (u32 fileId = 0; fileId < options->inputCount; fileId++) {
+        loadProgram(options->inputs[fileId]);
+        builder.names.push_back(options->inputs[fileId]);
+
+        u32 programOffset = 0;
+        u8 nextByte = 0;
+        Instr instr;
+        InstrFlags flags{};
         readMem(&nextByte, programOffset, 1);
+        while (nextByte != 0x0f) {
+            u32 instrOffset = programOffset;
+            programOffset += decodeNextInstr(&instr, programOffset, defTable);
+            handleFlags(&flags, &instr);
+            addInstrToIndex(&builder, fileId, instrOffset, &instr);
+            readMem(&nextByte, programOffset, 1);
+        }
+    }
+
+    writeIndex(&builder, options->indexFile);
+
+    fprintf(stderr, "Indexed %llu instructions from %u programs in %.3fms\n",
+            (unsigned long long) builder.entries.size(), options->inputCount,
+            millisecondsSince(start));
+}
+
+/**
+ * Print the location of every instruction matching all query terms
+ */
+static void runQuery(Options *options) {
+    std::vector<u32> keys;
+    for (u32 i = 0; i < options->inputCount; i++) {
+        u32 key;
+        if (!parseQueryTerm(options->inputs[i], &key)) {
+            fprintf(stderr, "Invalid query term: %s\n", options->inputs[i]);
+            printUsage();
+        }
+        keys.push_back(key);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SearchIndex index = openIndex(options->indexFile);
+    std::vector<u32> hits = queryIndex(&index, keys.data(), (u32) keys.size());
+    f64 queryTime = millisecondsSince(start);
+
+    for (u32 id : hits) {
+        IndexEntry entry = index.entries[id];
+        printf("%s:%u\n", index.names[entry.fileId], entry.offset);
+    }
+
+    fprintf(stderr, "%llu matches out of %u instructions in %.3fms\n",
+            (unsigned long long) hits.size(), index.header->instrCount, queryTime);
+
+    closeIndex(&index);
+}
+
+struct DecodeState {
+    Options *options;
+    InstrDefTable *defTable;
+    PairProfile *pairProfile;
+
+    u32 programOffset;
+    u8 nextByte;
+    InstrFlags flags;
+};
+
+/**
+ * Decode the next instruction of the loaded program into `instr`, or
+ * return false at the end of the program
+ */
+static bool decodeStep(DecodeState *state, Instr *instr) {
+    if (state->nextByte == 0x0f) {
+        return false;
+    }
+
+    TimeBlock("decode");
+
+    u32 instrOffset = state->programOffset;
+    state->programOffset += decodeNextInstr(instr, state->programOffset, *state->defTable);
+    if (watchPendingCount) {
+        rearmWatchpoints(instrOffset);
+    }
+    handleFlags(&state->flags, instr);
+    if (state->options->pairProfile) {
+        recordInstrPair(state->pairProfile, instr);
     }
+    readMem(&state->nextByte, state->programOffset, 1);
 
-    destroyStrArena();
+    return true;
+}
+
+static u32 decodeBatch(Instr *instrs, u32 maxCount, void *context) {
+    DecodeState *state = (DecodeState *) context;
+    u32 count = 0;
+    while (count < maxCount && decodeStep(state, &instrs[count])) {
+        count++;
+    }
+    return count;
 }
+
+int main(int argc, char **argv) {
+    BeginProfile();
+
+    Options options = parseOptions(argc, argv);
+
+    if (options.mode == MODE_QUERY) {
+        runQuery(&options);
+        return 0;
+    }
+
+    InstrDefTable defTable = getInstTable();
+
+    if (options.mode == MODE_INDEX) {
+        buildIndex(&options, defTable);
+        return 0;
+    }
+
+    loadProgram(options.progFile);
+
+    bool watching = !options.watchSpecs.empty();
+    if (watching) {
+        initWatchpoints(memory, MEMORY_SIZE);
+        for (const char *spec : options.watchSpecs) {
+            if (!addWatchpointSpec(spec)) {
+                fprintf(stderr, "Invalid watchpoint: %s\n", spec);
+                printUsage();
+            }
+        }
+        armWatchpoints();
+    }
+
+    static PairProfile pairProfile;
+
+    DecodeState state{};
+    state.options = &options;
+    state.defTable = &defTable;
+    state.pairProfile = &pairProfile;
+
+    if (options.formatterCount) {
+        // Formatting and writing happen on other threads, which the
+        // profiler can't time, so they only show up in the total
+        TimeBlock("pipeline");
+        runPipeline(options.formatterCount, decodeBatch, &state, stdout);
+    } else {
+        Instr instr;
+        while (decodeStep(&state, &instr)) {
+            TimeBlock("print");
+            printInstr(instr);
+        }
+    }
+
+    if (options.pairProfile) {
+        printPairProfile(&pairProfile, 16);
+    }
+
+    if (watching) {
+        printWatchHits();
+    }
+
+    if (options.printStats) {
+        printDecodeStats(stderr, defTable);
+    }
+
+    if (options.statsFile) {
+        FILE *statsFp = fopen(options.statsFile, "w");
+        if (!statsFp) {
+            PANIC("Failed to open %s", options.statsFile);
+        }
+        writeDecodeStatsCsv(statsFp, defTable);
+        fclose(statsFp);
+    }
+
+    if (options.printProfile) {
+#if !PROFILER
+        fprintf(stderr, "\nBuilt without -DPROFILER=1, only the total is timed\n");
+#endif
+        EndAndPrintProfile(stderr);
+    }
+}
+
+ProfilerEndOfCompilationUnit;
@@ -0,0 +1,366 @@
+#include "watch.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+static struct WatchState {
+    u8 *memory;
+    u32 memorySize;
+
+    Watchpoint watchpoints[MAX_WATCHPOINTS];
+    u32 watchpointCount;
+
+    // Union of WatchKind over all watchpoints touching each page
+    u8 *pageKinds;
+
+    WatchHit hits[MAX_WATCH_HITS];
+    u32 hitCount;
+    u32 droppedHits;
+
+    // Hits logged by the fault handler that have not been given an IP
+    u32 pendingHitStart;
+    u32 pendingPages[MAX_PENDING_PAGES];
+} watchState;
+
+volatile u32 watchPendingCount = 0;
+
+#ifdef _WIN32
+
+typedef DWORD PageProtection;
+#define WATCH_PAGE_OPEN PAGE_READWRITE
+
+static PageProtection getPageProtection(u8 kinds) {
+    if (kinds & WATCH_READ) return PAGE_NOACCESS;
+    if (kinds & WATCH_WRITE) return PAGE_READONLY;
+    return PAGE_READWRITE;
+}
+
+static void protectPage(u32 page, PageProtection prot) {
+    u8 *base = watchState.memory + (u64) page * WATCH_PAGE_SIZE;
+    DWORD previous;
+    if (!VirtualProtect(base, WATCH_PAGE_SIZE, prot, &previous)) {
+        PANIC("VirtualProtect failed");
+    }
+}
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define WATCH_SINGLE_STEP 1
+#endif
+
+#else
+
+typedef int PageProtection;
+#define WATCH_PAGE_OPEN (PROT_READ | PROT_WRITE)
+
+static PageProtection getPageProtection(u8 kinds) {
+    if (kinds & WATCH_READ) return PROT_NONE;
+    if (kinds & WATCH_WRITE) return PROT_READ;
+    return PROT_READ | PROT_WRITE;
+}
+
+// protectPage runs inside the SIGSEGV and SIGTRAP handlers, where PANIC's
+// stdio and exit aren't safe, so failing is just write and _exit
+#define WATCH_FAIL(message) watchFail(message "\n", sizeof(message "\n") - 1)
+
+static void watchFail(const char *message, size_t length) {
+    ssize_t written = write(STDERR_FILENO, message, length);
+    (void) written;
+    _exit(1);
+}
+
+static void protectPage(u32 page, PageProtection prot) {
+    u8 *base = watchState.memory + (u64) page * WATCH_PAGE_SIZE;
+    if (mprotect(base, WATCH_PAGE_SIZE, prot) != 0) {
+        WATCH_FAIL("Uh Oh! watch.cpp: mprotect failed");
+    }
+}
+
+#if defined(__x86_64__) && defined(REG_ERR)
+#define WATCH_SINGLE_STEP 1
+#endif
+
+#endif
+
+#define TRAP_FLAG 0x100
+
+#if WATCH_SINGLE_STEP
+// Page opened by the last fault, closed again by the single-step trap
+static volatile i32 steppingPage = -1;
+static volatile i32 steppingHit = -1;
+#endif
+
+static bool isWatchedMemory(u8 *faultAddr) {
+    if (faultAddr < watchState.memory || faultAddr >= watchState.memory + watchState.memorySize) {
+        return false;
+    }
+#if !WATCH_SINGLE_STEP
+    // Every open page is remembered until the next rearm
+    if (watchPendingCount >= MAX_PENDING_PAGES) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+/**
+ * Log a fault on watched memory and open its page.  With single stepping
+ * the caller also has to set the trap flag before resuming.
+ */
+static void onWatchedAccess(u8 *faultAddr, bool write) {
+    sim_ptr addr = (sim_ptr) (faultAddr - watchState.memory);
+    u32 page = addr / WATCH_PAGE_SIZE;
+
+    for (u32 i = 0; i < watchState.watchpointCount; i++) {
+        Watchpoint *wp = &watchState.watchpoints[i];
+        if (addr >= wp->start && addr - wp->start < wp->size &&
+            (wp->kind & (write ? WATCH_WRITE : WATCH_READ))) {
+            if (watchState.hitCount < MAX_WATCH_HITS) {
+#if WATCH_SINGLE_STEP
+                steppingHit = watchState.hitCount;
+#endif
+                watchState.hits[watchState.hitCount++] = { 0, addr, 0, write };
+            } else {
+                watchState.droppedHits++;
+            }
+            break;
+        }
+    }
+
+    protectPage(page, WATCH_PAGE_OPEN);
+
+#if WATCH_SINGLE_STEP
+    // Let just the faulting host instruction through, so every access to
+    // a watched byte is seen, not only the first one on the page
+    steppingPage = page;
+#else
+    // Leave the page open until the current simulated instruction is done
+    watchState.pendingPages[watchPendingCount] = page;
+#endif
+    watchPendingCount = watchPendingCount + 1;
+}
+
+#if WATCH_SINGLE_STEP
+/**
+ * The faulting instruction has completed: record the value it read or
+ * wrote and close its page again.  Returns false if no step was pending.
+ */
+static bool onWatchStepped() {
+    if (steppingPage < 0) {
+        return false;
+    }
+
+    if (steppingHit >= 0) {
+        WatchHit *hit = &watchState.hits[steppingHit];
+        hit->value = watchState.memory[hit->addr];
+        steppingHit = -1;
+    }
+    protectPage(steppingPage, getPageProtection(watchState.pageKinds[steppingPage]));
+    steppingPage = -1;
+    return true;
+}
+#endif
+
+#ifdef _WIN32
+
+static PVOID watchHandler;
+
+static LONG CALLBACK onWatchException(EXCEPTION_POINTERS *exception) {
+    EXCEPTION_RECORD *record = exception->ExceptionRecord;
+
+    if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION && record->NumberParameters >= 2) {
+        u8 *faultAddr = (u8 *) record->ExceptionInformation[1];
+        if (!isWatchedMemory(faultAddr)) {
+            return EXCEPTION_CONTINUE_SEARCH;
+        }
+
+        // 0 is a read, 1 a write, 8 an execute
+        onWatchedAccess(faultAddr, record->ExceptionInformation[0] == 1);
+#if WATCH_SINGLE_STEP
+        exception->ContextRecord->EFlags |= TRAP_FLAG;
+#endif
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+
+#if WATCH_SINGLE_STEP
+    if (record->ExceptionCode == EXCEPTION_SINGLE_STEP && onWatchStepped()) {
+        exception->ContextRecord->EFlags &= ~TRAP_FLAG;
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+#endif
+
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+static void installWatchHandlers() {
+    // First in line, so a debugger's or the CRT's handler doesn't see our faults
+    watchHandler = AddVectoredExceptionHandler(1, onWatchException);
+    if (!watchHandler) {
+        PANIC("AddVectoredExceptionHandler failed");
+    }
+}
+
+static void removeWatchHandlers() {
+    RemoveVectoredExceptionHandler(watchHandler);
+    watchHandler = NULL;
+}
+
+#else
+
+static struct sigaction previousSegvAction;
+
+#if WATCH_SINGLE_STEP
+static void onWatchStep(int, siginfo_t *, void *context) {
+    ucontext_t *uc = (ucontext_t *) context;
+    if (onWatchStepped()) {
+        uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+    }
+}
+#endif
+
+static void onWatchFault(int, siginfo_t *info, void *context) {
+    u8 *faultAddr = (u8 *) info->si_addr;
+    if (!isWatchedMemory(faultAddr)) {
+        // Not ours, let the previous handler (or the default) deal with it
+        sigaction(SIGSEGV, &previousSegvAction, NULL);
+        return;
+    }
+
+    ucontext_t *uc = (ucontext_t *) context;
+    bool write;
+#ifdef REG_ERR
+    // Bit 1 of the x86 page fault error code is set for writes
+    write = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+#else
+    // Without the fault error code, a page that only traps writes must have
+    // faulted on one.  A page that also traps reads can't tell the two
+    // apart, so every access to it is logged as a read
+    (void) uc;
+    u32 page = (u32) (faultAddr - watchState.memory) / WATCH_PAGE_SIZE;
+    write = !(watchState.pageKinds[page] & WATCH_READ);
+#endif
+
+    onWatchedAccess(faultAddr, write);
+#if WATCH_SINGLE_STEP
+    uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+#endif
+}
+
+static void installWatchHandlers() {
+    struct sigaction action{};
+    action.sa_sigaction = onWatchFault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previousSegvAction);
+
+#if WATCH_SINGLE_STEP
+    struct sigaction stepAction{};
+    stepAction.sa_sigaction = onWatchStep;
+    stepAction.sa_flags = SA_SIGINFO;
+    sigemptyset(&stepAction.sa_mask);
+    sigaction(SIGTRAP, &stepAction, NULL);
+#endif
+}
+
+static void removeWatchHandlers() {
+    sigaction(SIGSEGV, &previousSegvAction, NULL);
+}
+
+#endif
+
+void initWatchpoints(u8 *memory, u32 memorySize) {
+    assert(((u64) memory % WATCH_PAGE_SIZE) == 0 && "Watched memory must be page aligned");
+
+    watchState.memory = memory;
+    watchState.memorySize = memorySize;
+    watchState.pageKinds = (u8 *) calloc(memorySize / WATCH_PAGE_SIZE, 1);
+
+    installWatchHandlers();
+}
+
+void armWatchpoints() {
+    u32 pageCount = watchState.memorySize / WATCH_PAGE_SIZE;
+    for (u32 page = 0; page < pageCount; page++) {
+        if (watchState.pageKinds[page]) {
+            protectPage(page, getPageProtection(watchState.pageKinds[page]));
+        }
+    }
+}
+
+void rearmWatchpoints(sim_ptr ip) {
+    for (u32 i = watchState.pendingHitStart; i < watchState.hitCount; i++) {
+        watchState.hits[i].ip = ip;
+#if !WATCH_SINGLE_STEP
+        // The page is still open here, so this doesn't fault
+        watchState.hits[i].value = watchState.memory[watchState.hits[i].addr];
+#endif
+    }
+    watchState.pendingHitStart = watchState.hitCount;
+
+#if !WATCH_SINGLE_STEP
+    for (u32 i = 0; i < watchPendingCount; i++) {
+        u32 page = watchState.pendingPages[i];
+        protectPage(page, getPageProtection(watchState.pageKinds[page]));
+    }
+#endif
+    watchPendingCount = 0;
+}
+
+void printWatchHits() {
+    u32 pageCount = watchState.memorySize / WATCH_PAGE_SIZE;
+    for (u32 page = 0; page < pageCount; page++) {
+        if (watchState.pageKinds[page]) {
+            protectPage(page, WATCH_PAGE_OPEN);
+        }
+    }
+    removeWatchHandlers();
+
+    fprintf(stderr, "Watchpoint hits: %u", watchState.hitCount);
+    if (watchState.droppedHits) {
+        fprintf(stderr, " (%u dropped)", watchState.droppedHits);
+    }
+    fprintf(stderr, "\n");
+
+    for (u32 i = 0; i < watchState.hitCount; i++) {
+        WatchHit *hit = &watchState.hits[i];
+        fprintf(stderr, "  ip=0x%04x %s [0x%04x] value=0x%02x\n",
+                hit->ip, hit->write ? "write" : "read ", hit->addr, hit->value);
+    }
+
+    free(watchState.pageKinds);
+}
+
+bool addWatchpointSpec(const char *spec) {
+    char *end;
+    u64 start = strtoul(spec, &end, 0);
+    if (*end != ':') return false;
+    u64 size = strtoul(end + 1, &end, 0);
+    if (size == 0) return false;
+
+    u32 kind = WATCH_READ | WATCH_WRITE;
+    if (*end == ':') {
+        end++;
+        if (strcmp(end, "r") == 0) kind = WATCH_READ;
+        else if (strcmp(end, "w") == 0) kind = WATCH_WRITE;
+        else if (strcmp(end, "rw") != 0) return false;
+    } else if (*end != '\0') {
+        return false;
+    }
+
+    if (!watchState.pageKinds || start + size > watchState.memorySize ||
+        watchState.watchpointCount >= MAX_WATCHPOINTS) {
+        return false;
+    }
+
+    watchState.watchpoints[watchState.watchpointCount++] = { (sim_ptr) start, (u32) size, kind };
+    for (u64 page = start / WATCH_PAGE_SIZE; page <= (start + size - 1) / WATCH_PAGE_SIZE; page++) {
+        watchState.pageKinds[page] |= kind;
+    }
+
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "common.h"
+#include "sim86.h"
+
+/**
+ * Memory watchpoints backed by host page protection.
+ *
+ * The host pages behind watched ranges of simulation memory are
+ * protected (mprotect, or VirtualProtect on Windows), so unwatched accesses
+ * go through readMem/writeMem without any checks.  An access to a watched
+ * page faults, and the SIGSEGV handler (a vectored exception handler on
+ * Windows) logs it and opens the page.  On x86-64 the faulting host
+ * instruction is then single-stepped and the page closed again right after
+ * it, elsewhere the page stays open until `rearmWatchpoints` at the end of
+ * the instruction.
+ *
+ * Reads and writes are told apart by the fault itself on Windows and on
+ * x86 POSIX hosts (the page fault error code).  On other POSIX hosts only
+ * write-only watches are reported as writes: a page watched for reads
+ * faults on both, and every access to it is logged as a read.
+ */
+
+#define WATCH_PAGE_SIZE 4096
+#define MAX_WATCHPOINTS 64
+#define MAX_WATCH_HITS (64 * 1024)
+#define MAX_PENDING_PAGES 16
+
+enum WatchKind {
+    WATCH_READ = 1 << 0,
+    WATCH_WRITE = 1 << 1,
+};
+
+struct Watchpoint {
+    sim_ptr start;
+    u32 size;
+    u32 kind;
+};
+
+struct WatchHit {
+    sim_ptr ip;
+    sim_ptr addr;
+    u8 value;
+    bool write;
+};
+
+/**
+ * Set up the fault handler for `memory`, which must be page aligned.
+ */
+void initWatchpoints(u8 *memory, u32 memorySize);
+
+/**
+ * Parse `start:size[:r|w|rw]` (numbers in C notation) and add the
+ * watchpoint.  Returns false if the spec is invalid.
+ */
+bool addWatchpointSpec(const char *spec);
+
+/**
+ * Protect all pages that back a watchpoint.
+ */
+void armWatchpoints();
+
+/**
+ * Faults taken since the last call to `rearmWatchpoints`.  Only non-zero
+ * when a watched page was touched, so this is one load in the common case.
+ */
+extern volatile u32 watchPendingCount;
+
+/**
+ * Attribute pending hits to instruction `ip`, and re-protect any pages
+ * still open.
+ */
+void rearmWatchpoints(sim_ptr ip);
+
+/**
+ * Remove all protection and print every recorded hit to stderr.
+ */
+void printWatchHits();
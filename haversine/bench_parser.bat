@@ -0,0 +1,49 @@
+@ECHO OFF
+REM Wall time and peak working set of haversine_parser against an older
+REM build of it, on 1M and 10M pair inputs.  Run from haversine\ with zig
+REM 0.12 on the PATH:  bench_parser.bat <baseline commit>
+SETLOCAL
+IF "%~1"=="" (
+    ECHO Usage: bench_parser.bat ^<baseline commit^>
+    EXIT /B 1
+)
+
+SET BENCH_DIR=%CD%\zig-out\bench
+SET BASELINE_TREE=%BENCH_DIR%\baseline-src
+
+zig build -Doptimize=ReleaseFast -p "%BENCH_DIR%\new" || EXIT /B 1
+
+IF EXIST "%BASELINE_TREE%" git worktree remove --force "%BASELINE_TREE%"
+git worktree add --detach "%BASELINE_TREE%" %1 || EXIT /B 1
+PUSHD "%BASELINE_TREE%\haversine"
+zig build -Doptimize=ReleaseFast -p "%BENCH_DIR%\old"
+SET BUILD_RESULT=%ERRORLEVEL%
+POPD
+git worktree remove --force "%BASELINE_TREE%"
+IF NOT "%BUILD_RESULT%"=="0" EXIT /B 1
+
+PUSHD "%BENCH_DIR%"
+FOR %%N IN (1000000 10000000) DO (
+    IF NOT EXIST haversine-data_%%N.json "%BENCH_DIR%\new\bin\haversine_generator.exe" uniform 1 %%N
+    FOR %%B IN (old new) DO (
+        ECHO.
+        ECHO ==== %%B, %%N pairs
+        CALL :measure "%BENCH_DIR%\%%B\bin\haversine_parser.exe" haversine-data_%%N.json
+    )
+)
+POPD
+EXIT /B 0
+
+REM Peak working set is polled from outside the process, so the old build,
+REM which doesn't print its own, is measured the same way as the new one
+:measure
+powershell -NoProfile -Command ^
+    "$timer = [Diagnostics.Stopwatch]::StartNew();" ^
+    "$process = Start-Process -FilePath '%~1' -ArgumentList '%~2' -NoNewWindow -PassThru;" ^
+    "$handle = $process.Handle; $peak = 0;" ^
+    "while (-not $process.HasExited) { try { $process.Refresh(); $peak = [Math]::Max($peak, $process.PeakWorkingSet64) } catch {}; Start-Sleep -Milliseconds 5 };" ^
+    "$timer.Stop();" ^
+    "'Exit Code: {0}' -f $process.ExitCode;" ^
+    "'Wall Time: {0:N3} seconds' -f $timer.Elapsed.TotalSeconds;" ^
+    "'Peak Working Set: {0:N2} MB (polled)' -f ($peak / 1MB)"
+EXIT /B 0
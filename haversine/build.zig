@@ -19,6 +19,48 @@ pub fn build(b: *std.Build) !void {
     reference_parser.linkLibC();
     b.installArtifact(reference_parser);
 
+    const number_conversion_bench = b.addExecutable(.{
+        .name = "REF_number_conversion_bench",
+        .target = target,
+        .optimize = optimize,
+    });
+    number_conversion_bench.addCSourceFile(.{
+        .file = .{
+            .path = "./reference/number_conversion_bench.cpp",
+        },
+        .flags = &.{},
+    });
+    number_conversion_bench.linkLibC();
+    b.installArtifact(number_conversion_bench);
+
+    const math_sweep = b.addExecutable(.{
+        .name = "REF_math_sweep",
+        .target = target,
+        .optimize = optimize,
+    });
+    math_sweep.addCSourceFile(.{
+        .file = .{
+            .path = "./reference/math_sweep.cpp",
+        },
+        .flags = &.{},
+    });
+    math_sweep.linkLibC();
+    b.installArtifact(math_sweep);
+
+    const layout_bench = b.addExecutable(.{
+        .name = "REF_layout_bench",
+        .target = target,
+        .optimize = optimize,
+    });
+    layout_bench.addCSourceFile(.{
+        .file = .{
+            .path = "./reference/layout_bench.cpp",
+        },
+        .flags = &.{},
+    });
+    layout_bench.linkLibC();
+    b.installArtifact(layout_bench);
+
     const generator_exe = b.addExecutable(.{
         .name = "haversine_generator",
         .root_source_file = .{ .path = "./generate.zig" },
@@ -28,11 +70,22 @@ pub fn build(b: *std.Build) !void {
     generator_exe.linkLibC();
     b.installArtifact(generator_exe);
 
+    //- ojf: perf timers are compiled in for debug builds and out for release
+    // ones unless asked for, so a release parser carries no instrumentation
+    const perf_enabled = b.option(
+        bool,
+        "perf",
+        "Compile the perf timers into haversine_parser (default: only in Debug)",
+    ) orelse (optimize == .Debug);
+    const parser_options = b.addOptions();
+    parser_options.addOption(bool, "perf_enabled", perf_enabled);
+
     const parser_exe = b.addExecutable(.{
         .name = "haversine_parser",
         .root_source_file = .{ .path = "./parser.zig" },
         .target = target,
         .optimize = optimize,
     });
+    parser_exe.root_module.addOptions("build_options", parser_options);
     b.installArtifact(parser_exe);
 }
@@ -11,7 +11,7 @@ pub fn print(comptime fmt: []const u8, args: anytype) void {
 }
 
 fn printUsage() void {
-    print("Usage: haversine_generator.exe [uniform/cluster] [random seed] [number of coordinate pairs to generate]", .{});
+    print("Usage: haversine_generator.exe [uniform/cluster] [random seed] [number of coordinate pairs to generate] [pairs] [-threads n]", .{});
 }
 
 const GenerationMode = enum {
@@ -26,6 +26,137 @@ const Pair = struct {
     y1: f64,
 };
 
+//- ojf: the same pairs as a columnar binary file, see
+// reference/haversine_pair_file.cpp for the layout, the two have to match
+const pair_file_magic: u64 = 0x5352494150564148; // "HAVPAIRS"
+const pair_file_version: u32 = 1;
+const pair_file_header_size: u64 = 128;
+const pair_file_alignment: u64 = 64;
+const pair_file_column_count = 4;
+const pair_file_write_batch = 4096;
+
+const PairFileHeader = extern struct {
+    magic: u64 = pair_file_magic,
+    version: u32 = pair_file_version,
+    header_size: u32 = pair_file_header_size,
+
+    pair_count: u64,
+    column_offset: u64 = pair_file_header_size,
+    column_stride: u64,
+
+    source_hash: u64 = 0,
+    source_size: u64 = 0,
+
+    column_checksums: [pair_file_column_count]u64 = .{0} ** pair_file_column_count,
+
+    reserved: [5]u64 = .{0} ** 5,
+};
+
+comptime {
+    std.debug.assert(@sizeOf(PairFileHeader) == pair_file_header_size);
+}
+
+const PairFileWriter = struct {
+    file: std.fs.File,
+    header: PairFileHeader,
+
+    //- ojf: pairs come one at a time but the columns are far apart in the
+    // file, so each column gets batched and written at its own offset
+    batch: [pair_file_column_count][pair_file_write_batch]f64 = undefined,
+    batch_count: usize = 0,
+    written_count: u64 = 0,
+
+    //- ojf: Fletcher style, a += bits, b += a, the checksum is b
+    checksum_a: [pair_file_column_count]u64 = .{0} ** pair_file_column_count,
+    checksum_b: [pair_file_column_count]u64 = .{0} ** pair_file_column_count,
+
+    fn init(file: std.fs.File, pair_count: u64) PairFileWriter {
+        const column_bytes = pair_count * @sizeOf(f64);
+        return .{
+            .file = file,
+            .header = .{
+                .pair_count = pair_count,
+                .column_stride = (column_bytes + pair_file_alignment - 1) & ~(pair_file_alignment - 1),
+            },
+        };
+    }
+
+    fn append(self: *PairFileWriter, pair: Pair) !void {
+        const values = [pair_file_column_count]f64{ pair.x0, pair.y0, pair.x1, pair.y1 };
+        for (values, 0..) |value, column| {
+            self.batch[column][self.batch_count] = value;
+
+            const bits: u64 = @bitCast(value);
+            self.checksum_a[column] +%= bits;
+            self.checksum_b[column] +%= self.checksum_a[column];
+        }
+
+        self.batch_count += 1;
+        if (self.batch_count == pair_file_write_batch) {
+            try self.flush();
+        }
+    }
+
+    fn flush(self: *PairFileWriter) !void {
+        for (0..pair_file_column_count) |column| {
+            const offset = self.header.column_offset +
+                @as(u64, column) * self.header.column_stride +
+                self.written_count * @sizeOf(f64);
+            try self.file.pwriteAll(std.mem.sliceAsBytes(self.batch[column][0..self.batch_count]), offset);
+        }
+
+        self.written_count += @as(u64, @intCast(self.batch_count));
+        self.batch_count = 0;
+    }
+
+    fn finish(self: *PairFileWriter, source_hash: u64, source_size: u64) !void {
+        try self.flush();
+
+        self.header.source_hash = source_hash;
+        self.header.source_size = source_size;
+        self.header.column_checksums = self.checksum_b;
+
+        //- ojf: the last column's padding never gets written, so size the
+        // file explicitly
+        try self.file.setEndPos(self.header.column_offset + pair_file_column_count * self.header.column_stride);
+        try self.file.pwriteAll(std.mem.asBytes(&self.header), 0);
+    }
+};
+
+//- ojf: the pair file records a hash of the json it came from
+const JsonWriter = struct {
+    file: std.fs.File,
+    hash: std.hash.Fnv1a_64 = std.hash.Fnv1a_64.init(),
+    size: u64 = 0,
+
+    fn write(self: *JsonWriter, bytes: []const u8) !void {
+        try self.file.writeAll(bytes);
+        self.hash.update(bytes);
+        self.size += bytes.len;
+    }
+};
+
+//- ojf: every chunk of pairs gets its own generator seeded from the
+// master seed and the chunk's index, and every cluster its own from the
+// cluster's index, so the output only depends on the seed and the count,
+// never on how many threads made it or which one got which chunk.
+//
+// this (and the {d} number formatting below) changed what a given seed
+// produces: data and answer files made by the single-threaded generator
+// can't be regenerated from their seed any more, make them again instead
+const pairs_per_chunk: u64 = 1 << 16;
+const cluster_count = 64;
+
+const SeedStream = enum(u64) {
+    chunk,
+    cluster,
+};
+
+fn deriveSeed(seed: u64, stream: SeedStream, index: u64) u64 {
+    const key = [2]u64{ @intFromEnum(stream), index };
+    return std.hash.Wyhash.hash(seed, std.mem.asBytes(&key));
+}
+
 fn generateUniformPoint(rand: *std.Random) Pair {
     return .{
         .x0 = 360.0 * rand.float(f64) - 180.0,
@@ -39,16 +170,21 @@ const ClusterData = struct {
     cluster_point_x: f64 = 0.0,
     cluster_point_y: f64 = 0.0,
     cluster_size: f64 = 0.0,
-    change_factor: u64,
 };
 
-fn generateClusterPoint(index: u64, rand: *std.Random, cluster_data: *ClusterData) Pair {
-    if (index % cluster_data.change_factor == 0) {
-        cluster_data.cluster_size = 360.0 * rand.float(f64);
+fn clusterAt(seed: u64, cluster_index: u64) ClusterData {
+    var rng = std.Random.DefaultPrng.init(deriveSeed(seed, .cluster, cluster_index));
+    const rand = rng.random();
 
-        cluster_data.cluster_point_x = (360.0 - cluster_data.cluster_size) * rand.float(f64) - (180.0 - cluster_data.cluster_size / 2.0);
-        cluster_data.cluster_point_y = (180.0 - cluster_data.cluster_size) * rand.float(f64) - (90.0 - cluster_data.cluster_size / 2.0);
-    }
+    const cluster_size = 360.0 * rand.float(f64);
+    return .{
+        .cluster_point_x = (360.0 - cluster_size) * rand.float(f64) - (180.0 - cluster_size / 2.0),
+        .cluster_point_y = (180.0 - cluster_size) * rand.float(f64) - (90.0 - cluster_size / 2.0),
+        .cluster_size = cluster_size,
+    };
+}
+
+fn generateClusterPoint(rand: *std.Random, cluster_data: *const ClusterData) Pair {
     const cluster_point_x = cluster_data.cluster_point_x;
     const cluster_point_y = cluster_data.cluster_point_y;
     const cluster_size = cluster_data.cluster_size;
@@ -61,6 +197,155 @@ fn generateClusterPoint(index: u64, rand: *std.Random, cluster_data: *ClusterDat
     };
 }
 
+const GenerationParams = struct {
+    mode: GenerationMode,
+    seed: u64,
+    num_points: u64,
+    points_per_cluster: u64,
+    keep_pairs: bool,
+};
+
+//- ojf: one chunk's worth of output, the buffers are reused chunk to chunk
+// so memory stays flat however many pairs get generated
+const Chunk = struct {
+    first_index: u64 = 0,
+    count: u64 = 0,
+
+    json: std.ArrayList(u8),
+    answers: std.ArrayList(f64),
+    pairs: std.ArrayList(Pair),
+    answer_sum: f64 = 0,
+
+    err: ?anyerror = null,
+
+    fn init(allocator: Allocator) Chunk {
+        return .{
+            .json = std.ArrayList(u8).init(allocator),
+            .answers = std.ArrayList(f64).init(allocator),
+            .pairs = std.ArrayList(Pair).init(allocator),
+        };
+    }
+
+    fn deinit(self: *Chunk) void {
+        self.json.deinit();
+        self.answers.deinit();
+        self.pairs.deinit();
+    }
+};
+
+//- ojf: one chunk per generating thread.  main keeps two of these, so one
+// wave gets generated while the one before it is being written out
+const Wave = struct {
+    chunks: []Chunk,
+    threads: []std.Thread,
+    count: usize = 0,
+    running: usize = 0,
+
+    fn init(allocator: Allocator, thread_count: usize) !Wave {
+        const wave = Wave{
+            .chunks = try allocator.alloc(Chunk, thread_count),
+            .threads = try allocator.alloc(std.Thread, thread_count),
+        };
+        for (wave.chunks) |*chunk| {
+            chunk.* = Chunk.init(std.heap.page_allocator);
+        }
+        return wave;
+    }
+
+    fn deinit(self: *Wave) void {
+        for (self.chunks) |*chunk| {
+            chunk.deinit();
+        }
+    }
+
+    fn assignChunks(self: *Wave, next_index: *u64, num_points: u64) void {
+        self.count = 0;
+        while (self.count < self.chunks.len and next_index.* < num_points) : (self.count += 1) {
+            self.chunks[self.count].first_index = next_index.*;
+            self.chunks[self.count].count = @min(pairs_per_chunk, num_points - next_index.*);
+            next_index.* += self.chunks[self.count].count;
+        }
+    }
+
+    //- ojf: if a spawn fails the threads that did start are joined before
+    // the error goes up, nothing is left writing into the chunks
+    fn start(self: *Wave, params: *const GenerationParams) !void {
+        errdefer self.join();
+        for (self.chunks[0..self.count], self.threads[0..self.count]) |*chunk, *thread| {
+            thread.* = try std.Thread.spawn(.{}, generateChunk, .{ params, chunk });
+            self.running += 1;
+        }
+    }
+
+    fn join(self: *Wave) void {
+        for (self.threads[0..self.running]) |thread| {
+            thread.join();
+        }
+        self.running = 0;
+    }
+};
+
+fn generateChunk(params: *const GenerationParams, chunk: *Chunk) void {
+    generateChunk_internal(params, chunk) catch |err| {
+        chunk.err = err;
+    };
+}
+
+fn generateChunk_internal(params: *const GenerationParams, chunk: *Chunk) !void {
+    chunk.json.clearRetainingCapacity();
+    chunk.answers.clearRetainingCapacity();
+    chunk.pairs.clearRetainingCapacity();
+    chunk.answer_sum = 0;
+    chunk.err = null;
+
+    try chunk.answers.ensureTotalCapacity(@intCast(chunk.count));
+    if (params.keep_pairs) {
+        try chunk.pairs.ensureTotalCapacity(@intCast(chunk.count));
+    }
+
+    var rng = std.Random.DefaultPrng.init(deriveSeed(params.seed, .chunk, chunk.first_index / pairs_per_chunk));
+    var rand = rng.random();
+
+    var cluster_index: u64 = std.math.maxInt(u64);
+    var cluster_data = ClusterData{};
+
+    //- ojf: {d} with no precision is std's Ryu, the shortest digits that
+    // round trip, so the parsers get back exactly the bits that were summed
+    const json = chunk.json.writer();
+    for (chunk.first_index..chunk.first_index + chunk.count) |pair_index| {
+        const i: u64 = pair_index;
+        const point: Pair = switch (params.mode) {
+            .uniform => p: {
+                break :p generateUniformPoint(&rand);
+            },
+            .cluster => p: {
+                if (i / params.points_per_cluster != cluster_index) {
+                    cluster_index = i / params.points_per_cluster;
+                    cluster_data = clusterAt(params.seed, cluster_index);
+                }
+                break :p generateClusterPoint(&rand, &cluster_data);
+            },
+        };
+
+        try json.print("{{\"x0\":{d},\"y0\":{d},\"x1\":{d},\"y1\":{d}}}{s}\n", .{
+            point.x0,
+            point.y0,
+            point.x1,
+            point.y1,
+            if (i == params.num_points - 1) "" else ",",
+        });
+
+        //- ojf: accumulate, chunk sums get added in chunk order afterwards
+        const haversine_answer = hav.referenceHaversine(point.x0, point.y0, point.x1, point.y1);
+        chunk.answers.appendAssumeCapacity(haversine_answer);
+        chunk.answer_sum += haversine_answer;
+
+        if (params.keep_pairs) {
+            chunk.pairs.appendAssumeCapacity(point);
+        }
+    }
+}
+
 pub fn main() !void {
     var arena = std.heap.ArenaAllocator.init(std.heap.page_allocator);
     defer arena.deinit();
@@ -99,9 +384,6 @@ pub fn main() !void {
         };
     };
 
-    var rng = std.Random.DefaultPrng.init(seed);
-    var rand = rng.random();
-
     const num_points = n: {
         const arg_str = arg_iterator.next() orelse {
             printUsage();
@@ -114,49 +396,120 @@ pub fn main() !void {
         };
     };
 
+    //- ojf: optional, in any order: pairs also writes a binary pair file,
+    // -threads n picks how many threads generate, default is one per core
+    var write_pair_file = false;
+    var thread_count: usize = std.Thread.getCpuCount() catch 1;
+    while (arg_iterator.next()) |arg_str| {
+        if (std.mem.eql(u8, arg_str, "pairs")) {
+            write_pair_file = true;
+        } else if (std.mem.eql(u8, arg_str, "-threads")) {
+            const count_str = arg_iterator.next() orelse {
+                printUsage();
+                return;
+            };
+            thread_count = std.fmt.parseInt(usize, count_str, 10) catch 0;
+            if (thread_count == 0) {
+                printUsage();
+                return;
+            }
+        } else {
+            printUsage();
+            return;
+        }
+    }
+
     //- ojf: write json + reference answers
     const points_file_name = try std.fmt.allocPrint(allocator, "haversine-data_{d}.json", .{num_points});
     const points_file = try std.fs.cwd().createFile(points_file_name, .{});
     defer points_file.close();
+    var points_writer = JsonWriter{ .file = points_file };
 
     const answers_file_name = try std.fmt.allocPrint(allocator, "haversine-answers_{d}.f64", .{num_points});
     const answers_file = try std.fs.cwd().createFile(answers_file_name, .{});
     defer answers_file.close();
 
-    var haversine_sum: f64 = 0;
-    var cluster_data = ClusterData{
-        .change_factor = num_points / 64,
+    var pair_file: ?std.fs.File = null;
+    defer if (pair_file) |file| file.close();
+    var pair_writer: PairFileWriter = undefined;
+    if (write_pair_file) {
+        const pair_file_name = try std.fmt.allocPrint(allocator, "haversine-data_{d}.pairs", .{num_points});
+        pair_file = try std.fs.cwd().createFile(pair_file_name, .{});
+        pair_writer = PairFileWriter.init(pair_file.?, num_points);
+    }
+
+    const params = GenerationParams{
+        .mode = generation_mode,
+        .seed = seed,
+        .num_points = num_points,
+        .points_per_cluster = @max(1, num_points / cluster_count),
+        .keep_pairs = write_pair_file,
     };
 
-    _ = try points_file.write("{\"pairs\":[\n");
-    for (0..num_points) |i| {
-        const point: Pair = switch (generation_mode) {
-            .uniform => p: {
-                break :p generateUniformPoint(&rand);
-            },
-            .cluster => p: {
-                break :p generateClusterPoint(i, &rand, &cluster_data);
-            },
-        };
+    var waves = [2]Wave{
+        try Wave.init(allocator, thread_count),
+        try Wave.init(allocator, thread_count),
+    };
+    defer {
+        for (&waves) |*wave| {
+            wave.deinit();
+        }
+    }
+    //- ojf: runs before the deinit above, so an error while writing still
+    // waits for the wave in flight before its chunks are freed
+    defer {
+        for (&waves) |*wave| {
+            wave.join();
+        }
+    }
 
-        const line = try std.fmt.allocPrint(allocator, "{{\"x0\":{d:.16},\"y0\":{d:.16},\"x1\":{d:.16},\"y1\":{d:.16}}}{s}\n", .{
-            point.x0,
-            point.y0,
-            point.x1,
-            point.y1,
-            if (i == num_points - 1) "" else ",",
-        });
-        _ = try points_file.write(line);
+    var haversine_sum: f64 = 0;
 
-        //- ojf: accumulate
-        const haversine_answer = hav.referenceHaversine(point.x0, point.y0, point.x1, point.y1);
-        _ = try answers_file.write(&std.mem.toBytes(haversine_answer));
-        haversine_sum += haversine_answer;
+    try points_writer.write("{\"pairs\":[\n");
+
+    //- ojf: while this thread writes a wave out in order, the next one is
+    // already being generated, so the serial write overlaps generation
+    // instead of every thread waiting on it
+    var next_index: u64 = 0;
+    var current: usize = 0;
+    waves[current].assignChunks(&next_index, num_points);
+    try waves[current].start(&params);
+
+    while (waves[current].count != 0) {
+        waves[current].join();
+
+        const next = 1 - current;
+        waves[next].assignChunks(&next_index, num_points);
+        try waves[next].start(&params);
+
+        for (waves[current].chunks[0..waves[current].count]) |*chunk| {
+            if (chunk.err) |err| {
+                return err;
+            }
+
+            try points_writer.write(chunk.json.items);
+            try answers_file.writeAll(std.mem.sliceAsBytes(chunk.answers.items));
+            haversine_sum += chunk.answer_sum;
+
+            if (write_pair_file) {
+                for (chunk.pairs.items) |point| {
+                    try pair_writer.append(point);
+                }
+            }
+        }
+
+        current = next;
+    }
+
+    try points_writer.write("]}\n");
+
+    if (write_pair_file) {
+        try pair_writer.finish(points_writer.hash.final(), points_writer.size);
     }
-    _ = try points_file.write("]}\n");
 
     print("Method: {s}\n", .{if (generation_mode == .uniform) "Uniform" else "Cluster"});
     print("Random Seed: {d}\n", .{seed});
     print("Pair Count: {d}\n", .{num_points});
+    print("Threads: {d}\n", .{thread_count});
     print("Expected Sum: {d}\n", .{haversine_sum / @as(f64, @floatFromInt(num_points))});
 }
@@ -4,6 +4,10 @@ const print = std.debug.print;
 const hav = @import("./haver_ref.zig");
 const perf = @import("win32_perf.zig");
 
+//- ojf: set by build.zig from the optimize mode, -Dperf=true/false overrides
+// it.  false compiles every perf timer out
+pub const perf_enabled = @import("build_options").perf_enabled;
+
 const TokenKind = enum {
     l_brace,
     r_brace,
@@ -34,95 +38,104 @@ inline fn isDigit(char: u8) bool {
     return char >= '0' and char <= '9';
 }
 
-pub fn tokenize(allocator: std.mem.Allocator, string: []const u8) []Token {
-    const t = perf.timeFunction(@src());
-    defer perf.stopTimer(t);
-
-    var tokens = std.ArrayList(Token).init(allocator);
-    var i: u32 = 0;
-
-    while (i < string.len) : (i += 1) {
-        const token_start = i;
-        var token_number: ?f64 = null;
-
-        const token_kind: TokenKind = switch (string[i]) {
-            '{' => .l_brace,
-            '}' => .r_brace,
-            ',' => .comma,
-            ':' => .colon,
-            '[' => .l_bracket,
-            ']' => .r_bracket,
-            '"' => t: {
-                i += 1;
-                while (i < string.len and string[i] != '"') {
+//- ojf: pulls one token at a time out of the source as parseValue asks for
+// it, so there is never a token array for the whole file, and token
+// strings are slices of the source
+const Tokenizer = struct {
+    source: []const u8,
+    index: usize = 0,
+
+    fn next(self: *Tokenizer) ?Token {
+        const string = self.source;
+        var i = self.index;
+
+        while (i < string.len) : (i += 1) {
+            const token_start = i;
+            var token_number: ?f64 = null;
+
+            const token_kind: TokenKind = switch (string[i]) {
+                '{' => .l_brace,
+                '}' => .r_brace,
+                ',' => .comma,
+                ':' => .colon,
+                '[' => .l_bracket,
+                ']' => .r_bracket,
+                '"' => t: {
                     i += 1;
-                }
-                break :t .string;
-            },
-            ' ', '\n', '\r', '\t' => continue,
-            else => t: {
-                const t_else = perf.timeBlock("hard tokens");
-                defer perf.stopTimer(t_else);
-                if (isAlpha(string[i])) {
-                    while (i < string.len and isAlpha(string[i])) {
+                    while (i < string.len and string[i] != '"') {
                         i += 1;
                     }
-                    i -= 1;
-
-                    const ident = string[token_start .. i + 1];
-                    if (std.mem.eql(u8, ident, "true")) {
-                        break :t .keyword_true;
-                    }
-                    if (std.mem.eql(u8, ident, "false")) {
-                        break :t .keyword_false;
-                    }
-                    if (std.mem.eql(u8, ident, "null")) {
-                        break :t .keyword_null;
+                    break :t .string;
+                },
+                ' ', '\n', '\r', '\t' => continue,
+                else => t: {
+                    const t_else = perf.timeBlock("hard tokens");
+                    defer perf.stopTimer(t_else);
+                    if (isAlpha(string[i])) {
+                        while (i < string.len and isAlpha(string[i])) {
+                            i += 1;
+                        }
+                        i -= 1;
+
+                        const ident = string[token_start .. i + 1];
+                        if (std.mem.eql(u8, ident, "true")) {
+                            break :t .keyword_true;
+                        }
+                        if (std.mem.eql(u8, ident, "false")) {
+                            break :t .keyword_false;
+                        }
+                        if (std.mem.eql(u8, ident, "null")) {
+                            break :t .keyword_null;
+                        }
                     }
-                }
-                if (string[i] == '-' or isDigit(string[i])) {
-                    i += 1;
-                    while (i < string.len and
-                        (isDigit(string[i]) or
-                        string[i] == '.' or
-                        string[i] == 'e' or
-                        string[i] == 'E'))
-                    {
+                    if (string[i] == '-' or isDigit(string[i])) {
                         i += 1;
+                        while (i < string.len and
+                            (isDigit(string[i]) or
+                            string[i] == '.' or
+                            string[i] == 'e' or
+                            string[i] == 'E'))
+                        {
+                            i += 1;
+                        }
+
+                        i -= 1;
+
+                        token_number = std.fmt.parseFloat(
+                            f64,
+                            string[token_start .. i + 1],
+                        ) catch {
+                            @panic("Failed to parse number!");
+                        };
+
+                        break :t .number;
                     }
 
-                    i -= 1;
-
-                    token_number = std.fmt.parseFloat(
-                        f64,
-                        string[token_start .. i + 1],
-                    ) catch {
-                        @panic("Failed to parse number!");
-                    };
+                    @panic("Unexpected character!");
+                },
+            };
 
-                    break :t .number;
-                }
+            //- ojf: i is on the token's last character
+            self.index = i + 1;
 
-                @panic("Unexpected character!");
-            },
-        };
-
-        const token = Token{
-            .kind = token_kind,
-            .string = if (token_kind == .string)
-                string[token_start + 1 .. i]
-            else
-                string[token_start .. i + 1],
-            .number = token_number,
-        };
+            return Token{
+                .kind = token_kind,
+                .string = if (token_kind == .string)
+                    string[token_start + 1 .. i]
+                else
+                    string[token_start .. i + 1],
+                .number = token_number,
+            };
+        }
 
-        tokens.append(token) catch {
-            @panic("Failed to append token!");
-        };
+        self.index = i;
+        return null;
     }
+};
 
-    return tokens.toOwnedSlice() catch {
-        @panic("Failed to convert to owned slice!");
+fn nextToken(tokenizer: *Tokenizer) Token {
+    return tokenizer.next() orelse {
+        @panic("Unexpected end of input!");
     };
 }
 
@@ -210,123 +223,86 @@ const JsonValue = union(JsonValueKind) {
     }
 };
 
-const ParseResult = struct {
-    value: JsonValue,
-    tokens_consumed: u32,
-};
-
-fn parseValue(allocator: std.mem.Allocator, tokens: []Token) ParseResult {
+fn parseValue(allocator: std.mem.Allocator, tokenizer: *Tokenizer) JsonValue {
     const t = perf.timeFunction(@src());
     defer perf.stopTimer(t);
 
-    var current_token: u32 = 0;
+    const token = nextToken(tokenizer);
 
-    switch (tokens[current_token].kind) {
+    switch (token.kind) {
         .string => {
-            return ParseResult{
-                .value = JsonValue{
-                    .string = tokens[current_token].string,
-                },
-                .tokens_consumed = 1,
+            return JsonValue{
+                .string = token.string,
             };
         },
         .number => {
-            return ParseResult{
-                .value = JsonValue{
-                    .number = tokens[current_token].number orelse {
-                        @panic("Number token has no token associated!");
-                    },
+            return JsonValue{
+                .number = token.number orelse {
+                    @panic("Number token has no token associated!");
                 },
-                .tokens_consumed = 1,
             };
         },
         .keyword_true => {
-            return ParseResult{
-                .value = JsonValue{
-                    .boolean = true,
-                },
-                .tokens_consumed = 1,
+            return JsonValue{
+                .boolean = true,
             };
         },
         .keyword_false => {
-            return ParseResult{
-                .value = JsonValue{
-                    .boolean = false,
-                },
-                .tokens_consumed = 1,
+            return JsonValue{
+                .boolean = false,
             };
         },
         .keyword_null => {
-            return ParseResult{
-                .value = @as(JsonValue, .nil),
-                .tokens_consumed = 1,
-            };
+            return @as(JsonValue, .nil);
         },
         .l_brace => {
-            current_token += 1;
             var records = std.StringHashMap(JsonValue).init(allocator);
 
             while (true) {
                 //- ojf: parse record
-                const name_result = parseValue(allocator, tokens[current_token..]);
-                current_token += name_result.tokens_consumed;
-                const name = switch (name_result.value) {
+                const name = switch (parseValue(allocator, tokenizer)) {
                     .string => |str| str,
                     else => @panic("Expected string!"),
                 };
 
-                if (tokens[current_token].kind != .colon) {
+                if (nextToken(tokenizer).kind != .colon) {
                     @panic("Exected colon!");
                 }
-                current_token += 1;
 
-                const value_result = parseValue(allocator, tokens[current_token..]);
-                current_token += value_result.tokens_consumed;
-                const value = value_result.value;
+                const value = parseValue(allocator, tokenizer);
 
                 records.put(name, value) catch {
                     @panic("Error inserting into list");
                 };
 
-                if (tokens[current_token].kind == .comma) {
-                    current_token += 1;
-                } else if (tokens[current_token].kind == .r_brace) {
-                    current_token += 1;
-                    return ParseResult{
-                        .value = JsonValue{
-                            .object = records,
-                        },
-                        .tokens_consumed = current_token,
+                const separator = nextToken(tokenizer);
+                if (separator.kind == .comma) {
+                    continue;
+                } else if (separator.kind == .r_brace) {
+                    return JsonValue{
+                        .object = records,
                     };
                 } else {
                     @panic("Expected }} or ,");
                 }
             }
-
-            @panic("Not implemented!");
         },
         .l_bracket => {
-            current_token += 1;
             var values = std.ArrayList(JsonValue).init(allocator);
 
             while (true) {
-                const value_result = parseValue(allocator, tokens[current_token..]);
-                current_token += value_result.tokens_consumed;
-                const value = value_result.value;
+                const value = parseValue(allocator, tokenizer);
 
                 values.append(value) catch {
                     @panic("Failed to append value to array");
                 };
 
-                if (tokens[current_token].kind == .comma) {
-                    current_token += 1;
-                } else if (tokens[current_token].kind == .r_bracket) {
-                    current_token += 1;
-                    return ParseResult{
-                        .value = JsonValue{
-                            .array = values,
-                        },
-                        .tokens_consumed = current_token,
+                const separator = nextToken(tokenizer);
+                if (separator.kind == .comma) {
+                    continue;
+                } else if (separator.kind == .r_bracket) {
+                    return JsonValue{
+                        .array = values,
                     };
                 } else {
                     @panic("Expected ] or ,");
@@ -340,7 +316,7 @@ fn parseValue(allocator: std.mem.Allocator, tokens: []Token) ParseResult {
 }
 
 fn printUsage() void {
-    print("Usage: haversine_parser.exe [file name]", .{});
+    print("Usage: haversine_parser.exe [file name] [trace.json]", .{});
 }
 
 pub fn main() void {
@@ -384,7 +360,13 @@ pub fn main() void {
     };
     defer file.close();
 
-    const json_string = file.readToEndAlloc(allocator, 128 * 1024 * 1024) catch {
+    //- ojf: optional, a timeline of every timed block for chrome://tracing
+    // or perfetto
+    if (arg_iterator.next()) |trace_path| {
+        perf.startTrace(trace_path, 1 << 20);
+    }
+
+    const json_string = file.readToEndAlloc(allocator, std.math.maxInt(usize)) catch {
         @panic("Couldn't read json string!");
     };
     defer allocator.free(json_string);
@@ -393,11 +375,8 @@ pub fn main() void {
 
     const t_parsing = perf.timeBlock("parsing");
 
-    const tokens = tokenize(allocator, json_string);
-    defer allocator.free(tokens);
-
-    const parseResult = parseValue(allocator, tokens);
-    var parsed_value = parseResult.value;
+    var tokenizer = Tokenizer{ .source = json_string };
+    const parsed_value = parseValue(allocator, &tokenizer);
     defer parsed_value.free();
 
     if (@as(JsonValueKind, parsed_value) != .object) {
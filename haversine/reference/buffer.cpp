@@ -21,6 +21,7 @@ struct buffer
 };
 
 #define CONSTANT_STRING(String) {sizeof(String) - 1, (u8 *)(String)}
+#define ArrayCount(Array) (sizeof(Array)/sizeof((Array)[0]))
 
 static b32 IsInBounds(buffer Source, u64 At)
 {
@@ -0,0 +1,286 @@
+/* ========================================================================
+   Multithreaded chunked haversine pair parser
+   ======================================================================== */
+
+/* NOTE(ojf): The generator writes one pair object per line, and JSON
+   strings can't hold a raw newline, so the body of the pairs array can be
+   cut at any line that starts a new pair object after a line ending in a
+   comma.  Each chunk is parsed on its own thread into its own range of the
+   output, and the ranges are packed together in order afterwards.
+
+   If the pairs array can't be found, has no usable line breaks, or any
+   chunk fails to parse as a plain run of pair objects, the whole input is
+   parsed again with the single threaded stream parser, so odd input costs
+   time but never changes the answer.
+*/
+
+#define MAX_PARSE_CHUNKS 64
+
+// NOTE(ojf): Same bound the pair array is sized with, every pair takes at
+// least this many bytes of JSON
+#define MIN_PAIR_ENCODING (6*4)
+
+struct pair_chunk
+{
+    buffer Source;
+    pair_storage Storage;
+    u64 FirstPair;
+    u64 MaxPairCount;
+
+    u64 PairCount;
+    b32 Valid;
+};
+
+struct chunked_parse_result
+{
+    u64 PairCount;
+    u32 ChunkCount;
+    b32 FellBack;
+};
+
+// NOTE(ojf): Finds where the body of the top level pairs array starts,
+// just after its [
+static b32 FindPairsArrayStart(buffer InputJSON, u64 *BodyStart)
+{
+    b32 Result = false;
+
+    json_parser Parser = {};
+    Parser.Source = InputJSON;
+
+    json_token Token = GetJSONToken(&Parser);
+    if(Token.Type == Token_open_brace)
+    {
+        Token = GetJSONToken(&Parser);
+        while(IsParsing(&Parser) && (Token.Type == Token_string_literal))
+        {
+            buffer Label = Token.Value;
+            if(GetJSONToken(&Parser).Type != Token_colon)
+            {
+                break;
+            }
+
+            json_token Value = GetJSONToken(&Parser);
+            if(AreEqual(Label, CONSTANT_STRING("pairs")) && (Value.Type == Token_open_bracket))
+            {
+                *BodyStart = Parser.At;
+                Result = true;
+                break;
+            }
+
+            SkipJSONValue(&Parser, Value);
+            Token = GetJSONToken(&Parser);
+            if(Token.Type == Token_comma)
+            {
+                Token = GetJSONToken(&Parser);
+            }
+        }
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Only succeeds when pairs is the last field of the top level
+// object, so the array ends at the last ] in the input
+static b32 FindPairsArrayBody(buffer InputJSON, buffer *Body)
+{
+    u64 BodyStart = 0;
+    b32 Result = FindPairsArrayStart(InputJSON, &BodyStart);
+    if(Result)
+    {
+        Body->Data = InputJSON.Data + BodyStart;
+        Body->Count = InputJSON.Count - BodyStart;
+
+        // NOTE(ojf): Walk back over "]}" and any whitespace around them
+        char const Closing[] = "}]";
+        u32 ClosingIndex = 0;
+        while(Body->Count && (ClosingIndex < 2))
+        {
+            u8 Val = Body->Data[Body->Count - 1];
+            if(Val == Closing[ClosingIndex])
+            {
+                ++ClosingIndex;
+            }
+            else if(!IsJSONWhitespace(*Body, Body->Count - 1))
+            {
+                break;
+            }
+            --Body->Count;
+        }
+
+        Result = (ClosingIndex == 2);
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Returns the offset of the first pair object at or after At
+// that starts its own line, or Body.Count if there isn't one
+static u64 FindRecordBoundary(buffer Body, u64 At)
+{
+    u64 Result = Body.Count;
+
+    while(At < Body.Count)
+    {
+        u8 *Newline = (u8 *)memchr(Body.Data + At, '\n', Body.Count - At);
+        if(!Newline)
+        {
+            break;
+        }
+
+        u64 Before = Newline - Body.Data;
+        while(Before && IsJSONWhitespace(Body, Before - 1))
+        {
+            --Before;
+        }
+
+        u64 After = (Newline - Body.Data) + 1;
+        while(IsJSONWhitespace(Body, After))
+        {
+            ++After;
+        }
+
+        if(Before && (Body.Data[Before - 1] == ',') &&
+           IsInBounds(Body, After) && (Body.Data[After] == '{'))
+        {
+            Result = After;
+            break;
+        }
+
+        At = After;
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): A chunk is a run of pair objects separated by commas, the last
+// one possibly followed by a comma that belongs to the next chunk
+static void ParsePairChunk(void *Param)
+{
+    pair_chunk *Chunk = (pair_chunk *)Param;
+
+    json_parser Parser = {};
+    Parser.Source = Chunk->Source;
+
+    u64 PairCount = 0;
+    json_token Token = GetJSONToken(&Parser);
+    while((Token.Type == Token_open_brace) && (PairCount < Chunk->MaxPairCount))
+    {
+        haversine_pair Pair;
+        if(!StreamParsePairObject(&Parser, &Pair))
+        {
+            break;
+        }
+        StorePair(&Chunk->Storage, PairCount++, Pair);
+
+        Token = GetJSONToken(&Parser);
+        if(Token.Type == Token_comma)
+        {
+            Token = GetJSONToken(&Parser);
+        }
+    }
+
+    Chunk->PairCount = PairCount;
+    Chunk->Valid = (!Parser.HadError && (Token.Type == Token_end_of_stream));
+}
+
+static chunked_parse_result ChunkedParseHaversinePairs(buffer InputJSON, u64 MaxPairCount, pair_storage *Storage,
+                                                       u32 ThreadCount)
+{
+    chunked_parse_result Result = {};
+
+    if(ThreadCount < 1) ThreadCount = 1;
+    if(ThreadCount > MAX_PARSE_CHUNKS) ThreadCount = MAX_PARSE_CHUNKS;
+
+    buffer Body = {};
+    b32 Valid = FindPairsArrayBody(InputJSON, &Body);
+
+    pair_chunk Chunks[MAX_PARSE_CHUNKS] = {};
+    u32 ChunkCount = 0;
+    if(Valid)
+    {
+        // NOTE(ojf): Chunk boundaries are found independently per thread's
+        // share, and a share with no boundary just merges into the one before
+        u64 ChunkStart = 0;
+        for(u32 ThreadIndex = 1; ThreadIndex <= ThreadCount; ++ThreadIndex)
+        {
+            u64 ChunkEnd = Body.Count;
+            if(ThreadIndex < ThreadCount)
+            {
+                u64 TargetEnd = (Body.Count * ThreadIndex) / ThreadCount;
+                ChunkEnd = FindRecordBoundary(Body, (TargetEnd > ChunkStart) ? TargetEnd : ChunkStart);
+            }
+
+            if(ChunkEnd > ChunkStart)
+            {
+                pair_chunk *Chunk = Chunks + ChunkCount++;
+                Chunk->Source.Data = Body.Data + ChunkStart;
+                Chunk->Source.Count = ChunkEnd - ChunkStart;
+
+                // NOTE(ojf): Output ranges are laid out by byte offset, which
+                // keeps every chunk inside Pairs and big enough for its input
+                u64 FirstPair = ChunkStart / MIN_PAIR_ENCODING;
+                u64 EndPair = (ChunkEnd == Body.Count) ? MaxPairCount : (ChunkEnd / MIN_PAIR_ENCODING);
+                if(FirstPair > MaxPairCount) FirstPair = MaxPairCount;
+                if(EndPair > MaxPairCount) EndPair = MaxPairCount;
+                Chunk->Storage = OffsetPairStorage(Storage, FirstPair);
+                Chunk->FirstPair = FirstPair;
+                Chunk->MaxPairCount = EndPair - FirstPair;
+
+                ChunkStart = ChunkEnd;
+            }
+        }
+
+        os_thread Threads[MAX_PARSE_CHUNKS];
+        b32 Started[MAX_PARSE_CHUNKS] = {};
+        for(u32 ChunkIndex = 1; ChunkIndex < ChunkCount; ++ChunkIndex)
+        {
+            Started[ChunkIndex] = StartOSThread(Threads + ChunkIndex, ParsePairChunk, Chunks + ChunkIndex);
+            if(!Started[ChunkIndex])
+            {
+                ParsePairChunk(Chunks + ChunkIndex);
+            }
+        }
+
+        if(ChunkCount)
+        {
+            ParsePairChunk(Chunks);
+        }
+
+        for(u32 ChunkIndex = 1; ChunkIndex < ChunkCount; ++ChunkIndex)
+        {
+            if(Started[ChunkIndex])
+            {
+                JoinOSThread(Threads + ChunkIndex);
+            }
+        }
+
+        for(u32 ChunkIndex = 0; ChunkIndex < ChunkCount; ++ChunkIndex)
+        {
+            Valid = Valid && Chunks[ChunkIndex].Valid;
+        }
+    }
+
+    if(Valid)
+    {
+        // NOTE(ojf): Every chunk's range starts at or after the end of the
+        // packed pairs before it, so moving them down in order is safe
+        u64 PairCount = 0;
+        for(u32 ChunkIndex = 0; ChunkIndex < ChunkCount; ++ChunkIndex)
+        {
+            pair_chunk *Chunk = Chunks + ChunkIndex;
+            MovePairs(Storage, PairCount, Chunk->FirstPair, Chunk->PairCount);
+            PairCount += Chunk->PairCount;
+        }
+
+        Result.PairCount = PairCount;
+        Result.ChunkCount = ChunkCount;
+    }
+    else
+    {
+        Result.PairCount = StreamParseHaversinePairs(InputJSON, MaxPairCount, Storage, 0);
+        Result.ChunkCount = 1;
+        Result.FellBack = true;
+    }
+
+    return Result;
+}
@@ -0,0 +1,63 @@
+/* ========================================================================
+   CPU feature detection
+   ======================================================================== */
+
+/* NOTE(ojf): Only the features some kernel in here actually has a path
+   for.  AVX and AVX-512 also need the OS to save the wider registers, which
+   __builtin_cpu_supports already checks and the MSVC path checks with
+   XGETBV.
+*/
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_FEATURES_X64 1
+#include <immintrin.h>
+#else
+#define CPU_FEATURES_X64 0
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_FEATURES(Features) __attribute__((target(Features)))
+#else
+#define TARGET_FEATURES(Features)
+#endif
+
+struct cpu_features
+{
+    b32 SSE42;
+    b32 PCLMUL;
+    b32 AVX2;
+    b32 FMA;
+    b32 AVX512F;
+};
+
+static cpu_features GetCPUFeatures(void)
+{
+    cpu_features Result = {};
+
+#if CPU_FEATURES_X64 && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    Result.SSE42 = __builtin_cpu_supports("sse4.2");
+    Result.PCLMUL = __builtin_cpu_supports("pclmul");
+    Result.AVX2 = __builtin_cpu_supports("avx2");
+    Result.FMA = __builtin_cpu_supports("fma");
+    Result.AVX512F = __builtin_cpu_supports("avx512f");
+#elif CPU_FEATURES_X64
+    int Info[4];
+    __cpuid(Info, 1);
+    Result.PCLMUL = (Info[2] & (1 << 1)) != 0;
+    Result.FMA = (Info[2] & (1 << 12)) != 0;
+    Result.SSE42 = (Info[2] & (1 << 20)) != 0;
+    b32 OSXSave = (Info[2] & (1 << 27)) != 0;
+
+    u64 XCR0 = OSXSave ? _xgetbv(0) : 0;
+    b32 OSSavesYMM = ((XCR0 & 0x6) == 0x6);
+    b32 OSSavesZMM = ((XCR0 & 0xe6) == 0xe6);
+
+    __cpuidex(Info, 7, 0);
+    Result.AVX2 = OSSavesYMM && ((Info[1] & (1 << 5)) != 0);
+    Result.FMA = OSSavesYMM && Result.FMA;
+    Result.AVX512F = OSSavesZMM && ((Info[1] & (1 << 16)) != 0);
+#endif
+
+    return Result;
+}
@@ -0,0 +1,188 @@
+/* ========================================================================
+   Sin, cos, asin and sqrt for the ranges the haversine formula uses
+   ======================================================================== */
+
+/* NOTE(ojf): ReferenceHaversine only ever asks for
+
+     sin(x), |x| <= pi      (half the longitude difference)
+     sin(x), |x| <= pi/2    (half the latitude difference)
+     cos(x), |x| <= pi/2    (latitudes)
+     asin(x), 0 <= x <= 1
+     sqrt(x), 0 <= x <= 1
+
+   so none of the general range reduction libm does is needed.  sin on
+   (pi/2, pi] folds back with sin(x) = sin(pi - x), asin above 1/2 uses
+   asin(x) = pi/2 - 2*asin(sqrt((1 - x)/2)), and sqrt is the SQRTSD
+   instruction, which is already correctly rounded.
+
+   Each function is a polynomial in x^2 from the tables below.  There is a
+   table entry per term count so math_sweep.cpp can show what every extra
+   term buys, and the defaults are the last, most accurate entries.  The
+   coefficients are Chebyshev interpolants of sin(sqrt(t))/sqrt(t),
+   cos(sqrt(t)) and asin(sqrt(t))/sqrt(t) over t = x^2, computed at 60
+   digits and rounded to doubles by:
+
+     from decimal import Decimal as D, getcontext
+     from math import comb
+     getcontext().prec = 60
+     Pi = D('3.14159265358979323846264338327950288419716939937510582097494')
+     Fact = [D(1)]
+     for I in range(1, 400): Fact.append(Fact[-1]*I)
+     def Series(T, C, Terms=200):
+         Sum, Power = D(0), D(1)
+         for N in range(Terms): Sum, Power = Sum + C(N)*Power, Power*T
+         return Sum
+     def Cos(X):
+         X = X % (2*Pi)
+         return Series(X*X, lambda N: (-1)**N/Fact[2*N], 100)
+     def Fit(F, T, N):
+         U = [Cos((2*K + 1)*Pi/(2*N)) for K in range(N)]
+         V = [F(T*(UK + 1)/2) for UK in U]
+         A = [sum(V[K]*Cos(J*(2*K + 1)*Pi/(2*N)) for K in range(N))*2/N for J in range(N)]
+         A[0] /= 2
+         Cheb = [[D(1)], [D(0), D(1)]]
+         while len(Cheb) < N:
+             P = [D(0)] + [2*C for C in Cheb[-1]]
+             Cheb.append([C - (Cheb[-2][I] if I < len(Cheb[-2]) else 0) for I, C in enumerate(P)])
+         InU = [sum(A[J]*Cheb[J][I] for J in range(I, N)) for I in range(N)]
+         return [sum(InU[I]*comb(I, M)*(2/T)**M*(-1)**(I - M) for I in range(M, N)) for M in range(N)]
+     def Emit(F, T, Counts):
+         for N in Counts:
+             print('    {%d, {%s}},' % (N, ', '.join(repr(float(C)) for C in Fit(F, T, N))))
+         print()
+     Emit(lambda T: Series(T, lambda N: (-1)**N/Fact[2*N + 1]), (Pi/2)**2, range(4, 10))
+     Emit(lambda T: Series(T, lambda N: (-1)**N/Fact[2*N]), (Pi/2)**2, range(5, 11))
+     Emit(lambda T: Series(T, lambda N: Fact[2*N]/(4**N*Fact[N]**2*(2*N + 1))), D('0.25'), range(6, 15))
+*/
+
+#define MAX_POLYNOMIAL_TERMS 16
+
+struct polynomial
+{
+    u32 Count;
+    f64 Coefficients[MAX_POLYNOMIAL_TERMS];
+};
+
+// NOTE(ojf): sin(x) = x*P(x^2) for |x| <= pi/2
+static polynomial const SinPolynomials[] =
+{
+    {4, {0.9999992370615313, -0.16665676500413848, 0.008313191414376437, -0.00018522539324609908}},
+    {5, {0.999999995698809, -0.16666657947846011, 0.008333050170671773, -0.00019809017408678003, 2.605107635334788e-06}},
+    {6, {0.9999999999829191, -0.16666666616815567, 0.008333330974207583, -0.00019840861179319552, 2.752526981229885e-06, -2.3889217773452806e-08}},
+    {7, {0.9999999999999496, -0.16666666666466673, 0.00833333332035835, -0.00019841266683130672, 2.7556952912858047e-06, -2.503026818882279e-08, 1.54112197466489e-10}},
+    {8, {0.9999999999999999, -0.16666666666666072, 0.008333333333282756, -0.00019841269824861897, 2.7557316609073673e-06, -2.505188194671259e-08, 1.6048168318165643e-10, -7.374387503862757e-13}},
+    {9, {1.0, -0.16666666666666666, 0.008333333333333186, -0.00019841269841208676, 2.7557319211229606e-06, -2.505210689056952e-08, 1.605894087848656e-10, -7.643026557971632e-13, 2.7215749422983443e-15}},
+};
+
+// NOTE(ojf): cos(x) = P(x^2) for |x| <= pi/2
+static polynomial const CosPolynomials[] =
+{
+    {5, {0.9999999530275123, -0.49999904777792115, 0.04166357316018825, -0.001385362953617557, 2.3152416659997792e-05}},
+    {6, {0.999999999779154, -0.4999999935543786, 0.04166663615972319, -0.0013888360284403018, 2.4760109673159873e-05, -2.6050657493719744e-07}},
+    {7, {0.9999999999992479, -0.4999999999701275, 0.04166666647285179, -0.0013888884170789055, 2.4801039928008272e-05, -2.7524670425081666e-07, 1.9907506103760227e-09}},
+    {8, {0.9999999999999981, -0.49999999999989936, 0.04166666666580973, -0.0013888888861087183, 2.4801582870372985e-05, -2.7556935431582117e-07, 2.085831802290141e-09, -1.1007956573034519e-11}},
+    {9, {1.0, -0.4999999999999997, 0.04166666666666388, -0.001388888888877299, 2.4801587277414926e-05, -2.755731639102575e-07, 2.0876561839933163e-09, -1.1462901901757276e-11, 4.608977003001797e-14}},
+    {10, {1.0, -0.5, 0.04166666666666666, -0.001388888888888853, 2.480158730149264e-05, -2.755731920965447e-07, 2.0876755666578904e-09, -1.1470670165323271e-11, 4.7768722491448073e-14, -1.5119827834217995e-16}},
+};
+
+// NOTE(ojf): asin(x) = x*P(x^2) for 0 <= x <= 1/2
+static polynomial const ArcSinPolynomials[] =
+{
+    {6, {0.999999995983738, 0.16666782005775338, 0.07494696687423973, 0.045520635631714566, 0.02399399965364759, 0.04241737375979984}},
+    {7, {1.0000000002307783, 0.16666657639575913, 0.07500571381024686, 0.04450870949865153, 0.03185718889411276, 0.014295256037820107, 0.0376771383418486}},
+    {8, {0.9999999999863537, 0.16666667364186447, 0.07499941908754719, 0.04466113930866896, 0.03010250689966149, 0.024650862660604088, 0.0074010072390753795, 0.0347484248080839}},
+    {9, {1.000000000000825, 0.16666666613278705, 0.07500005655821883, 0.04464056469220037, 0.03042811901907943, 0.02185574259984348, 0.02068132717169167, 0.0019156113431105127, 0.03295759470084881}},
+    {10, {0.9999999999999493, 0.16666666670723188, 0.07499999467531561, 0.044643126897073435, 0.030375046838709736, 0.022472629272259407, 0.016472738109361944, 0.018638508213446328, -0.0028563505336838967, 0.03194399638410843}},
+    {11, {1.000000000000003, 0.1666666666636023, 0.07500000048801558, 0.04464282695575735, 0.03038289742013321, 0.02235471795166217, 0.01755004624569455, 0.012550386671737955, 0.017924305774952437, -0.007309161310274521, 0.03150097858285519}},
+    {12, {0.9999999999999998, 0.16666666666689706, 0.07499999995624415, 0.04464286038603156, 0.030381820752221768, 0.022374928823605693, 0.017313700945909897, 0.01432423514994457, 0.009376473481056654, 0.01825637024213353, -0.011693559679531318, 0.03150477675162431}},
+    {13, {1.0, 0.16666666666664942, 0.07500000000385201, 0.044642856805998936, 0.03038195969768514, 0.022371749733164054, 0.01735977964134998, 0.01388484282640208, 0.012170138592391726, 0.0065293020047365695, 0.019513468251252167, -0.016187392271599134, 0.03187962140081284}},
+    {14, {1.0, 0.16666666666666796, 0.07499999999966611, 0.04464285717686322, 0.030381942642327187, 0.022372216106072148, 0.017351600625343435, 0.01398088299217101, 0.011398850408440755, 0.010778675120995992, 0.0037180577483250537, 0.02166805886905636, -0.02093065831518245, 0.03257934796692842}},
+};
+
+#define SIN_POLYNOMIAL (SinPolynomials + ArrayCount(SinPolynomials) - 1)
+#define COS_POLYNOMIAL (CosPolynomials + ArrayCount(CosPolynomials) - 1)
+#define ARCSIN_POLYNOMIAL (ArcSinPolynomials + ArrayCount(ArcSinPolynomials) - 1)
+
+// NOTE(ojf): pi split in two so pi - x keeps the bits a single double drops
+#define HAVERSINE_PI_HI 3.141592653589793116
+#define HAVERSINE_PI_LO 1.2246467991473532e-16
+#define HAVERSINE_HALF_PI 1.5707963267948966192
+
+inline f64 EvaluatePolynomial(f64 X, polynomial const *Polynomial)
+{
+    f64 Result = Polynomial->Coefficients[Polynomial->Count - 1];
+    for(u32 Index = Polynomial->Count - 1; Index > 0; --Index)
+    {
+        Result = Result*X + Polynomial->Coefficients[Index - 1];
+    }
+
+    return Result;
+}
+
+static f64 HaversineSqrt(f64 X)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    __m128d Value = _mm_set_sd(X);
+    f64 Result = _mm_cvtsd_f64(_mm_sqrt_sd(Value, Value));
+#else
+    f64 Result = sqrt(X);
+#endif
+    return Result;
+}
+
+// NOTE(ojf): |X| <= pi
+static f64 HaversineSin(f64 X, polynomial const *Polynomial = SIN_POLYNOMIAL)
+{
+    f64 AbsX = fabs(X);
+    if(AbsX > HAVERSINE_HALF_PI)
+    {
+        AbsX = (HAVERSINE_PI_HI - AbsX) + HAVERSINE_PI_LO;
+    }
+
+    f64 Result = AbsX*EvaluatePolynomial(AbsX*AbsX, Polynomial);
+    return (X < 0) ? -Result : Result;
+}
+
+// NOTE(ojf): |X| <= pi/2
+static f64 HaversineCos(f64 X, polynomial const *Polynomial = COS_POLYNOMIAL)
+{
+    f64 Result = EvaluatePolynomial(X*X, Polynomial);
+    return Result;
+}
+
+// NOTE(ojf): |X| <= 1
+static f64 HaversineArcSin(f64 X, polynomial const *Polynomial = ARCSIN_POLYNOMIAL)
+{
+    f64 AbsX = fabs(X);
+    f64 Result;
+    if(AbsX > 0.5)
+    {
+        f64 T = 0.5*(1.0 - AbsX);
+        Result = HAVERSINE_HALF_PI - 2.0*HaversineSqrt(T)*EvaluatePolynomial(T, Polynomial);
+    }
+    else
+    {
+        Result = AbsX*EvaluatePolynomial(AbsX*AbsX, Polynomial);
+    }
+
+    return (X < 0) ? -Result : Result;
+}
+
+// NOTE(ojf): ReferenceHaversine with the libm calls swapped out
+static f64 CustomHaversine(f64 X0, f64 Y0, f64 X1, f64 Y1, f64 EarthRadius)
+{
+    f64 dLat = RadiansFromDegrees(Y1 - Y0);
+    f64 dLon = RadiansFromDegrees(X1 - X0);
+    f64 Lat0 = RadiansFromDegrees(Y0);
+    f64 Lat1 = RadiansFromDegrees(Y1);
+
+    f64 A = Square(HaversineSin(dLat/2.0)) + HaversineCos(Lat0)*HaversineCos(Lat1)*Square(HaversineSin(dLon/2.0));
+    if(A > 1.0)
+    {
+        A = 1.0;
+    }
+    f64 C = 2.0*HaversineArcSin(HaversineSqrt(A));
+
+    f64 Result = EarthRadius*C;
+    return Result;
+}
@@ -0,0 +1,275 @@
+/* ========================================================================
+   Columnar binary pair files
+   ======================================================================== */
+
+/* NOTE(ojf): The same pairs as a haversine JSON file, already parsed, so a
+   run that only needs the sum maps the file and goes straight to the
+   kernel.  Little endian, laid out as:
+
+     pair_file_header     PAIR_FILE_HEADER_SIZE bytes
+     X0[PairCount]        each column starts ColumnStride bytes after the
+     Y0[PairCount]        one before, and ColumnStride is PairCount f64s
+     X1[PairCount]        rounded up to PAIR_FILE_ALIGNMENT, so every
+     Y1[PairCount]        column is cache line aligned in the mapping
+
+   The columns are exactly haversine_pair_soa, so OpenPairFile hands out a
+   pair_storage that points into the mapping and nothing gets copied.
+
+   SourceHash is FNV-1a 64 of the JSON it was made from, and SourceSize its
+   length, so a stale file can be told apart from a fresh one.  Each column
+   has a Fletcher style checksum over its raw f64 bits (A += Bits, B += A,
+   the checksum is B), which is only checked when asked for, since reading
+   every page would cost what mapping saves.  generate.zig writes the same
+   format, so the two have to change together, and the version goes up.
+*/
+
+#define PAIR_FILE_MAGIC 0x5352494150564148ull // "HAVPAIRS"
+#define PAIR_FILE_VERSION 1
+#define PAIR_FILE_HEADER_SIZE 128
+#define PAIR_FILE_ALIGNMENT 64
+#define PAIR_FILE_COLUMN_COUNT 4
+#define PAIR_FILE_WRITE_BATCH 4096
+
+struct pair_file_header
+{
+    u64 Magic;
+    u32 Version;
+    u32 HeaderSize;
+
+    u64 PairCount;
+    u64 ColumnOffset;
+    u64 ColumnStride;
+
+    u64 SourceHash;
+    u64 SourceSize;
+
+    u64 ColumnChecksums[PAIR_FILE_COLUMN_COUNT];
+
+    u64 Reserved[5];
+};
+static_assert(sizeof(pair_file_header) == PAIR_FILE_HEADER_SIZE, "pair_file_header must match PAIR_FILE_HEADER_SIZE");
+
+struct pair_file
+{
+    mapped_file Mapped;
+    pair_file_header *Header;
+    pair_storage Pairs;
+};
+
+struct pair_column_checksum
+{
+    u64 A;
+    u64 B;
+};
+
+inline void UpdatePairColumnChecksum(pair_column_checksum *Checksum, f64 Value)
+{
+    u64 Bits;
+    memcpy(&Bits, &Value, sizeof(Bits));
+    Checksum->A += Bits;
+    Checksum->B += Checksum->A;
+}
+
+static u64 HashPairFileSource(buffer Source)
+{
+    u64 Result = 0xcbf29ce484222325ull;
+    for(u64 At = 0; At < Source.Count; ++At)
+    {
+        Result ^= Source.Data[At];
+        Result *= 0x100000001b3ull;
+    }
+
+    return Result;
+}
+
+static u64 GetPairFileColumnStride(u64 PairCount)
+{
+    u64 Result = (PairCount*sizeof(f64) + PAIR_FILE_ALIGNMENT - 1) & ~(u64)(PAIR_FILE_ALIGNMENT - 1);
+    return Result;
+}
+
+static f64 GetPairColumn(haversine_pair Pair, u32 Column)
+{
+    f64 Result = (Column == 0) ? Pair.X0 : (Column == 1) ? Pair.Y0 : (Column == 2) ? Pair.X1 : Pair.Y1;
+    return Result;
+}
+
+// NOTE(ojf): Works from either layout, a column at a time through a small
+// batch, so converting doesn't need a second copy of the pairs
+static b32 WritePairFile(char *FileName, pair_storage *Pairs, u64 PairCount, buffer Source)
+{
+    b32 Result = false;
+
+    pair_file_header Header = {};
+    Header.Magic = PAIR_FILE_MAGIC;
+    Header.Version = PAIR_FILE_VERSION;
+    Header.HeaderSize = PAIR_FILE_HEADER_SIZE;
+    Header.PairCount = PairCount;
+    Header.ColumnOffset = PAIR_FILE_HEADER_SIZE;
+    Header.ColumnStride = GetPairFileColumnStride(PairCount);
+    Header.SourceHash = HashPairFileSource(Source);
+    Header.SourceSize = Source.Count;
+
+    FILE *File = fopen(FileName, "wb");
+    if(File)
+    {
+        // NOTE(ojf): Written again at the end with the checksums filled in
+        b32 Written = (fwrite(&Header, sizeof(Header), 1, File) == 1);
+
+        f64 Batch[PAIR_FILE_WRITE_BATCH];
+        for(u32 Column = 0; Written && (Column < PAIR_FILE_COLUMN_COUNT); ++Column)
+        {
+            pair_column_checksum Checksum = {};
+            for(u64 First = 0; Written && (First < PairCount); First += PAIR_FILE_WRITE_BATCH)
+            {
+                u64 Count = PairCount - First;
+                if(Count > PAIR_FILE_WRITE_BATCH)
+                {
+                    Count = PAIR_FILE_WRITE_BATCH;
+                }
+
+                for(u64 Index = 0; Index < Count; ++Index)
+                {
+                    Batch[Index] = GetPairColumn(LoadPair(Pairs, First + Index), Column);
+                    UpdatePairColumnChecksum(&Checksum, Batch[Index]);
+                }
+
+                Written = (fwrite(Batch, sizeof(f64), Count, File) == Count);
+            }
+            Header.ColumnChecksums[Column] = Checksum.B;
+
+            u8 Padding[PAIR_FILE_ALIGNMENT] = {};
+            u64 PaddingSize = Header.ColumnStride - PairCount*sizeof(f64);
+            Written = Written && (fwrite(Padding, 1, PaddingSize, File) == PaddingSize);
+        }
+
+        Written = Written && (fseek(File, 0, SEEK_SET) == 0) && (fwrite(&Header, sizeof(Header), 1, File) == 1);
+        Result = (fclose(File) == 0) && Written;
+    }
+
+    if(!Result)
+    {
+        fprintf(stderr, "ERROR: Unable to write \"%s\".\n", FileName);
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Everything here comes off disk, so it's all divisions, a
+// PairCount or ColumnStride big enough to wrap a multiply can't sneak past
+static b32 PairFileColumnsFit(pair_file_header *Header, u64 DataCount)
+{
+    b32 Result = ((Header->HeaderSize >= sizeof(pair_file_header)) &&
+                  ((Header->ColumnOffset % PAIR_FILE_ALIGNMENT) == 0) &&
+                  ((Header->ColumnStride % PAIR_FILE_ALIGNMENT) == 0) &&
+                  (Header->ColumnOffset <= DataCount) &&
+                  (Header->ColumnStride <= (DataCount - Header->ColumnOffset) / PAIR_FILE_COLUMN_COUNT) &&
+                  (Header->PairCount <= Header->ColumnStride / sizeof(f64)));
+    return Result;
+}
+
+// NOTE(ojf): Only reads the magic, so inputs can be told apart by content
+// rather than by extension
+static b32 IsPairFile(char *FileName)
+{
+    b32 Result = false;
+
+    FILE *File = fopen(FileName, "rb");
+    if(File)
+    {
+        u64 Magic = 0;
+        Result = (fread(&Magic, sizeof(Magic), 1, File) == 1) && (Magic == PAIR_FILE_MAGIC);
+        fclose(File);
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Pair files are always mapped, read is treated as mmap
+static b32 OpenPairFile(char *FileName, input_strategy Strategy, pair_file *File)
+{
+    *File = {};
+
+    b32 Result = false;
+    if(MapInputFile(FileName, (Strategy == InputStrategy_read) ? InputStrategy_mmap : Strategy, &File->Mapped))
+    {
+        buffer Data = File->Mapped.Data;
+        pair_file_header *Header = (pair_file_header *)Data.Data;
+
+        if((Data.Count < sizeof(pair_file_header)) || (Header->Magic != PAIR_FILE_MAGIC))
+        {
+            fprintf(stderr, "ERROR: \"%s\" is not a pair file.\n", FileName);
+        }
+        else if(Header->Version != PAIR_FILE_VERSION)
+        {
+            fprintf(stderr, "ERROR: \"%s\" is pair file version %u, this reads version %u.\n",
+                    FileName, Header->Version, PAIR_FILE_VERSION);
+        }
+        else if(!PairFileColumnsFit(Header, Data.Count))
+        {
+            fprintf(stderr, "ERROR: \"%s\" is truncated or has a corrupt header.\n", FileName);
+        }
+        else
+        {
+            File->Header = Header;
+
+            u8 *Columns = Data.Data + Header->ColumnOffset;
+            File->Pairs.Layout = PairLayout_soa;
+            File->Pairs.SoA.X0 = (f64 *)(Columns + 0*Header->ColumnStride);
+            File->Pairs.SoA.Y0 = (f64 *)(Columns + 1*Header->ColumnStride);
+            File->Pairs.SoA.X1 = (f64 *)(Columns + 2*Header->ColumnStride);
+            File->Pairs.SoA.Y1 = (f64 *)(Columns + 3*Header->ColumnStride);
+
+            Result = true;
+        }
+    }
+
+    if(!Result)
+    {
+        UnmapInputFile(&File->Mapped);
+        *File = {};
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Touches every page of the columns, so only on request.  The
+// header is checked again, since this walks PairCount f64s of every column
+static b32 VerifyPairFile(pair_file *File)
+{
+    b32 Result = PairFileColumnsFit(File->Header, File->Mapped.Data.Count);
+    if(Result)
+    {
+        f64 *Columns[PAIR_FILE_COLUMN_COUNT] =
+        {
+            File->Pairs.SoA.X0, File->Pairs.SoA.Y0, File->Pairs.SoA.X1, File->Pairs.SoA.Y1,
+        };
+
+        for(u32 Column = 0; Column < PAIR_FILE_COLUMN_COUNT; ++Column)
+        {
+            pair_column_checksum Checksum = {};
+            for(u64 Index = 0; Index < File->Header->PairCount; ++Index)
+            {
+                UpdatePairColumnChecksum(&Checksum, Columns[Column][Index]);
+            }
+
+            if(Checksum.B != File->Header->ColumnChecksums[Column])
+            {
+                fprintf(stderr, "ERROR: Checksum mismatch in pair file column %u.\n", Column);
+                Result = false;
+            }
+        }
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Pair file is truncated or has a corrupt header.\n");
+    }
+
+    return Result;
+}
+
+static void ClosePairFile(pair_file *File)
+{
+    UnmapInputFile(&File->Mapped);
+    *File = {};
+}
@@ -0,0 +1,158 @@
+/* ========================================================================
+   Pair storage layouts
+   ======================================================================== */
+
+/* NOTE(ojf): Pairs can be stored the way haversine_pair lays them out, one
+   pair after another (AoS), or as four separate X0, Y0, X1 and Y1 arrays
+   (SoA).  With SoA the vector kernels load X0 for 4 or 8 pairs straight
+   from memory instead of transposing, and a kernel that only needed some of
+   the fields wouldn't drag the others through the cache.
+
+   The parsers write through StorePair, so they fill either layout directly.
+   Each SoA array starts on a cache line, and the kernels still use
+   unaligned loads since chunk and block views start anywhere.  The memory
+   comes straight from the OS, in whatever page kind was asked for (see
+   platform_memory.cpp).
+*/
+
+#define PAIR_SOA_ALIGNMENT 64
+
+enum haversine_pair_layout
+{
+    PairLayout_aos,
+    PairLayout_soa,
+};
+
+static char const *PairLayoutNames[] = {"aos", "soa"};
+
+struct haversine_pair_soa
+{
+    f64 *X0;
+    f64 *Y0;
+    f64 *X1;
+    f64 *Y1;
+};
+
+struct pair_storage
+{
+    haversine_pair_layout Layout;
+    haversine_pair *Pairs;
+    haversine_pair_soa SoA;
+
+    // NOTE(ojf): Only set on storage from AllocatePairStorage, views made by
+    // OffsetPairStorage don't own anything
+    buffer Memory;
+    page_kind Pages;
+};
+
+static u64 AlignPairSoA(u64 Value)
+{
+    u64 Result = (Value + PAIR_SOA_ALIGNMENT - 1) & ~(u64)(PAIR_SOA_ALIGNMENT - 1);
+    return Result;
+}
+
+static pair_storage AllocatePairStorage(haversine_pair_layout Layout, u64 MaxPairCount,
+                                        page_kind Pages = PageKind_normal)
+{
+    pair_storage Result = {};
+    Result.Layout = Layout;
+
+    if(Layout == PairLayout_soa)
+    {
+        // NOTE(ojf): OS allocations are page aligned, so the arrays only need
+        // their sizes rounded to keep each one on a cache line
+        u64 ArraySize = AlignPairSoA(MaxPairCount*sizeof(f64));
+        Result.Memory = AllocateOSMemory(4*ArraySize, Pages, &Result.Pages);
+        if(Result.Memory.Data)
+        {
+            u8 *Base = Result.Memory.Data;
+            Result.SoA.X0 = (f64 *)(Base + 0*ArraySize);
+            Result.SoA.Y0 = (f64 *)(Base + 1*ArraySize);
+            Result.SoA.X1 = (f64 *)(Base + 2*ArraySize);
+            Result.SoA.Y1 = (f64 *)(Base + 3*ArraySize);
+        }
+    }
+    else
+    {
+        Result.Memory = AllocateOSMemory(MaxPairCount*sizeof(haversine_pair), Pages, &Result.Pages);
+        Result.Pairs = (haversine_pair *)Result.Memory.Data;
+    }
+
+    return Result;
+}
+
+static void FreePairStorage(pair_storage *Storage)
+{
+    FreeOSMemory(&Storage->Memory);
+    *Storage = {};
+}
+
+// NOTE(ojf): A view of the same storage starting Offset pairs in
+static pair_storage OffsetPairStorage(pair_storage *Storage, u64 Offset)
+{
+    pair_storage Result = {};
+    Result.Layout = Storage->Layout;
+
+    if(Storage->Layout == PairLayout_soa)
+    {
+        Result.SoA.X0 = Storage->SoA.X0 + Offset;
+        Result.SoA.Y0 = Storage->SoA.Y0 + Offset;
+        Result.SoA.X1 = Storage->SoA.X1 + Offset;
+        Result.SoA.Y1 = Storage->SoA.Y1 + Offset;
+    }
+    else
+    {
+        Result.Pairs = Storage->Pairs + Offset;
+    }
+
+    return Result;
+}
+
+inline void StorePair(pair_storage *Storage, u64 Index, haversine_pair Pair)
+{
+    if(Storage->Layout == PairLayout_soa)
+    {
+        Storage->SoA.X0[Index] = Pair.X0;
+        Storage->SoA.Y0[Index] = Pair.Y0;
+        Storage->SoA.X1[Index] = Pair.X1;
+        Storage->SoA.Y1[Index] = Pair.Y1;
+    }
+    else
+    {
+        Storage->Pairs[Index] = Pair;
+    }
+}
+
+inline haversine_pair LoadPair(pair_storage *Storage, u64 Index)
+{
+    haversine_pair Result;
+    if(Storage->Layout == PairLayout_soa)
+    {
+        Result.X0 = Storage->SoA.X0[Index];
+        Result.Y0 = Storage->SoA.Y0[Index];
+        Result.X1 = Storage->SoA.X1[Index];
+        Result.Y1 = Storage->SoA.Y1[Index];
+    }
+    else
+    {
+        Result = Storage->Pairs[Index];
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): memmove semantics, the ranges can overlap
+static void MovePairs(pair_storage *Storage, u64 To, u64 From, u64 Count)
+{
+    if(Storage->Layout == PairLayout_soa)
+    {
+        memmove(Storage->SoA.X0 + To, Storage->SoA.X0 + From, Count*sizeof(f64));
+        memmove(Storage->SoA.Y0 + To, Storage->SoA.Y0 + From, Count*sizeof(f64));
+        memmove(Storage->SoA.X1 + To, Storage->SoA.X1 + From, Count*sizeof(f64));
+        memmove(Storage->SoA.Y1 + To, Storage->SoA.Y1 + From, Count*sizeof(f64));
+    }
+    else
+    {
+        memmove(Storage->Pairs + To, Storage->Pairs + From, Count*sizeof(haversine_pair));
+    }
+}
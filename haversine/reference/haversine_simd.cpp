@@ -0,0 +1,468 @@
+/* ========================================================================
+   Vectorized haversine kernels
+   ======================================================================== */
+
+/* NOTE(ojf): 4 (AVX2+FMA) or 8 (AVX-512) pairs per iteration, with the
+   libm calls replaced by the same range-reduced polynomials as
+   haversine_math.cpp, evaluated with FMA.  The asin branch at 1/2 becomes a
+   blend, so both sides share one polynomial evaluation.
+
+   TOLERANCE: The haversine formula is badly conditioned near antipodal
+   pairs, where asin's slope turns a rounding error in a into a large one in
+   the distance, so both libm and these kernels drift from the true distance
+   there.  Measured against a long double evaluation on 4M pairs, the worst
+   errors were:
+
+                                  scalar (libm)    avx2/avx512
+     more than 10km from antipodal     3.1e-9km         4.2e-9km
+     within 10km of antipodal          2.7e-4km         3.3e-4km
+
+   so a distance is accepted when it is within 1e-8km of ReferenceHaversine,
+   or 1e-3km for pairs within 10km of antipodal (see HaversinePairTolerance).
+   The sum is accumulated per lane and the lanes added at the end, so it also
+   differs from the serial sum by reassociation, and is accepted within 1e-9.
+
+   Every kernel has an AoS and an SoA version (see haversine_pair_soa.cpp).
+   They compute the same lanes in the same order, so the sums match bit for
+   bit, and the SoA ones just skip the transpose.
+
+   The tail is padded with zero pairs, which have a distance of exactly 0,
+   so it goes through the same code as everything else: AVX2 copies it into
+   a zeroed block, AVX-512 uses zero-masked loads.
+*/
+
+enum haversine_kernel
+{
+    HaversineKernel_scalar,
+    HaversineKernel_custom,
+    HaversineKernel_avx2,
+    HaversineKernel_avx512,
+
+    HaversineKernel_count,
+};
+
+static char const *HaversineKernelNames[] = {"scalar", "custom", "avx2", "avx512"};
+
+#define HAVERSINE_SUM_TOLERANCE 1e-9
+
+static f64 HaversinePairTolerance(f64 ReferenceDistance, f64 EarthRadius)
+{
+    f64 AntipodalDistance = HAVERSINE_PI_HI*EarthRadius;
+    f64 Result = ((AntipodalDistance - ReferenceDistance) > 10.0) ? 1e-8 : 1e-3;
+    return Result;
+}
+
+static haversine_kernel GetBestHaversineKernel(void)
+{
+    haversine_kernel Result = HaversineKernel_scalar;
+
+    cpu_features Features = GetCPUFeatures();
+    if(Features.AVX512F)
+    {
+        Result = HaversineKernel_avx512;
+    }
+    else if(Features.AVX2 && Features.FMA)
+    {
+        Result = HaversineKernel_avx2;
+    }
+
+    return Result;
+}
+
+typedef f64 haversine_formula(f64 X0, f64 Y0, f64 X1, f64 Y1, f64 EarthRadius);
+
+// NOTE(ojf): Distances can be 0 when only the sum is wanted
+static f64 HaversineScalar(u64 PairCount, haversine_pair *Pairs, f64 EarthRadius, f64 *Distances,
+                           haversine_formula *Formula = ReferenceHaversine)
+{
+    f64 Sum = 0;
+
+    f64 SumCoef = 1 / (f64)PairCount;
+    for(u64 PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+    {
+        haversine_pair Pair = Pairs[PairIndex];
+        f64 Dist = Formula(Pair.X0, Pair.Y0, Pair.X1, Pair.Y1, EarthRadius);
+        if(Distances)
+        {
+            Distances[PairIndex] = Dist;
+        }
+        Sum += SumCoef*Dist;
+    }
+
+    return Sum;
+}
+
+static f64 HaversineScalarSoA(u64 PairCount, haversine_pair_soa SoA, f64 EarthRadius, f64 *Distances,
+                              haversine_formula *Formula = ReferenceHaversine)
+{
+    f64 Sum = 0;
+
+    f64 SumCoef = 1 / (f64)PairCount;
+    for(u64 PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+    {
+        f64 Dist = Formula(SoA.X0[PairIndex], SoA.Y0[PairIndex], SoA.X1[PairIndex], SoA.Y1[PairIndex], EarthRadius);
+        if(Distances)
+        {
+            Distances[PairIndex] = Dist;
+        }
+        Sum += SumCoef*Dist;
+    }
+
+    return Sum;
+}
+
+#if CPU_FEATURES_X64
+
+TARGET_FEATURES("avx2,fma")
+inline __m256d EvaluatePolynomial4(__m256d X, polynomial const *Polynomial)
+{
+    __m256d Result = _mm256_set1_pd(Polynomial->Coefficients[Polynomial->Count - 1]);
+    for(u32 Index = Polynomial->Count - 1; Index > 0; --Index)
+    {
+        Result = _mm256_fmadd_pd(Result, X, _mm256_set1_pd(Polynomial->Coefficients[Index - 1]));
+    }
+
+    return Result;
+}
+
+TARGET_FEATURES("avx2,fma")
+inline __m256d Haversine4(__m256d X0, __m256d Y0, __m256d X1, __m256d Y1, f64 EarthRadius)
+{
+    __m256d SignMask = _mm256_set1_pd(-0.0);
+    __m256d HalfRadians = _mm256_set1_pd(0.5*0.01745329251994329577);
+    __m256d Radians = _mm256_set1_pd(0.01745329251994329577);
+
+    __m256d HalfDLat = _mm256_mul_pd(_mm256_sub_pd(Y1, Y0), HalfRadians);
+    __m256d HalfDLon = _mm256_mul_pd(_mm256_sub_pd(X1, X0), HalfRadians);
+    __m256d Lat0 = _mm256_mul_pd(Y0, Radians);
+    __m256d Lat1 = _mm256_mul_pd(Y1, Radians);
+
+    // NOTE(ojf): Only the square of sin(dLat/2) is used, so its sign doesn't matter
+    __m256d SinDLat = _mm256_mul_pd(HalfDLat, EvaluatePolynomial4(_mm256_mul_pd(HalfDLat, HalfDLat), SIN_POLYNOMIAL));
+
+    // NOTE(ojf): dLon/2 can reach pi, so fold |x| > pi/2 back with pi - |x|,
+    // sign is again irrelevant
+    __m256d AbsDLon = _mm256_andnot_pd(SignMask, HalfDLon);
+    __m256d FoldedDLon = _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(HAVERSINE_PI_HI), AbsDLon), _mm256_set1_pd(HAVERSINE_PI_LO));
+    AbsDLon = _mm256_min_pd(AbsDLon, FoldedDLon);
+    __m256d SinDLon = _mm256_mul_pd(AbsDLon, EvaluatePolynomial4(_mm256_mul_pd(AbsDLon, AbsDLon), SIN_POLYNOMIAL));
+
+    __m256d CosLat0 = EvaluatePolynomial4(_mm256_mul_pd(Lat0, Lat0), COS_POLYNOMIAL);
+    __m256d CosLat1 = EvaluatePolynomial4(_mm256_mul_pd(Lat1, Lat1), COS_POLYNOMIAL);
+
+    __m256d A = _mm256_fmadd_pd(_mm256_mul_pd(CosLat0, CosLat1), _mm256_mul_pd(SinDLon, SinDLon),
+                                _mm256_mul_pd(SinDLat, SinDLat));
+    A = _mm256_min_pd(A, _mm256_set1_pd(1.0));
+
+    // NOTE(ojf): asin(sqrt(a)), above 1/2 through the half angle identity
+    __m256d SqrtA = _mm256_sqrt_pd(A);
+    __m256d Large = _mm256_cmp_pd(SqrtA, _mm256_set1_pd(0.5), _CMP_GT_OQ);
+    __m256d HalfComplement = _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), SqrtA), _mm256_set1_pd(0.5));
+    __m256d T = _mm256_blendv_pd(A, HalfComplement, Large);
+    __m256d X = _mm256_blendv_pd(SqrtA, _mm256_sqrt_pd(HalfComplement), Large);
+    __m256d Asin = _mm256_mul_pd(X, EvaluatePolynomial4(T, ARCSIN_POLYNOMIAL));
+    __m256d LargeAsin = _mm256_fnmadd_pd(_mm256_set1_pd(2.0), Asin, _mm256_set1_pd(HAVERSINE_HALF_PI));
+    Asin = _mm256_blendv_pd(Asin, LargeAsin, Large);
+
+    __m256d Result = _mm256_mul_pd(Asin, _mm256_set1_pd(2.0*EarthRadius));
+    return Result;
+}
+
+TARGET_FEATURES("avx2,fma")
+static f64 HaversineAVX2(u64 PairCount, haversine_pair *Pairs, f64 EarthRadius, f64 *Distances)
+{
+    __m256d Sum = _mm256_setzero_pd();
+    __m256d SumCoef = _mm256_set1_pd(1 / (f64)PairCount);
+
+    for(u64 PairIndex = 0; PairIndex < PairCount; PairIndex += 4)
+    {
+        haversine_pair *Block = Pairs + PairIndex;
+        u64 BlockCount = PairCount - PairIndex;
+
+        haversine_pair Tail[4] = {};
+        if(BlockCount < 4)
+        {
+            memcpy(Tail, Block, BlockCount*sizeof(haversine_pair));
+            Block = Tail;
+        }
+
+        // NOTE(ojf): One pair is exactly one register, so a 4x4 transpose
+        // turns four pairs into X0, Y0, X1 and Y1 registers
+        __m256d P0 = _mm256_loadu_pd(&Block[0].X0);
+        __m256d P1 = _mm256_loadu_pd(&Block[1].X0);
+        __m256d P2 = _mm256_loadu_pd(&Block[2].X0);
+        __m256d P3 = _mm256_loadu_pd(&Block[3].X0);
+
+        __m256d X01 = _mm256_unpacklo_pd(P0, P1);
+        __m256d Y01 = _mm256_unpackhi_pd(P0, P1);
+        __m256d X23 = _mm256_unpacklo_pd(P2, P3);
+        __m256d Y23 = _mm256_unpackhi_pd(P2, P3);
+
+        __m256d X0 = _mm256_permute2f128_pd(X01, X23, 0x20);
+        __m256d X1 = _mm256_permute2f128_pd(X01, X23, 0x31);
+        __m256d Y0 = _mm256_permute2f128_pd(Y01, Y23, 0x20);
+        __m256d Y1 = _mm256_permute2f128_pd(Y01, Y23, 0x31);
+
+        __m256d Dist = Haversine4(X0, Y0, X1, Y1, EarthRadius);
+        Sum = _mm256_fmadd_pd(SumCoef, Dist, Sum);
+
+        if(Distances)
+        {
+            f64 BlockDistances[4];
+            _mm256_storeu_pd(BlockDistances, Dist);
+            memcpy(Distances + PairIndex, BlockDistances, ((BlockCount < 4) ? BlockCount : 4)*sizeof(f64));
+        }
+    }
+
+    f64 Lanes[4];
+    _mm256_storeu_pd(Lanes, Sum);
+    f64 Result = (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+    return Result;
+}
+
+// NOTE(ojf): Same sums as HaversineAVX2, without the transpose.  The tail
+// lanes are masked off, so they load as zero pairs just like the padding
+TARGET_FEATURES("avx2,fma")
+static f64 HaversineAVX2SoA(u64 PairCount, haversine_pair_soa SoA, f64 EarthRadius, f64 *Distances)
+{
+    __m256d Sum = _mm256_setzero_pd();
+    __m256d SumCoef = _mm256_set1_pd(1 / (f64)PairCount);
+
+    for(u64 PairIndex = 0; PairIndex < PairCount; PairIndex += 4)
+    {
+        u64 BlockCount = PairCount - PairIndex;
+
+        __m256d X0, Y0, X1, Y1;
+        if(BlockCount >= 4)
+        {
+            X0 = _mm256_loadu_pd(SoA.X0 + PairIndex);
+            Y0 = _mm256_loadu_pd(SoA.Y0 + PairIndex);
+            X1 = _mm256_loadu_pd(SoA.X1 + PairIndex);
+            Y1 = _mm256_loadu_pd(SoA.Y1 + PairIndex);
+        }
+        else
+        {
+            __m256i Mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x((i64)BlockCount), _mm256_set_epi64x(3, 2, 1, 0));
+            X0 = _mm256_maskload_pd(SoA.X0 + PairIndex, Mask);
+            Y0 = _mm256_maskload_pd(SoA.Y0 + PairIndex, Mask);
+            X1 = _mm256_maskload_pd(SoA.X1 + PairIndex, Mask);
+            Y1 = _mm256_maskload_pd(SoA.Y1 + PairIndex, Mask);
+        }
+
+        __m256d Dist = Haversine4(X0, Y0, X1, Y1, EarthRadius);
+        Sum = _mm256_fmadd_pd(SumCoef, Dist, Sum);
+
+        if(Distances)
+        {
+            f64 BlockDistances[4];
+            _mm256_storeu_pd(BlockDistances, Dist);
+            memcpy(Distances + PairIndex, BlockDistances, ((BlockCount < 4) ? BlockCount : 4)*sizeof(f64));
+        }
+    }
+
+    f64 Lanes[4];
+    _mm256_storeu_pd(Lanes, Sum);
+    f64 Result = (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+    return Result;
+}
+
+TARGET_FEATURES("avx512f")
+inline __m512d EvaluatePolynomial8(__m512d X, polynomial const *Polynomial)
+{
+    __m512d Result = _mm512_set1_pd(Polynomial->Coefficients[Polynomial->Count - 1]);
+    for(u32 Index = Polynomial->Count - 1; Index > 0; --Index)
+    {
+        Result = _mm512_fmadd_pd(Result, X, _mm512_set1_pd(Polynomial->Coefficients[Index - 1]));
+    }
+
+    return Result;
+}
+
+TARGET_FEATURES("avx512f")
+inline __m512d Haversine8(__m512d X0, __m512d Y0, __m512d X1, __m512d Y1, f64 EarthRadius)
+{
+    __m512d HalfRadians = _mm512_set1_pd(0.5*0.01745329251994329577);
+    __m512d Radians = _mm512_set1_pd(0.01745329251994329577);
+
+    __m512d HalfDLat = _mm512_mul_pd(_mm512_sub_pd(Y1, Y0), HalfRadians);
+    __m512d HalfDLon = _mm512_mul_pd(_mm512_sub_pd(X1, X0), HalfRadians);
+    __m512d Lat0 = _mm512_mul_pd(Y0, Radians);
+    __m512d Lat1 = _mm512_mul_pd(Y1, Radians);
+
+    __m512d SinDLat = _mm512_mul_pd(HalfDLat, EvaluatePolynomial8(_mm512_mul_pd(HalfDLat, HalfDLat), SIN_POLYNOMIAL));
+
+    __m512d AbsDLon = _mm512_abs_pd(HalfDLon);
+    __m512d FoldedDLon = _mm512_add_pd(_mm512_sub_pd(_mm512_set1_pd(HAVERSINE_PI_HI), AbsDLon), _mm512_set1_pd(HAVERSINE_PI_LO));
+    AbsDLon = _mm512_min_pd(AbsDLon, FoldedDLon);
+    __m512d SinDLon = _mm512_mul_pd(AbsDLon, EvaluatePolynomial8(_mm512_mul_pd(AbsDLon, AbsDLon), SIN_POLYNOMIAL));
+
+    __m512d CosLat0 = EvaluatePolynomial8(_mm512_mul_pd(Lat0, Lat0), COS_POLYNOMIAL);
+    __m512d CosLat1 = EvaluatePolynomial8(_mm512_mul_pd(Lat1, Lat1), COS_POLYNOMIAL);
+
+    __m512d A = _mm512_fmadd_pd(_mm512_mul_pd(CosLat0, CosLat1), _mm512_mul_pd(SinDLon, SinDLon),
+                                _mm512_mul_pd(SinDLat, SinDLat));
+    A = _mm512_min_pd(A, _mm512_set1_pd(1.0));
+
+    __m512d SqrtA = _mm512_sqrt_pd(A);
+    __mmask8 Large = _mm512_cmp_pd_mask(SqrtA, _mm512_set1_pd(0.5), _CMP_GT_OQ);
+    __m512d HalfComplement = _mm512_mul_pd(_mm512_sub_pd(_mm512_set1_pd(1.0), SqrtA), _mm512_set1_pd(0.5));
+    __m512d T = _mm512_mask_blend_pd(Large, A, HalfComplement);
+    __m512d X = _mm512_mask_blend_pd(Large, SqrtA, _mm512_sqrt_pd(HalfComplement));
+    __m512d Asin = _mm512_mul_pd(X, EvaluatePolynomial8(T, ARCSIN_POLYNOMIAL));
+    __m512d LargeAsin = _mm512_fnmadd_pd(_mm512_set1_pd(2.0), Asin, _mm512_set1_pd(HAVERSINE_HALF_PI));
+    Asin = _mm512_mask_blend_pd(Large, Asin, LargeAsin);
+
+    __m512d Result = _mm512_mul_pd(Asin, _mm512_set1_pd(2.0*EarthRadius));
+    return Result;
+}
+
+TARGET_FEATURES("avx512f")
+static f64 HaversineAVX512(u64 PairCount, haversine_pair *Pairs, f64 EarthRadius, f64 *Distances)
+{
+    __m512d Sum = _mm512_setzero_pd();
+    __m512d SumCoef = _mm512_set1_pd(1 / (f64)PairCount);
+
+    // NOTE(ojf): Picks the first or second double of each pair out of two
+    // registers that hold two pairs each
+    __m512i Column0 = _mm512_set_epi64(13, 9, 5, 1, 12, 8, 4, 0);
+    __m512i Column1 = _mm512_set_epi64(15, 11, 7, 3, 14, 10, 6, 2);
+
+    for(u64 PairIndex = 0; PairIndex < PairCount; PairIndex += 8)
+    {
+        haversine_pair *Block = Pairs + PairIndex;
+        u64 BlockCount = PairCount - PairIndex;
+
+        // NOTE(ojf): Masked loads zero the missing pairs in the tail, the same
+        // as the zero padding in the AVX2 path
+        u32 ValueMask = 0xffffffff;
+        __mmask8 StoreMask = 0xff;
+        if(BlockCount < 8)
+        {
+            ValueMask = (1u << (4*BlockCount)) - 1;
+            StoreMask = (__mmask8)((1u << BlockCount) - 1);
+        }
+
+        f64 *Values = &Block[0].X0;
+        __m512d P01 = _mm512_maskz_loadu_pd((__mmask8)(ValueMask >> 0), Values);
+        __m512d P23 = _mm512_maskz_loadu_pd((__mmask8)(ValueMask >> 8), Values + 8);
+        __m512d P45 = _mm512_maskz_loadu_pd((__mmask8)(ValueMask >> 16), Values + 16);
+        __m512d P67 = _mm512_maskz_loadu_pd((__mmask8)(ValueMask >> 24), Values + 24);
+
+        // NOTE(ojf): Each of these holds four pairs' X0s in the low half and
+        // Y0s (or X1s and Y1s) in the high half
+        __m512d XY0Low = _mm512_permutex2var_pd(P01, Column0, P23);
+        __m512d XY1Low = _mm512_permutex2var_pd(P01, Column1, P23);
+        __m512d XY0High = _mm512_permutex2var_pd(P45, Column0, P67);
+        __m512d XY1High = _mm512_permutex2var_pd(P45, Column1, P67);
+
+        __m512d X0 = _mm512_shuffle_f64x2(XY0Low, XY0High, _MM_SHUFFLE(1, 0, 1, 0));
+        __m512d Y0 = _mm512_shuffle_f64x2(XY0Low, XY0High, _MM_SHUFFLE(3, 2, 3, 2));
+        __m512d X1 = _mm512_shuffle_f64x2(XY1Low, XY1High, _MM_SHUFFLE(1, 0, 1, 0));
+        __m512d Y1 = _mm512_shuffle_f64x2(XY1Low, XY1High, _MM_SHUFFLE(3, 2, 3, 2));
+
+        __m512d Dist = Haversine8(X0, Y0, X1, Y1, EarthRadius);
+        Sum = _mm512_fmadd_pd(SumCoef, Dist, Sum);
+
+        if(Distances)
+        {
+            _mm512_mask_storeu_pd(Distances + PairIndex, StoreMask, Dist);
+        }
+    }
+
+    f64 Lanes[8];
+    _mm512_storeu_pd(Lanes, Sum);
+    f64 Result = (((Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3])) +
+                  ((Lanes[4] + Lanes[5]) + (Lanes[6] + Lanes[7])));
+    return Result;
+}
+
+TARGET_FEATURES("avx512f")
+static f64 HaversineAVX512SoA(u64 PairCount, haversine_pair_soa SoA, f64 EarthRadius, f64 *Distances)
+{
+    __m512d Sum = _mm512_setzero_pd();
+    __m512d SumCoef = _mm512_set1_pd(1 / (f64)PairCount);
+
+    for(u64 PairIndex = 0; PairIndex < PairCount; PairIndex += 8)
+    {
+        u64 BlockCount = PairCount - PairIndex;
+
+        __mmask8 Mask = 0xff;
+        if(BlockCount < 8)
+        {
+            Mask = (__mmask8)((1u << BlockCount) - 1);
+        }
+
+        __m512d X0 = _mm512_maskz_loadu_pd(Mask, SoA.X0 + PairIndex);
+        __m512d Y0 = _mm512_maskz_loadu_pd(Mask, SoA.Y0 + PairIndex);
+        __m512d X1 = _mm512_maskz_loadu_pd(Mask, SoA.X1 + PairIndex);
+        __m512d Y1 = _mm512_maskz_loadu_pd(Mask, SoA.Y1 + PairIndex);
+
+        __m512d Dist = Haversine8(X0, Y0, X1, Y1, EarthRadius);
+        Sum = _mm512_fmadd_pd(SumCoef, Dist, Sum);
+
+        if(Distances)
+        {
+            _mm512_mask_storeu_pd(Distances + PairIndex, Mask, Dist);
+        }
+    }
+
+    f64 Lanes[8];
+    _mm512_storeu_pd(Lanes, Sum);
+    f64 Result = (((Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3])) +
+                  ((Lanes[4] + Lanes[5]) + (Lanes[6] + Lanes[7])));
+    return Result;
+}
+
+#endif
+
+static f64 HaversineWithKernel(haversine_kernel Kernel, u64 PairCount, haversine_pair *Pairs, f64 EarthRadius,
+                               f64 *Distances)
+{
+    f64 Result = 0;
+
+    switch(Kernel)
+    {
+        case HaversineKernel_custom: {Result = HaversineScalar(PairCount, Pairs, EarthRadius, Distances, CustomHaversine);} break;
+#if CPU_FEATURES_X64
+        case HaversineKernel_avx2: {Result = HaversineAVX2(PairCount, Pairs, EarthRadius, Distances);} break;
+        case HaversineKernel_avx512: {Result = HaversineAVX512(PairCount, Pairs, EarthRadius, Distances);} break;
+#endif
+        default: {Result = HaversineScalar(PairCount, Pairs, EarthRadius, Distances);} break;
+    }
+
+    return Result;
+}
+
+static f64 HaversineSoAWithKernel(haversine_kernel Kernel, u64 PairCount, haversine_pair_soa SoA, f64 EarthRadius,
+                                  f64 *Distances)
+{
+    f64 Result = 0;
+
+    switch(Kernel)
+    {
+        case HaversineKernel_custom: {Result = HaversineScalarSoA(PairCount, SoA, EarthRadius, Distances, CustomHaversine);} break;
+#if CPU_FEATURES_X64
+        case HaversineKernel_avx2: {Result = HaversineAVX2SoA(PairCount, SoA, EarthRadius, Distances);} break;
+        case HaversineKernel_avx512: {Result = HaversineAVX512SoA(PairCount, SoA, EarthRadius, Distances);} break;
+#endif
+        default: {Result = HaversineScalarSoA(PairCount, SoA, EarthRadius, Distances);} break;
+    }
+
+    return Result;
+}
+
+static f64 HaversineWithStorage(haversine_kernel Kernel, u64 PairCount, pair_storage *Storage, f64 EarthRadius,
+                                f64 *Distances)
+{
+    f64 Result = 0;
+    if(Storage->Layout == PairLayout_soa)
+    {
+        Result = HaversineSoAWithKernel(Kernel, PairCount, Storage->SoA, EarthRadius, Distances);
+    }
+    else
+    {
+        Result = HaversineWithKernel(Kernel, PairCount, Storage->Pairs, EarthRadius, Distances);
+    }
+
+    return Result;
+}
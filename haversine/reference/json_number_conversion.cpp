@@ -0,0 +1,314 @@
+/* ========================================================================
+   Correctly rounded JSON number conversion
+   ======================================================================== */
+
+/* NOTE(ojf): Numbers are read into a 64-bit decimal mantissa and a power
+   of ten, then converted by, in order:
+
+   1. Clinger's fast path, when both the mantissa and the power of ten are
+      exact doubles, so one multiply or divide rounds correctly.
+   2. Eisel-Lemire, which multiplies by a 128-bit power of ten and only
+      gives up when the result is too close to a rounding boundary to call.
+   3. strtod, for the rare inputs the first two can't decide.
+
+   Mantissas longer than 19 digits are truncated to 19, and the true value
+   lies between the truncated mantissa and the next one up, so if
+   Eisel-Lemire rounds both to the same double that double is the answer.
+
+   Every step is exact or correctly rounded, so the result always matches a
+   correctly rounded strtod.
+*/
+
+#include "power_of_ten_table.cpp"
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static u64 MultiplyU64(u64 A, u64 B, u64 *High)
+{
+    return _umul128(A, B, High);
+}
+
+static u32 CountLeadingZeros64(u64 Value)
+{
+    unsigned long Index;
+    _BitScanReverse64(&Index, Value);
+    return 63 - Index;
+}
+#else
+static u64 MultiplyU64(u64 A, u64 B, u64 *High)
+{
+    unsigned __int128 Product = (unsigned __int128)A * B;
+    *High = (u64)(Product >> 64);
+    return (u64)Product;
+}
+
+static u32 CountLeadingZeros64(u64 Value)
+{
+    return __builtin_clzll(Value);
+}
+#endif
+
+struct json_decimal
+{
+    u64 Mantissa;
+    i32 Exponent10;
+    b32 Negative;
+    b32 Truncated;  // Digits beyond the 19 that fit in Mantissa were dropped
+};
+
+#define MAX_MANTISSA_DIGITS 19
+#define MAX_EXPONENT_DIGITS_VALUE 100000
+
+static json_decimal ParseJSONDecimal(buffer Source)
+{
+    json_decimal Result = {};
+    u64 At = 0;
+
+    if(IsInBounds(Source, At) && (Source.Data[At] == '-'))
+    {
+        Result.Negative = true;
+        ++At;
+    }
+
+    u32 Digits = 0;
+    while(IsInBounds(Source, At))
+    {
+        u8 Digit = Source.Data[At] - (u8)'0';
+        if(Digit >= 10)
+        {
+            break;
+        }
+
+        if(Digits < MAX_MANTISSA_DIGITS)
+        {
+            Result.Mantissa = 10*Result.Mantissa + Digit;
+            Digits += (Result.Mantissa != 0);
+        }
+        else
+        {
+            Result.Exponent10 += 1;
+            Result.Truncated |= (Digit != 0);
+        }
+        ++At;
+    }
+
+    if(IsInBounds(Source, At) && (Source.Data[At] == '.'))
+    {
+        ++At;
+        while(IsInBounds(Source, At))
+        {
+            u8 Digit = Source.Data[At] - (u8)'0';
+            if(Digit >= 10)
+            {
+                break;
+            }
+
+            if(Digits < MAX_MANTISSA_DIGITS)
+            {
+                Result.Mantissa = 10*Result.Mantissa + Digit;
+                Digits += (Result.Mantissa != 0);
+                Result.Exponent10 -= 1;
+            }
+            else
+            {
+                Result.Truncated |= (Digit != 0);
+            }
+            ++At;
+        }
+    }
+
+    if(IsInBounds(Source, At) && ((Source.Data[At] == 'e') || (Source.Data[At] == 'E')))
+    {
+        ++At;
+        b32 ExponentNegative = false;
+        if(IsInBounds(Source, At) && ((Source.Data[At] == '+') || (Source.Data[At] == '-')))
+        {
+            ExponentNegative = (Source.Data[At] == '-');
+            ++At;
+        }
+
+        i32 Exponent = 0;
+        while(IsInBounds(Source, At))
+        {
+            u8 Digit = Source.Data[At] - (u8)'0';
+            if(Digit >= 10)
+            {
+                break;
+            }
+
+            // NOTE(ojf): Anything this large is 0 or inf regardless, just don't overflow
+            if(Exponent < MAX_EXPONENT_DIGITS_VALUE)
+            {
+                Exponent = 10*Exponent + Digit;
+            }
+            ++At;
+        }
+
+        Result.Exponent10 += ExponentNegative ? -Exponent : Exponent;
+    }
+
+    return Result;
+}
+
+static b32 ClingerFastPath(json_decimal Decimal, f64 *Result)
+{
+    static const f64 ExactPowersOfTen[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    b32 Valid = (!Decimal.Truncated &&
+                 (Decimal.Mantissa <= (1ull << 53)) &&
+                 (Decimal.Exponent10 >= -22) &&
+                 (Decimal.Exponent10 <= 22));
+    if(Valid)
+    {
+        f64 Value = (f64)Decimal.Mantissa;
+        if(Decimal.Exponent10 < 0)
+        {
+            Value /= ExactPowersOfTen[-Decimal.Exponent10];
+        }
+        else
+        {
+            Value *= ExactPowersOfTen[Decimal.Exponent10];
+        }
+        *Result = Decimal.Negative ? -Value : Value;
+    }
+
+    return Valid;
+}
+
+static b32 EiselLemire(json_decimal Decimal, f64 *Result)
+{
+    u64 Mantissa = Decimal.Mantissa;
+    i32 Exponent10 = Decimal.Exponent10;
+
+    if((Exponent10 < POWER_OF_TEN_MIN_EXP10) ||
+       (Exponent10 > POWER_OF_TEN_MAX_EXP10))
+    {
+        return false;
+    }
+
+    // NOTE(ojf): Normalize so the top bit of the mantissa is set
+    u32 LeadingZeros = CountLeadingZeros64(Mantissa);
+    Mantissa <<= LeadingZeros;
+
+    // NOTE(ojf): 217706/2^16 ~= log2(10)
+    u64 Exponent2 = (u64)(((217706*(i64)Exponent10) >> 16) + 64 + 1023) - LeadingZeros;
+
+    const u64 *Power = PowersOfTen128[Exponent10 - POWER_OF_TEN_MIN_EXP10];
+    u64 High;
+    u64 Low = MultiplyU64(Mantissa, Power[1], &High);
+
+    // NOTE(ojf): If the low bits that get rounded away are all ones, the
+    // truncated power of ten might have pushed us under a boundary, so
+    // bring in the next 64 bits of it
+    if(((High & 0x1FF) == 0x1FF) && ((Low + Mantissa) < Mantissa))
+    {
+        u64 NextHigh;
+        u64 NextLow = MultiplyU64(Mantissa, Power[0], &NextHigh);
+        u64 MergedHigh = High;
+        u64 MergedLow = Low + NextHigh;
+        if(MergedLow < Low)
+        {
+            ++MergedHigh;
+        }
+
+        if(((MergedHigh & 0x1FF) == 0x1FF) && ((MergedLow + 1) == 0) && ((NextLow + Mantissa) < Mantissa))
+        {
+            return false;
+        }
+
+        High = MergedHigh;
+        Low = MergedLow;
+    }
+
+    // NOTE(ojf): Shift down to 54 bits, one more than a double holds, so we
+    // can round
+    u64 MSB = High >> 63;
+    u64 ResultMantissa = High >> (MSB + 9);
+    Exponent2 -= 1 ^ MSB;
+
+    // NOTE(ojf): Exactly half way between two doubles, can't tell which way
+    // to round from the truncated product
+    if((Low == 0) && ((High & 0x1FF) == 0) && ((ResultMantissa & 3) == 1))
+    {
+        return false;
+    }
+
+    ResultMantissa += ResultMantissa & 1;
+    ResultMantissa >>= 1;
+    if(ResultMantissa >> 53)
+    {
+        ResultMantissa >>= 1;
+        Exponent2 += 1;
+    }
+
+    // NOTE(ojf): Subnormals, infinities and underflow all go to the fallback
+    if((Exponent2 - 1) >= (0x7FF - 1))
+    {
+        return false;
+    }
+
+    u64 Bits = (Exponent2 << 52) | (ResultMantissa & 0x000FFFFFFFFFFFFFull);
+    if(Decimal.Negative)
+    {
+        Bits |= 0x8000000000000000ull;
+    }
+    memcpy(Result, &Bits, sizeof(Bits));
+
+    return true;
+}
+
+static f64 ConvertJSONNumberWithStrtod(buffer Source)
+{
+    char Stack[64];
+    char *Text = Stack;
+    if(Source.Count >= sizeof(Stack))
+    {
+        Text = (char *)malloc(Source.Count + 1);
+    }
+
+    memcpy(Text, Source.Data, Source.Count);
+    Text[Source.Count] = 0;
+    f64 Result = strtod(Text, 0);
+
+    if(Text != Stack)
+    {
+        free(Text);
+    }
+
+    return Result;
+}
+
+static f64 ConvertJSONNumberToF64(buffer Source)
+{
+    f64 Result = 0;
+
+    json_decimal Decimal = ParseJSONDecimal(Source);
+    if(Decimal.Mantissa == 0)
+    {
+        Result = Decimal.Negative ? -0.0 : 0.0;
+    }
+    else if(Decimal.Truncated)
+    {
+        json_decimal RoundedUp = Decimal;
+        ++RoundedUp.Mantissa;
+
+        f64 UpperResult;
+        if(!EiselLemire(Decimal, &Result) ||
+           !EiselLemire(RoundedUp, &UpperResult) ||
+           (Result != UpperResult))
+        {
+            Result = ConvertJSONNumberWithStrtod(Source);
+        }
+    }
+    else if(!ClingerFastPath(Decimal, &Result) &&
+            !EiselLemire(Decimal, &Result))
+    {
+        Result = ConvertJSONNumberWithStrtod(Source);
+    }
+
+    return Result;
+}
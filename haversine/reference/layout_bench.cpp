@@ -0,0 +1,178 @@
+/* ========================================================================
+   AoS vs SoA haversine throughput
+   ======================================================================== */
+
+/* NOTE(ojf): Fills the same random pairs into both layouts at working set
+   sizes meant to sit in L1, L2, L3 and DRAM, then times every kernel this
+   CPU has over each one.  Both layouts are 32 bytes a pair, so the sizes
+   are the same for both.
+
+   The sizes are fixed rather than read from the CPU: 16kb and 1mb fit the
+   L1 and L2 of anything recent, 32mb fits most server L3s but not most
+   desktop ones, so check the L3 size before reading that row.  The DRAM
+   size can be changed on the command line.
+
+   Each measurement is the best of as many passes as fit in about a quarter
+   of a second (at least 3), so the small sets are warm and the DRAM set
+   only ever streams.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int32_t i32;
+typedef int64_t i64;
+
+typedef int32_t b32;
+
+typedef float f32;
+typedef double f64;
+
+struct haversine_pair
+{
+    f64 X0, Y0;
+    f64 X1, Y1;
+};
+
+#include "platform_metrics.cpp"
+#include "haversine_formula.cpp"
+#include "buffer.cpp"
+#include "cpu_features.cpp"
+#include "haversine_math.cpp"
+#include "platform_thread.cpp"
+#include "platform_memory.cpp"
+#include "haversine_pair_soa.cpp"
+#include "haversine_simd.cpp"
+
+#define EARTH_RADIUS 6372.8
+#define MIN_PASSES 3
+
+struct working_set
+{
+    char const *Name;
+    u64 Size;
+};
+
+static u64 RandomU64(u64 *State)
+{
+    // NOTE(ojf): splitmix64
+    u64 Result = (*State += 0x9e3779b97f4a7c15ull);
+    Result = (Result ^ (Result >> 30)) * 0xbf58476d1ce4e5b9ull;
+    Result = (Result ^ (Result >> 27)) * 0x94d049bb133111ebull;
+    Result ^= (Result >> 31);
+    return Result;
+}
+
+static f64 RandomInRange(u64 *State, f64 Min, f64 Max)
+{
+    f64 Unit = (f64)(RandomU64(State) >> 11) * (1.0 / 9007199254740992.0);
+    f64 Result = Min + (Max - Min)*Unit;
+    return Result;
+}
+
+static u64 BestCyclesPerPass(haversine_kernel Kernel, u64 PairCount, pair_storage *Storage, u64 CPUFreq, f64 *Sink)
+{
+    u64 BestCycles = ~0ull;
+    u64 TotalCycles = 0;
+    for(u32 Pass = 0; (Pass < MIN_PASSES) || (TotalCycles < (CPUFreq / 4)); ++Pass)
+    {
+        u64 Start = ReadCPUTimer();
+        *Sink += HaversineWithStorage(Kernel, PairCount, Storage, EARTH_RADIUS, 0);
+        u64 Cycles = ReadCPUTimer() - Start;
+
+        TotalCycles += Cycles;
+        if(Cycles < BestCycles)
+        {
+            BestCycles = Cycles;
+        }
+    }
+
+    return BestCycles;
+}
+
+int main(int ArgCount, char **Args)
+{
+    u64 DRAMMegabytes = 512;
+    if(ArgCount > 1)
+    {
+        DRAMMegabytes = strtoull(Args[1], 0, 10);
+    }
+
+    if(!DRAMMegabytes)
+    {
+        fprintf(stderr, "Usage: %s [DRAM working set in mb]\n", Args[0]);
+        return 1;
+    }
+
+    working_set WorkingSets[] =
+    {
+        {"L1", 16*1024},
+        {"L2", 1024*1024},
+        {"L3", 32*1024*1024},
+        {"DRAM", DRAMMegabytes*1024*1024},
+    };
+
+    u64 CPUFreq = EstimateCPUTimerFreq(100);
+    haversine_kernel BestKernel = GetBestHaversineKernel();
+
+    fprintf(stdout, "Set        Size     Pairs  Kernel   AoS cycles/pair  SoA cycles/pair  SoA speedup  SoA gb/s\n");
+
+    int Result = 0;
+    f64 Sink = 0;
+    for(u32 SetIndex = 0; SetIndex < ArrayCount(WorkingSets); ++SetIndex)
+    {
+        working_set *Set = WorkingSets + SetIndex;
+        u64 PairCount = Set->Size / sizeof(haversine_pair);
+
+        pair_storage AoS = AllocatePairStorage(PairLayout_aos, PairCount);
+        pair_storage SoA = AllocatePairStorage(PairLayout_soa, PairCount);
+        if(AoS.Memory.Count && SoA.Memory.Count)
+        {
+            u64 State = 1;
+            for(u64 PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+            {
+                haversine_pair Pair;
+                Pair.X0 = RandomInRange(&State, -180.0, 180.0);
+                Pair.Y0 = RandomInRange(&State, -90.0, 90.0);
+                Pair.X1 = RandomInRange(&State, -180.0, 180.0);
+                Pair.Y1 = RandomInRange(&State, -90.0, 90.0);
+                StorePair(&AoS, PairIndex, Pair);
+                StorePair(&SoA, PairIndex, Pair);
+            }
+
+            for(u32 Kernel = 0; Kernel <= (u32)BestKernel; ++Kernel)
+            {
+                u64 AoSCycles = BestCyclesPerPass((haversine_kernel)Kernel, PairCount, &AoS, CPUFreq, &Sink);
+                u64 SoACycles = BestCyclesPerPass((haversine_kernel)Kernel, PairCount, &SoA, CPUFreq, &Sink);
+
+                f64 SoASeconds = (f64)SoACycles / (f64)CPUFreq;
+                fprintf(stdout, "%-5s %9.2fmb %9llu  %-7s %16.2f %16.2f %11.2fx %9.3f\n",
+                        Set->Name, (f64)Set->Size / (1024.0*1024.0), PairCount, HaversineKernelNames[Kernel],
+                        (f64)AoSCycles / (f64)PairCount, (f64)SoACycles / (f64)PairCount,
+                        (f64)AoSCycles / (f64)SoACycles,
+                        ((f64)Set->Size / (1024.0*1024.0*1024.0)) / SoASeconds);
+            }
+        }
+        else
+        {
+            Result = 1;
+        }
+
+        FreePairStorage(&AoS);
+        FreePairStorage(&SoA);
+    }
+
+    // NOTE(ojf): Printed so the timed passes can't be thrown away
+    fprintf(stdout, "(checksum %g)\n", Sink);
+
+    return Result;
+}
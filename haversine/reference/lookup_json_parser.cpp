@@ -44,6 +44,7 @@ struct json_token
 struct json_element
 {
     buffer Label;
+    u64 LabelHash;
     buffer Value;
     json_element *FirstSubElement;
     
@@ -55,8 +56,28 @@ struct json_parser
     buffer Source;
     u64 At;
     b32 HadError;
+    
+    memory_arena *Arena;
+    
+    // NOTE(ojf): When set, tokens come from the structural index instead of
+    // scanning Source byte by byte
+    structural_index *Index;
+    u64 NextStructural;
 };
 
+// NOTE(ojf): FNV-1a, labels are short so anything fancier wouldn't pay off
+static u64 HashJSONLabel(buffer Label)
+{
+    u64 Result = 0xcbf29ce484222325ull;
+    for(u64 Index = 0; Index < Label.Count; ++Index)
+    {
+        Result ^= Label.Data[Index];
+        Result *= 0x100000001b3ull;
+    }
+    
+    return Result;
+}
+
 static b32 IsJSONDigit(buffer Source, u64 At)
 {
     b32 Result = false;
@@ -109,8 +130,85 @@ static void ParseKeyword(buffer Source, u64 *At, buffer KeywordRemaining, json_t
     }
 }
 
+// NOTE(ojf): Stage 2 of the indexed tokenizer.  Each position in the index
+// starts a token, and the token runs up to the next position less any
+// whitespace, so a string ends at the last quote before the next operator.
+static json_token GetIndexedJSONToken(json_parser *Parser)
+{
+    json_token Result = {};
+    
+    buffer Source = Parser->Source;
+    structural_index *Index = Parser->Index;
+    if(Parser->NextStructural < Index->Count)
+    {
+        u64 Start = Index->Positions[Parser->NextStructural++];
+        u64 End = Index->Positions[Parser->NextStructural];
+        
+        Result.Type = Token_error;
+        Result.Value.Count = 1;
+        Result.Value.Data = Source.Data + Start;
+        u8 Val = Source.Data[Start];
+        switch(Val)
+        {
+            case '{': {Result.Type = Token_open_brace;} break;
+            case '[': {Result.Type = Token_open_bracket;} break;
+            case '}': {Result.Type = Token_close_brace;} break;
+            case ']': {Result.Type = Token_close_bracket;} break;
+            case ',': {Result.Type = Token_comma;} break;
+            case ':': {Result.Type = Token_colon;} break;
+            case ';': {Result.Type = Token_semi_colon;} break;
+            
+            default:
+            {
+                while((End > (Start + 1)) && IsJSONWhitespace(Source, End - 1))
+                {
+                    --End;
+                }
+                
+                Result.Value.Count = End - Start;
+                if(Val == '"')
+                {
+                    if((End > (Start + 1)) && (Source.Data[End - 1] == '"'))
+                    {
+                        Result.Type = Token_string_literal;
+                        Result.Value.Data = Source.Data + Start + 1;
+                        Result.Value.Count = End - Start - 2;
+                    }
+                }
+                else if((Val == '-') || ((Val >= '0') && (Val <= '9')))
+                {
+                    Result.Type = Token_number;
+                }
+                else if(AreEqual(Result.Value, CONSTANT_STRING("true")))
+                {
+                    Result.Type = Token_true;
+                }
+                else if(AreEqual(Result.Value, CONSTANT_STRING("false")))
+                {
+                    Result.Type = Token_false;
+                }
+                else if(AreEqual(Result.Value, CONSTANT_STRING("null")))
+                {
+                    Result.Type = Token_null;
+                }
+            } break;
+        }
+    }
+    
+    Parser->At = Index->Positions[Parser->NextStructural];
+    
+    return Result;
+}
+
 static json_token GetJSONToken(json_parser *Parser)
 {
+    TimeDetailFunction;
+    
+    if(Parser->Index)
+    {
+        return GetIndexedJSONToken(Parser);
+    }
+    
     json_token Result = {};
     
     buffer Source = Parser->Source;
@@ -280,8 +378,17 @@ static json_element *ParseJSONElement(json_parser *Parser, buffer Label, json_to
     
     if(Valid)
     {
-        Result = (json_element *)malloc(sizeof(json_element));
+        Result = PushStruct(Parser->Arena, json_element);
+        if(!Result)
+        {
+            Error(Parser, Value, "Out of memory for JSON elements");
+        }
+    }
+    
+    if(Result)
+    {
         Result->Label = Label;
+        Result->LabelHash = HashJSONLabel(Label);
         Result->Value = Value.Value;
         Result->FirstSubElement = SubElement;
         Result->NextSibling = 0;
@@ -349,25 +456,24 @@ static json_element *ParseJSONList(json_parser *Parser, json_token StartingToken
     return FirstElement;
 }
 
-static json_element *ParseJSON(buffer InputJSON)
+// NOTE(ojf): Every element is pushed onto Arena, so the whole tree is freed
+// by releasing (or resetting) the arena
+static json_element *ParseJSON(buffer InputJSON, memory_arena *Arena)
 {
     json_parser Parser = {};
     Parser.Source = InputJSON;
+    Parser.Arena = Arena;
     
     json_element *Result = ParseJSONElement(&Parser, {}, GetJSONToken(&Parser));
     return Result;
 }
 
-static void FreeJSON(json_element *Element)
+// NOTE(ojf): Every token is at least one byte plus a separator, so this
+// is the most elements any input can produce
+static u64 GetMaxJSONArenaSize(buffer InputJSON)
 {
-    while(Element)
-    {
-        json_element *FreeElement = Element;
-        Element = Element->NextSibling;
-    
-        FreeJSON(FreeElement->FirstSubElement);
-        free(FreeElement);
-    }
+    u64 Result = sizeof(json_element)*(InputJSON.Count/2 + 1);
+    return Result;
 }
 
 static json_element *LookupElement(json_element *Object, buffer ElementName)
@@ -376,9 +482,10 @@ static json_element *LookupElement(json_element *Object, buffer ElementName)
     
     if(Object)
     {
+        u64 Hash = HashJSONLabel(ElementName);
         for(json_element *Search = Object->FirstSubElement; Search; Search = Search->NextSibling)
         {
-            if(AreEqual(Search->Label, ElementName))
+            if((Search->LabelHash == Hash) && AreEqual(Search->Label, ElementName))
             {
                 Result = Search;
                 break;
@@ -389,120 +496,144 @@ static json_element *LookupElement(json_element *Object, buffer ElementName)
     return Result;
 }
 
-static f64 ConvertJSONSign(buffer Source, u64 *AtResult)
-{
-    u64 At = *AtResult;
+/* NOTE(ojf): A field cursor looks up the same set of fields in many objects
+   that share a layout.  It remembers which field was found at each position
+   last time, and walks the object's children once, checking each child
+   against that field first.  When every object has the same key order (as
+   the generated pair objects do), each lookup is one compare, and the walk
+   stops as soon as every field is found.
+*/
 
-    f64 Result = 1.0;
-    if(IsInBounds(Source, At) && (Source.Data[At] == '-'))
-    {
-        Result = -1.0;
-        ++At;
-    }
-    
-    *AtResult = At;
+#define MAX_CURSOR_FIELDS 8
+#define MAX_CURSOR_OBJECT_FIELDS 32
 
-    return Result;
-}
+struct json_field_cursor
+{
+    u32 FieldCount;
+    buffer FieldNames[MAX_CURSOR_FIELDS];
+    u64 FieldHashes[MAX_CURSOR_FIELDS];
+    u32 GuessedPositions[MAX_CURSOR_FIELDS];
+    
+    // NOTE(ojf): The field expected at each position, MAX_CURSOR_FIELDS for none
+    u32 ExpectedFields[MAX_CURSOR_OBJECT_FIELDS];
+};
 
-static f64 ConvertJSONNumber(buffer Source, u64 *AtResult)
+static json_field_cursor CreateFieldCursor(u32 FieldCount, buffer *FieldNames)
 {
-    u64 At = *AtResult;
+    json_field_cursor Cursor = {};
     
-    f64 Result = 0.0;
-    while(IsInBounds(Source, At))
+    assert(FieldCount <= MAX_CURSOR_FIELDS);
+    Cursor.FieldCount = FieldCount;
+    for(u32 Position = 0; Position < MAX_CURSOR_OBJECT_FIELDS; ++Position)
     {
-        u8 Char = Source.Data[At] - (u8)'0';
-        if(Char < 10)
-        {
-            Result = 10.0*Result + (f64)Char;
-            ++At;
-        }
-        else
-        {
-            break;
-        }
+        Cursor.ExpectedFields[Position] = (Position < FieldCount) ? Position : MAX_CURSOR_FIELDS;
     }
     
-    *AtResult = At;
+    for(u32 FieldIndex = 0; FieldIndex < FieldCount; ++FieldIndex)
+    {
+        Cursor.FieldNames[FieldIndex] = FieldNames[FieldIndex];
+        Cursor.FieldHashes[FieldIndex] = HashJSONLabel(FieldNames[FieldIndex]);
+        Cursor.GuessedPositions[FieldIndex] = FieldIndex;
+    }
     
+    return Cursor;
+}
+
+inline b32 IsCursorField(json_field_cursor *Cursor, u32 FieldIndex, json_element *Element)
+{
+    b32 Result = ((Element->LabelHash == Cursor->FieldHashes[FieldIndex]) &&
+                  AreEqual(Element->Label, Cursor->FieldNames[FieldIndex]));
     return Result;
 }
 
-static f64 ConvertElementToF64(json_element *Object, buffer ElementName)
+// NOTE(ojf): Fills Fields[i] with the first element labelled FieldNames[i],
+// or 0 if Object has no such field
+static void LookupFields(json_field_cursor *Cursor, json_element *Object, json_element **Fields)
 {
-    f64 Result = 0.0;
+    for(u32 FieldIndex = 0; FieldIndex < Cursor->FieldCount; ++FieldIndex)
+    {
+        Fields[FieldIndex] = 0;
+    }
     
-    json_element *Element = LookupElement(Object, ElementName);
-    if(Element)
+    u32 FoundCount = 0;
+    u32 Position = 0;
+    for(json_element *Child = Object ? Object->FirstSubElement : 0;
+        Child && (FoundCount < Cursor->FieldCount);
+        Child = Child->NextSibling, ++Position)
     {
-        buffer Source = Element->Value;
-        u64 At = 0;
-        
-        f64 Sign = ConvertJSONSign(Source, &At);
-        f64 Number = ConvertJSONNumber(Source, &At);
-        
-        if(IsInBounds(Source, At) && (Source.Data[At] == '.'))
+        u32 Expected = (Position < MAX_CURSOR_OBJECT_FIELDS) ? Cursor->ExpectedFields[Position] : MAX_CURSOR_FIELDS;
+        if((Expected < Cursor->FieldCount) && !Fields[Expected] && IsCursorField(Cursor, Expected, Child))
+        {
+            Fields[Expected] = Child;
+            ++FoundCount;
+        }
+        else
         {
-            ++At;
-            f64 C = 1.0 / 10.0;
-            while(IsInBounds(Source, At))
+            for(u32 FieldIndex = 0; FieldIndex < Cursor->FieldCount; ++FieldIndex)
             {
-                u8 Char = Source.Data[At] - (u8)'0';
-                if(Char < 10)
-                {
-                    Number = Number + C*(f64)Char;
-                    C *= 1.0 / 10.0;
-                    ++At;
-                }
-                else
+                if(!Fields[FieldIndex] && IsCursorField(Cursor, FieldIndex, Child))
                 {
+                    Fields[FieldIndex] = Child;
+                    ++FoundCount;
+                    
+                    // NOTE(ojf): Move the guess, so the next object with this
+                    // layout gets it on the first compare
+                    if(Position < MAX_CURSOR_OBJECT_FIELDS)
+                    {
+                        u32 OldPosition = Cursor->GuessedPositions[FieldIndex];
+                        if((OldPosition < MAX_CURSOR_OBJECT_FIELDS) &&
+                           (Cursor->ExpectedFields[OldPosition] == FieldIndex))
+                        {
+                            Cursor->ExpectedFields[OldPosition] = MAX_CURSOR_FIELDS;
+                        }
+                        
+                        Cursor->ExpectedFields[Position] = FieldIndex;
+                        Cursor->GuessedPositions[FieldIndex] = Position;
+                    }
                     break;
                 }
             }
         }
-        
-        if(IsInBounds(Source, At) && ((Source.Data[At] == 'e') || (Source.Data[At] == 'E')))
-        {
-            ++At;
-            if(IsInBounds(Source, At) && (Source.Data[At] == '+'))
-            {
-                ++At;
-            }
-
-            f64 ExponentSign = ConvertJSONSign(Source, &At);
-            f64 Exponent = ExponentSign*ConvertJSONNumber(Source, &At);
-            Number *= pow(10.0, Exponent);
-        }
-        
-        Result = Sign*Number;
     }
-    
-    return Result;
 }
 
-static u64 ParseHaversinePairs(buffer InputJSON, u64 MaxPairCount, haversine_pair *Pairs)
+static u64 ParseHaversinePairs(buffer InputJSON, u64 MaxPairCount, pair_storage *Storage)
 {
+    TimeFunction;
+    
     u64 PairCount = 0;
     
-    json_element *JSON = ParseJSON(InputJSON);
+    memory_arena Arena = ReserveArena(GetMaxJSONArenaSize(InputJSON));
+    json_element *JSON = ParseJSON(InputJSON, &Arena);
     json_element *PairsArray = LookupElement(JSON, CONSTANT_STRING("pairs"));
     if(PairsArray)
     {
+        buffer FieldNames[] =
+        {
+            CONSTANT_STRING("x0"),
+            CONSTANT_STRING("y0"),
+            CONSTANT_STRING("x1"),
+            CONSTANT_STRING("y1"),
+        };
+        json_field_cursor Cursor = CreateFieldCursor(ArrayCount(FieldNames), FieldNames);
+        
         for(json_element *Element = PairsArray->FirstSubElement;
             Element && (PairCount < MaxPairCount);
             Element = Element->NextSibling)
         {
-            haversine_pair *Pair = Pairs + PairCount++;
+            json_element *Fields[ArrayCount(FieldNames)];
+            LookupFields(&Cursor, Element, Fields);
             
-            Pair->X0 = ConvertElementToF64(Element, CONSTANT_STRING("x0"));
-            Pair->Y0 = ConvertElementToF64(Element, CONSTANT_STRING("y0"));
-            Pair->X1 = ConvertElementToF64(Element, CONSTANT_STRING("x1"));
-            Pair->Y1 = ConvertElementToF64(Element, CONSTANT_STRING("y1"));
+            haversine_pair Pair;
+            Pair.X0 = Fields[0] ? ConvertJSONNumberToF64(Fields[0]->Value) : 0.0;
+            Pair.Y0 = Fields[1] ? ConvertJSONNumberToF64(Fields[1]->Value) : 0.0;
+            Pair.X1 = Fields[2] ? ConvertJSONNumberToF64(Fields[2]->Value) : 0.0;
+            Pair.Y1 = Fields[3] ? ConvertJSONNumberToF64(Fields[3]->Value) : 0.0;
+            StorePair(Storage, PairCount++, Pair);
         }
     }
     
-    FreeJSON(JSON);
+    ReleaseArena(&Arena);
     
     return PairCount;
 }
@@ -0,0 +1,285 @@
+/* ========================================================================
+   Accuracy and cost sweep for haversine_math.cpp
+   ======================================================================== */
+
+/* NOTE(ojf): For every polynomial in haversine_math.cpp, and for libm, walks
+   the whole input range the haversine formula uses and reports the worst
+   absolute and ULP error against the x87 long double versions of the same
+   functions (64 bit mantissa, 11 bits more than a double), then times a
+   loop of calls to get TSC cycles per call.
+
+   Cycles are per call in a loop of independent calls summed into one
+   accumulator, so they measure throughput, not latency, and can't go below
+   the latency of an add.  ULP error is relative, so it blows up where the
+   true value goes to zero (cos at the ends of its range) even when the
+   absolute error is tiny; read both columns.  Under MSVC long double is just a double and the
+   error columns are meaningless.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int32_t i32;
+typedef int64_t i64;
+
+typedef int32_t b32;
+
+typedef float f32;
+typedef double f64;
+
+#include "platform_metrics.cpp"
+#include "haversine_formula.cpp"
+#include "buffer.cpp"
+#include "haversine_math.cpp"
+
+#define TIMING_INPUT_COUNT 4096
+#define TIMING_REPEATS 200
+
+enum math_function
+{
+    MathFunction_sin,
+    MathFunction_cos,
+    MathFunction_asin,
+    MathFunction_sqrt,
+
+    MathFunction_count,
+};
+
+struct math_domain
+{
+    char const *Name;
+    f64 Min;
+    f64 Max;
+    polynomial const *Polynomials;
+    u32 PolynomialCount;
+};
+
+static math_domain const MathDomains[MathFunction_count] =
+{
+    {"sin", -HAVERSINE_PI_HI, HAVERSINE_PI_HI, SinPolynomials, ArrayCount(SinPolynomials)},
+    {"cos", -HAVERSINE_HALF_PI, HAVERSINE_HALF_PI, CosPolynomials, ArrayCount(CosPolynomials)},
+    {"asin", 0.0, 1.0, ArcSinPolynomials, ArrayCount(ArcSinPolynomials)},
+    {"sqrt", 0.0, 1.0, 0, 0},
+};
+
+struct error_stats
+{
+    f64 MaxAbsError;
+    f64 MaxAbsErrorAt;
+    f64 MaxULPError;
+    f64 MaxULPErrorAt;
+};
+
+static long double ReferenceValue(math_function Function, f64 X)
+{
+    long double Result = 0;
+    switch(Function)
+    {
+        case MathFunction_sin: {Result = sinl((long double)X);} break;
+        case MathFunction_cos: {Result = cosl((long double)X);} break;
+        case MathFunction_asin: {Result = asinl((long double)X);} break;
+        case MathFunction_sqrt: {Result = sqrtl((long double)X);} break;
+        default: {} break;
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Polynomial is ignored for sqrt, which only has SQRTSD
+static f64 EvaluateFunction(math_function Function, f64 X, polynomial const *Polynomial, b32 Libm)
+{
+    f64 Result = 0;
+    switch(Function)
+    {
+        case MathFunction_sin: {Result = Libm ? sin(X) : HaversineSin(X, Polynomial);} break;
+        case MathFunction_cos: {Result = Libm ? cos(X) : HaversineCos(X, Polynomial);} break;
+        case MathFunction_asin: {Result = Libm ? asin(X) : HaversineArcSin(X, Polynomial);} break;
+        case MathFunction_sqrt: {Result = Libm ? sqrt(X) : HaversineSqrt(X);} break;
+        default: {} break;
+    }
+
+    return Result;
+}
+
+static void AccumulateError(error_stats *Stats, f64 X, f64 Value, long double Reference)
+{
+    f64 AbsError = (f64)fabsl((long double)Value - Reference);
+    if(AbsError > Stats->MaxAbsError)
+    {
+        Stats->MaxAbsError = AbsError;
+        Stats->MaxAbsErrorAt = X;
+    }
+
+    // NOTE(ojf): One ULP is the gap between the double nearest the true
+    // value and the next double away from zero
+    f64 Nearest = fabs((f64)Reference);
+    if(Nearest > 0)
+    {
+        f64 ULP = nextafter(Nearest, INFINITY) - Nearest;
+        f64 ULPError = (f64)(fabsl((long double)Value - Reference) / ULP);
+        if(ULPError > Stats->MaxULPError)
+        {
+            Stats->MaxULPError = ULPError;
+            Stats->MaxULPErrorAt = X;
+        }
+    }
+}
+
+static f64 GridInput(math_domain const *Domain, u64 Index, u64 Count)
+{
+    f64 Result = Domain->Min + (Domain->Max - Domain->Min)*((f64)Index / (f64)(Count - 1));
+    return Result;
+}
+
+static f64 RandomInput(math_domain const *Domain, u64 *State)
+{
+    // NOTE(ojf): splitmix64, top 53 bits as a unit double
+    u64 Bits = (*State += 0x9e3779b97f4a7c15ull);
+    Bits = (Bits ^ (Bits >> 30)) * 0xbf58476d1ce4e5b9ull;
+    Bits = (Bits ^ (Bits >> 27)) * 0x94d049bb133111ebull;
+    Bits ^= (Bits >> 31);
+
+    f64 Unit = (f64)(Bits >> 11) * (1.0 / 9007199254740992.0);
+    f64 Result = Domain->Min + (Domain->Max - Domain->Min)*Unit;
+    return Result;
+}
+
+// NOTE(ojf): One variant per polynomial, or just SQRTSD for sqrt, then libm
+static u32 GetVariantCount(math_domain const *Domain)
+{
+    u32 Result = (Domain->PolynomialCount ? Domain->PolynomialCount : 1) + 1;
+    return Result;
+}
+
+static polynomial const *GetVariant(math_domain const *Domain, u32 Variant)
+{
+    polynomial const *Result = 0;
+    if(Variant < Domain->PolynomialCount)
+    {
+        Result = Domain->Polynomials + Variant;
+    }
+
+    return Result;
+}
+
+static b32 IsLibmVariant(math_domain const *Domain, u32 Variant)
+{
+    b32 Result = (Variant == (GetVariantCount(Domain) - 1));
+    return Result;
+}
+
+static f64 MeasureCyclesPerCall(math_function Function, polynomial const *Polynomial, b32 Libm,
+                                f64 *Inputs, f64 *Sink)
+{
+    u64 BestCycles = ~0ull;
+    for(u32 Repeat = 0; Repeat < TIMING_REPEATS; ++Repeat)
+    {
+        f64 Sum = 0;
+        u64 Start = ReadCPUTimer();
+        for(u32 Index = 0; Index < TIMING_INPUT_COUNT; ++Index)
+        {
+            Sum += EvaluateFunction(Function, Inputs[Index], Polynomial, Libm);
+        }
+        u64 Cycles = ReadCPUTimer() - Start;
+
+        *Sink += Sum;
+        if(Cycles < BestCycles)
+        {
+            BestCycles = Cycles;
+        }
+    }
+
+    f64 Result = (f64)BestCycles / (f64)TIMING_INPUT_COUNT;
+    return Result;
+}
+
+int main(int ArgCount, char **Args)
+{
+    u64 SampleCount = 10*1000*1000;
+    if(ArgCount > 1)
+    {
+        SampleCount = strtoull(Args[1], 0, 10);
+    }
+
+    if(SampleCount < 4)
+    {
+        fprintf(stderr, "Usage: %s [samples per function]\n", Args[0]);
+        return 1;
+    }
+
+    fprintf(stdout, "%llu samples per function, errors against long double (%u bit mantissa)\n\n",
+            SampleCount, (u32)LDBL_MANT_DIG);
+    fprintf(stdout, "function  terms  max abs error         at x    max ulp         at x  cycles/call\n");
+
+    f64 Sink = 0;
+    f64 *Inputs = (f64 *)malloc(sizeof(f64)*TIMING_INPUT_COUNT);
+    for(u32 Function = 0; Function < MathFunction_count; ++Function)
+    {
+        math_domain const *Domain = MathDomains + Function;
+        u32 VariantCount = GetVariantCount(Domain);
+
+        // NOTE(ojf): Half the samples on an even grid, which always hits the
+        // ends of the range, half uniformly random in between
+        error_stats Stats[MAX_POLYNOMIAL_TERMS + 2] = {};
+        u64 RandomState = Function + 1;
+        for(u64 SampleIndex = 0; SampleIndex < SampleCount; ++SampleIndex)
+        {
+            f64 X = (SampleIndex & 1) ?
+                RandomInput(Domain, &RandomState) :
+                GridInput(Domain, SampleIndex / 2, (SampleCount + 1) / 2);
+            long double Reference = ReferenceValue((math_function)Function, X);
+            for(u32 Variant = 0; Variant < VariantCount; ++Variant)
+            {
+                f64 Value = EvaluateFunction((math_function)Function, X, GetVariant(Domain, Variant),
+                                             IsLibmVariant(Domain, Variant));
+                AccumulateError(Stats + Variant, X, Value, Reference);
+            }
+        }
+
+        for(u32 Index = 0; Index < TIMING_INPUT_COUNT; ++Index)
+        {
+            Inputs[Index] = RandomInput(Domain, &RandomState);
+        }
+
+        for(u32 Variant = 0; Variant < VariantCount; ++Variant)
+        {
+            b32 Libm = IsLibmVariant(Domain, Variant);
+            polynomial const *Polynomial = GetVariant(Domain, Variant);
+            f64 Cycles = MeasureCyclesPerCall((math_function)Function, Polynomial, Libm, Inputs, &Sink);
+
+            char Terms[16];
+            if(Libm)
+            {
+                sprintf(Terms, "libm");
+            }
+            else if(Polynomial)
+            {
+                sprintf(Terms, "%u", Polynomial->Count);
+            }
+            else
+            {
+                sprintf(Terms, "sqrtsd");
+            }
+
+            error_stats *Error = Stats + Variant;
+            fprintf(stdout, "%-8s %6s  %13.3e  %11.6f  %9.3g  %11.6f  %11.2f\n", Domain->Name, Terms,
+                    Error->MaxAbsError, Error->MaxAbsErrorAt, Error->MaxULPError, Error->MaxULPErrorAt, Cycles);
+        }
+        fprintf(stdout, "\n");
+    }
+
+    // NOTE(ojf): Printed so the timing loops can't be thrown away
+    fprintf(stdout, "(checksum %g)\n", Sink);
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/* ========================================================================
+   Linear arena over reserved virtual memory
+   ======================================================================== */
+
+/* NOTE(ojf): The whole arena is reserved as address space up front, and
+   pages are committed in ARENA_COMMIT_CHUNK_SIZE steps as the arena grows,
+   so pushing is a bump of Used and freeing everything is a single release.
+*/
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define ARENA_COMMIT_CHUNK_SIZE (64ull*1024*1024)
+
+struct memory_arena
+{
+    u8 *Base;
+    u64 Reserved;
+    u64 Committed;
+    u64 Used;
+};
+
+static u64 RoundUpToChunk(u64 Size)
+{
+    u64 Result = (Size + ARENA_COMMIT_CHUNK_SIZE - 1) & ~(ARENA_COMMIT_CHUNK_SIZE - 1);
+    return Result;
+}
+
+static memory_arena ReserveArena(u64 ReserveSize)
+{
+    memory_arena Arena = {};
+    u64 Size = RoundUpToChunk(ReserveSize ? ReserveSize : 1);
+
+#if _WIN32
+    Arena.Base = (u8 *)VirtualAlloc(0, Size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void *Base = mmap(0, Size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    Arena.Base = (Base == MAP_FAILED) ? 0 : (u8 *)Base;
+#endif
+
+    if(Arena.Base)
+    {
+        Arena.Reserved = Size;
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Unable to reserve %llu bytes of address space.\n", Size);
+    }
+
+    return Arena;
+}
+
+static b32 CommitArena(memory_arena *Arena, u64 Size)
+{
+    b32 Result = false;
+
+    u64 NewCommitted = RoundUpToChunk(Size);
+    if(NewCommitted > Arena->Reserved)
+    {
+        NewCommitted = Arena->Reserved;
+    }
+
+    if(NewCommitted >= Size)
+    {
+        u8 *Start = Arena->Base + Arena->Committed;
+        u64 CommitSize = NewCommitted - Arena->Committed;
+#if _WIN32
+        Result = (VirtualAlloc(Start, CommitSize, MEM_COMMIT, PAGE_READWRITE) != 0);
+#else
+        Result = (mprotect(Start, CommitSize, PROT_READ|PROT_WRITE) == 0);
+#endif
+        if(Result)
+        {
+            Arena->Committed = NewCommitted;
+        }
+    }
+
+    return Result;
+}
+
+static void *PushSize(memory_arena *Arena, u64 Size)
+{
+    void *Result = 0;
+
+    u64 AlignedUsed = (Arena->Used + 7) & ~7ull;
+    u64 NewUsed = AlignedUsed + Size;
+    if((NewUsed <= Arena->Committed) || CommitArena(Arena, NewUsed))
+    {
+        Result = Arena->Base + AlignedUsed;
+        Arena->Used = NewUsed;
+    }
+
+    return Result;
+}
+
+#define PushStruct(Arena, type) (type *)PushSize((Arena), sizeof(type))
+
+static void ReleaseArena(memory_arena *Arena)
+{
+    if(Arena->Base)
+    {
+#if _WIN32
+        VirtualFree(Arena->Base, 0, MEM_RELEASE);
+#else
+        munmap(Arena->Base, Arena->Reserved);
+#endif
+    }
+
+    *Arena = {};
+}
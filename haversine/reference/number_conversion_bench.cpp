@@ -0,0 +1,338 @@
+/* ========================================================================
+   JSON number conversion check and benchmark
+   ======================================================================== */
+
+/* NOTE(ojf): Converts millions of random numbers with ConvertJSONNumberToF64,
+   checks every result bit for bit against strtod, and times it against the
+   original digit-by-digit conversion and strtod itself.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int32_t i32;
+typedef int64_t i64;
+
+typedef int32_t b32;
+
+typedef float f32;
+typedef double f64;
+
+struct haversine_pair
+{
+    f64 X0, Y0;
+    f64 X1, Y1;
+};
+
+#include "platform_metrics.cpp"
+#include "profiler.h"
+#include "buffer.cpp"
+#include "memory_arena.cpp"
+#include "json_number_conversion.cpp"
+#include "cpu_features.cpp"
+#include "platform_thread.cpp"
+#include "platform_memory.cpp"
+#include "haversine_pair_soa.cpp"
+#include "structural_index.cpp"
+#include "lookup_json_parser.cpp"
+
+static f64 ConvertJSONSign(buffer Source, u64 *AtResult)
+{
+    u64 At = *AtResult;
+
+    f64 Result = 1.0;
+    if(IsInBounds(Source, At) && (Source.Data[At] == '-'))
+    {
+        Result = -1.0;
+        ++At;
+    }
+    
+    *AtResult = At;
+
+    return Result;
+}
+
+static f64 ConvertJSONNumber(buffer Source, u64 *AtResult)
+{
+    u64 At = *AtResult;
+    
+    f64 Result = 0.0;
+    while(IsInBounds(Source, At))
+    {
+        u8 Char = Source.Data[At] - (u8)'0';
+        if(Char < 10)
+        {
+            Result = 10.0*Result + (f64)Char;
+            ++At;
+        }
+        else
+        {
+            break;
+        }
+    }
+    
+    *AtResult = At;
+    
+    return Result;
+}
+
+// NOTE(ojf): The original digit-by-digit conversion the parsers used before
+// json_number_conversion.cpp.  It isn't correctly rounded, it's only kept
+// here as a baseline
+static f64 ReferenceConvertJSONValueToF64(buffer Source)
+{
+    u64 At = 0;
+    
+    f64 Sign = ConvertJSONSign(Source, &At);
+    f64 Number = ConvertJSONNumber(Source, &At);
+    
+    if(IsInBounds(Source, At) && (Source.Data[At] == '.'))
+    {
+        ++At;
+        f64 C = 1.0 / 10.0;
+        while(IsInBounds(Source, At))
+        {
+            u8 Char = Source.Data[At] - (u8)'0';
+            if(Char < 10)
+            {
+                Number = Number + C*(f64)Char;
+                C *= 1.0 / 10.0;
+                ++At;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+    
+    if(IsInBounds(Source, At) && ((Source.Data[At] == 'e') || (Source.Data[At] == 'E')))
+    {
+        ++At;
+        if(IsInBounds(Source, At) && (Source.Data[At] == '+'))
+        {
+            ++At;
+        }
+
+        f64 ExponentSign = ConvertJSONSign(Source, &At);
+        f64 Exponent = ExponentSign*ConvertJSONNumber(Source, &At);
+        Number *= pow(10.0, Exponent);
+    }
+    
+    f64 Result = Sign*Number;
+    return Result;
+}
+
+struct random_series
+{
+    u64 State;
+};
+
+static u64 RandomU64(random_series *Series)
+{
+    // NOTE(ojf): splitmix64
+    u64 Result = (Series->State += 0x9e3779b97f4a7c15ull);
+    Result = (Result ^ (Result >> 30)) * 0xbf58476d1ce4e5b9ull;
+    Result = (Result ^ (Result >> 27)) * 0x94d049bb133111ebull;
+    Result ^= (Result >> 31);
+    return Result;
+}
+
+static u32 RandomBelow(random_series *Series, u32 Limit)
+{
+    u32 Result = (u32)(RandomU64(Series) % Limit);
+    return Result;
+}
+
+static f64 RandomUnit(random_series *Series)
+{
+    f64 Result = (f64)(RandomU64(Series) >> 11) * (1.0 / 9007199254740992.0);
+    return Result;
+}
+
+// NOTE(ojf): Writes one random JSON number into Dest, returns its length
+static u32 WriteRandomNumber(random_series *Series, char *Dest, b32 GeneratorOnly)
+{
+    int Length = 0;
+    switch(GeneratorOnly ? 0 : RandomBelow(Series, 4))
+    {
+        case 0:
+        {
+            // NOTE(ojf): What the generator writes
+            f64 Value = 360.0*RandomUnit(Series) - 180.0;
+            Length = sprintf(Dest, "%.16f", Value);
+        } break;
+
+        case 1:
+        {
+            // NOTE(ojf): Any finite double, including subnormals, in shortest-ish form
+            f64 Value;
+            do
+            {
+                u64 Bits = RandomU64(Series);
+                memcpy(&Value, &Bits, sizeof(Value));
+            } while(!isfinite(Value));
+            Length = sprintf(Dest, "%.*g", 1 + RandomBelow(Series, 17), Value);
+        } break;
+
+        case 2:
+        {
+            // NOTE(ojf): Random digit strings, some longer than 19 digits
+            if(RandomBelow(Series, 2)) Dest[Length++] = '-';
+            u32 IntDigits = 1 + RandomBelow(Series, 12);
+            u32 FracDigits = RandomBelow(Series, 16);
+            Dest[Length++] = (char)('1' + RandomBelow(Series, 9));
+            for(u32 Digit = 1; Digit < IntDigits; ++Digit)
+            {
+                Dest[Length++] = (char)('0' + RandomBelow(Series, 10));
+            }
+            if(FracDigits)
+            {
+                Dest[Length++] = '.';
+                for(u32 Digit = 0; Digit < FracDigits; ++Digit)
+                {
+                    Dest[Length++] = (char)('0' + RandomBelow(Series, 10));
+                }
+            }
+            Length += sprintf(Dest + Length, "e%d", (int)RandomBelow(Series, 700) - 350);
+        } break;
+
+        case 3:
+        {
+            // NOTE(ojf): Doubles printed exactly enough to sit right next to a
+            // rounding boundary
+            f64 Value = RandomUnit(Series) * pow(10.0, (f64)RandomBelow(Series, 40) - 20.0);
+            f64 Next = nextafter(Value, INFINITY);
+            Length = sprintf(Dest, "%.25e", Value + (Next - Value)*0.5);
+        } break;
+    }
+
+    return (u32)Length;
+}
+
+struct number_set
+{
+    buffer Text;
+    u32 *Offsets;
+    u32 Count;
+};
+
+static number_set GenerateNumbers(u32 Count, u64 Seed, b32 GeneratorOnly)
+{
+    number_set Set = {};
+    Set.Text = AllocateBuffer((u64)Count * 64);
+    Set.Offsets = (u32 *)malloc(sizeof(u32) * (Count + 1));
+    Set.Count = Count;
+
+    random_series Series = {Seed};
+    u32 At = 0;
+    for(u32 Index = 0; Index < Count; ++Index)
+    {
+        Set.Offsets[Index] = At;
+        At += WriteRandomNumber(&Series, (char *)Set.Text.Data + At, GeneratorOnly);
+    }
+    Set.Offsets[Count] = At;
+    Set.Text.Count = At;
+
+    return Set;
+}
+
+static buffer GetNumber(number_set *Set, u32 Index)
+{
+    buffer Result = {Set->Offsets[Index + 1] - Set->Offsets[Index], Set->Text.Data + Set->Offsets[Index]};
+    return Result;
+}
+
+typedef f64 number_converter(buffer Source);
+
+static void TimeConverter(char const *Name, number_converter *Converter, number_set *Set, f64 *Results)
+{
+    u64 Start = ReadOSTimer();
+    for(u32 Index = 0; Index < Set->Count; ++Index)
+    {
+        Results[Index] = Converter(GetNumber(Set, Index));
+    }
+    f64 Seconds = SecondsFromOSTimer(ReadOSTimer() - Start);
+
+    fprintf(stdout, "  %-10s %8.2fns/number %8.2fmb/s\n", Name,
+            1e9*Seconds / Set->Count,
+            ((f64)Set->Text.Count / (1024.0*1024.0)) / Seconds);
+}
+
+static u32 CountMismatches(number_set *Set, f64 *Expected, f64 *Actual, b32 Print)
+{
+    u32 Mismatches = 0;
+    for(u32 Index = 0; Index < Set->Count; ++Index)
+    {
+        if(memcmp(&Expected[Index], &Actual[Index], sizeof(f64)) != 0)
+        {
+            if(Print && (Mismatches < 10))
+            {
+                buffer Number = GetNumber(Set, Index);
+                fprintf(stdout, "  MISMATCH: %.*s -> %.17g, expected %.17g\n",
+                        (int)Number.Count, (char *)Number.Data, Actual[Index], Expected[Index]);
+            }
+            ++Mismatches;
+        }
+    }
+
+    return Mismatches;
+}
+
+int main(int ArgCount, char **Args)
+{
+    u32 Count = 4*1024*1024;
+    u64 Seed = 1;
+    if(ArgCount > 1) Count = (u32)atoi(Args[1]);
+    if(ArgCount > 2) Seed = strtoull(Args[2], 0, 10);
+
+    if(!Count)
+    {
+        fprintf(stderr, "Usage: %s [number count] [seed]\n", Args[0]);
+        return 1;
+    }
+
+    f64 *Expected = (f64 *)malloc(sizeof(f64) * Count);
+    f64 *Fast = (f64 *)malloc(sizeof(f64) * Count);
+    f64 *Reference = (f64 *)malloc(sizeof(f64) * Count);
+
+    int Result = 0;
+    for(u32 GeneratorOnly = 0; GeneratorOnly <= 1; ++GeneratorOnly)
+    {
+        number_set Set = GenerateNumbers(Count, Seed, GeneratorOnly);
+
+        fprintf(stdout, "%s: %u numbers, %llu bytes, seed %llu\n",
+                GeneratorOnly ? "Generator style (%.16f)" : "Mixed",
+                Count, (u64)Set.Text.Count, Seed);
+        TimeConverter("strtod", ConvertJSONNumberWithStrtod, &Set, Expected);
+        TimeConverter("reference", ReferenceConvertJSONValueToF64, &Set, Reference);
+        TimeConverter("fast", ConvertJSONNumberToF64, &Set, Fast);
+
+        u32 FastMismatches = CountMismatches(&Set, Expected, Fast, true);
+        u32 ReferenceMismatches = CountMismatches(&Set, Expected, Reference, false);
+
+        fprintf(stdout, "Mismatches against strtod:\n");
+        fprintf(stdout, "  reference  %u (%.2f%%)\n", ReferenceMismatches, 100.0*ReferenceMismatches / Count);
+        fprintf(stdout, "  fast       %u\n\n", FastMismatches);
+
+        if(FastMismatches)
+        {
+            Result = 1;
+        }
+
+        FreeBuffer(&Set.Text);
+        free(Set.Offsets);
+    }
+
+    return Result;
+}
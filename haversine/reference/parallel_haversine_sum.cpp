@@ -0,0 +1,175 @@
+/* ========================================================================
+   Deterministic parallel haversine sum
+   ======================================================================== */
+
+/* NOTE(ojf): The pairs are cut into fixed blocks of SUM_BLOCK_PAIRS that
+   depend only on the pair count, never on the thread count.  Each block's
+   distances are added in order with Neumaier's compensated sum, and the
+   block sums are combined in a fixed pairwise tree over block index.
+   Threads only decide who computes which block, so the sum is the same bits
+   for any thread count.
+
+   That holds for a given kernel: avx2, avx512 and libm all round distances
+   differently, so machines that have to agree should pin one with -kernel.
+
+   The serial sum adds SumCoef*Dist left to right, which is off by at most
+   about (n+1) units of roundoff times the sum, the compensated sum by about
+   3, so ParallelSumErrorBound is what the two can be expected to differ by.
+*/
+
+#define SUM_BLOCK_PAIRS 4096
+
+struct compensated_sum
+{
+    f64 Sum;
+    f64 Compensation;
+};
+
+inline void AddCompensated(compensated_sum *Sum, f64 Value)
+{
+    f64 T = Sum->Sum + Value;
+    if(fabs(Sum->Sum) >= fabs(Value))
+    {
+        Sum->Compensation += (Sum->Sum - T) + Value;
+    }
+    else
+    {
+        Sum->Compensation += (Value - T) + Sum->Sum;
+    }
+    Sum->Sum = T;
+}
+
+static compensated_sum CombineCompensated(compensated_sum A, compensated_sum B)
+{
+    compensated_sum Result = A;
+    AddCompensated(&Result, B.Sum);
+    Result.Compensation += B.Compensation;
+    return Result;
+}
+
+// NOTE(ojf): Splits at the midpoint every time, so the shape of the tree
+// only depends on Count
+static compensated_sum ReduceCompensated(compensated_sum *Sums, u64 Count)
+{
+    compensated_sum Result = {};
+    if(Count == 1)
+    {
+        Result = Sums[0];
+    }
+    else if(Count > 1)
+    {
+        u64 Half = Count / 2;
+        Result = CombineCompensated(ReduceCompensated(Sums, Half), ReduceCompensated(Sums + Half, Count - Half));
+    }
+
+    return Result;
+}
+
+struct sum_worker
+{
+    haversine_kernel Kernel;
+    pair_storage *Storage;
+    u64 PairCount;
+    f64 EarthRadius;
+
+    compensated_sum *BlockSums;
+    u64 FirstBlock;
+    u64 EndBlock;
+};
+
+static void SumHaversineBlocks(void *Param)
+{
+    sum_worker *Worker = (sum_worker *)Param;
+
+    f64 Distances[SUM_BLOCK_PAIRS];
+    for(u64 BlockIndex = Worker->FirstBlock; BlockIndex < Worker->EndBlock; ++BlockIndex)
+    {
+        u64 FirstPair = BlockIndex*SUM_BLOCK_PAIRS;
+        u64 BlockPairCount = Worker->PairCount - FirstPair;
+        if(BlockPairCount > SUM_BLOCK_PAIRS)
+        {
+            BlockPairCount = SUM_BLOCK_PAIRS;
+        }
+
+        pair_storage Block = OffsetPairStorage(Worker->Storage, FirstPair);
+        HaversineWithStorage(Worker->Kernel, BlockPairCount, &Block, Worker->EarthRadius, Distances);
+
+        compensated_sum Sum = {};
+        for(u64 PairIndex = 0; PairIndex < BlockPairCount; ++PairIndex)
+        {
+            AddCompensated(&Sum, Distances[PairIndex]);
+        }
+        Worker->BlockSums[BlockIndex] = Sum;
+    }
+}
+
+static f64 ParallelSumHaversineDistances(haversine_kernel Kernel, u64 PairCount, pair_storage *Storage,
+                                         f64 EarthRadius, u32 ThreadCount)
+{
+    f64 Result = 0;
+
+    if(ThreadCount < 1) ThreadCount = 1;
+    if(ThreadCount > MAX_PARSE_CHUNKS) ThreadCount = MAX_PARSE_CHUNKS;
+
+    u64 BlockCount = (PairCount + SUM_BLOCK_PAIRS - 1) / SUM_BLOCK_PAIRS;
+    buffer BlockSums = AllocateBuffer(BlockCount*sizeof(compensated_sum) + 1);
+    if(BlockSums.Count)
+    {
+        sum_worker Workers[MAX_PARSE_CHUNKS] = {};
+        for(u32 WorkerIndex = 0; WorkerIndex < ThreadCount; ++WorkerIndex)
+        {
+            sum_worker *Worker = Workers + WorkerIndex;
+            Worker->Kernel = Kernel;
+            Worker->Storage = Storage;
+            Worker->PairCount = PairCount;
+            Worker->EarthRadius = EarthRadius;
+            Worker->BlockSums = (compensated_sum *)BlockSums.Data;
+            Worker->FirstBlock = (BlockCount*WorkerIndex) / ThreadCount;
+            Worker->EndBlock = (BlockCount*(WorkerIndex + 1)) / ThreadCount;
+        }
+
+        os_thread Threads[MAX_PARSE_CHUNKS];
+        b32 Started[MAX_PARSE_CHUNKS] = {};
+        for(u32 WorkerIndex = 1; WorkerIndex < ThreadCount; ++WorkerIndex)
+        {
+            Started[WorkerIndex] = StartOSThread(Threads + WorkerIndex, SumHaversineBlocks, Workers + WorkerIndex);
+            if(!Started[WorkerIndex])
+            {
+                SumHaversineBlocks(Workers + WorkerIndex);
+            }
+        }
+
+        SumHaversineBlocks(Workers);
+
+        for(u32 WorkerIndex = 1; WorkerIndex < ThreadCount; ++WorkerIndex)
+        {
+            if(Started[WorkerIndex])
+            {
+                JoinOSThread(Threads + WorkerIndex);
+            }
+        }
+
+        if(BlockCount)
+        {
+            compensated_sum Total = ReduceCompensated((compensated_sum *)BlockSums.Data, BlockCount);
+            Result = (Total.Sum + Total.Compensation) / (f64)PairCount;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Unable to allocate %llu block sums.\n", BlockCount);
+    }
+
+    FreeBuffer(&BlockSums);
+
+    return Result;
+}
+
+// NOTE(ojf): Distances are never negative, so the sum of their magnitudes
+// is just the sum
+static f64 ParallelSumErrorBound(u64 PairCount, f64 Sum)
+{
+    f64 UnitRoundoff = DBL_EPSILON / 2;
+    f64 Result = ((f64)(PairCount + 1) + 3.0)*UnitRoundoff*fabs(Sum);
+    return Result;
+}
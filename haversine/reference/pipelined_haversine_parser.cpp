@@ -0,0 +1,322 @@
+/* ========================================================================
+   Constant memory read -> parse -> sum pipeline
+   ======================================================================== */
+
+/* NOTE(ojf): A reader thread fills a small ring of fixed size blocks from
+   the file while this thread parses the block before, so memory stays at
+   PIPELINE_BLOCK_COUNT blocks plus one batch of pairs however big the input
+   is, and reading overlaps parsing.
+
+   Pair objects are flat, so everything up to the last } in a block is a
+   run of complete pairs (or the end of the array).  The bytes after it are
+   carried over and copied in front of the next block, which is why every
+   block has PIPELINE_MAX_CARRY bytes of room before its data.  A pair that
+   doesn't fit in the carry is an error.
+
+   The pairs array has to start inside the first block, since the fields
+   before it are skipped with the regular parser.  Anything after the array
+   is ignored.  Parsed pairs go into a batch that the haversine kernel runs
+   on whenever it fills, and the distances are added with the same
+   compensated sum as parallel_haversine_sum.cpp, so the answer doesn't
+   depend on the block or batch size either.
+*/
+
+#define PIPELINE_BLOCK_SIZE (1024*1024)
+#define PIPELINE_BLOCK_COUNT 4
+#define PIPELINE_MAX_CARRY (64*1024)
+#define PIPELINE_BATCH_PAIRS 4096
+
+struct pipeline_block
+{
+    buffer Memory;
+    u8 *Data;
+    u64 Count;
+};
+
+struct pipeline_reader
+{
+    FILE *File;
+    pipeline_block Blocks[PIPELINE_BLOCK_COUNT];
+
+    os_semaphore FreeBlocks;
+    os_semaphore FilledBlocks;
+
+    volatile b32 Stop;
+    b32 ReadError;
+    u64 WaitTime;
+};
+
+struct pipeline_result
+{
+    u64 ByteCount;
+    u64 PairCount;
+    f64 Sum;
+    b32 Valid;
+
+    // NOTE(ojf): Time the parser spent waiting on the reader and the other
+    // way around, so whichever side is slower shows up as the other's wait
+    f64 ParseWaitSeconds;
+    f64 ReadWaitSeconds;
+};
+
+struct haversine_pipeline
+{
+    haversine_kernel Kernel;
+    f64 EarthRadius;
+    pair_storage Batch;
+    u64 BatchCount;
+    f64 *Distances;
+
+    compensated_sum Sum;
+    u64 PairCount;
+
+    b32 FoundPairs;
+    b32 Finished;
+    b32 HadError;
+};
+
+static void ReadPipelineBlocks(void *Param)
+{
+    pipeline_reader *Reader = (pipeline_reader *)Param;
+
+    for(u64 BlockIndex = 0;; ++BlockIndex)
+    {
+        u64 WaitStart = ReadOSTimer();
+        WaitOSSemaphore(&Reader->FreeBlocks);
+        Reader->WaitTime += ReadOSTimer() - WaitStart;
+
+        // NOTE(ojf): An empty block marks the end, for errors as well
+        pipeline_block *Block = Reader->Blocks + (BlockIndex % PIPELINE_BLOCK_COUNT);
+        Block->Count = 0;
+        if(!Reader->Stop)
+        {
+            Block->Count = fread(Block->Data, 1, PIPELINE_BLOCK_SIZE, Reader->File);
+            if(!Block->Count && ferror(Reader->File))
+            {
+                Reader->ReadError = true;
+            }
+        }
+
+        b32 Done = (Block->Count == 0);
+        PostOSSemaphore(&Reader->FilledBlocks);
+
+        if(Done)
+        {
+            break;
+        }
+    }
+}
+
+static void FlushPipelineBatch(haversine_pipeline *Pipeline)
+{
+    if(Pipeline->BatchCount)
+    {
+        HaversineWithStorage(Pipeline->Kernel, Pipeline->BatchCount, &Pipeline->Batch, Pipeline->EarthRadius,
+                             Pipeline->Distances);
+        for(u64 PairIndex = 0; PairIndex < Pipeline->BatchCount; ++PairIndex)
+        {
+            AddCompensated(&Pipeline->Sum, Pipeline->Distances[PairIndex]);
+        }
+
+        Pipeline->PairCount += Pipeline->BatchCount;
+        Pipeline->BatchCount = 0;
+    }
+}
+
+// NOTE(ojf): Region ends just after a }, or is the last of the input
+static void ParsePipelineRegion(haversine_pipeline *Pipeline, buffer Region)
+{
+    json_parser Parser = {};
+    Parser.Source = Region;
+
+    json_token Token = GetJSONToken(&Parser);
+    while(!Parser.HadError && !Pipeline->Finished && (Token.Type != Token_end_of_stream))
+    {
+        if(Token.Type == Token_open_brace)
+        {
+            haversine_pair Pair;
+            if(StreamParsePairObject(&Parser, &Pair))
+            {
+                StorePair(&Pipeline->Batch, Pipeline->BatchCount++, Pair);
+                if(Pipeline->BatchCount == PIPELINE_BATCH_PAIRS)
+                {
+                    FlushPipelineBatch(Pipeline);
+                }
+            }
+        }
+        else if(Token.Type == Token_close_bracket)
+        {
+            Pipeline->Finished = true;
+        }
+        else if(Token.Type != Token_comma)
+        {
+            Error(&Parser, Token, "Expected pair object in pairs");
+        }
+
+        if(!Pipeline->Finished)
+        {
+            Token = GetJSONToken(&Parser);
+        }
+    }
+
+    Pipeline->HadError = Pipeline->HadError || Parser.HadError;
+}
+
+// NOTE(ojf): Parses as much of Window as is complete, and returns how many
+// bytes at the end have to be carried into the next one
+static u64 ParsePipelineWindow(haversine_pipeline *Pipeline, buffer Window, b32 IsLast)
+{
+    u64 Start = 0;
+    if(!Pipeline->FoundPairs)
+    {
+        Pipeline->FoundPairs = FindPairsArrayStart(Window, &Start);
+        if(!Pipeline->FoundPairs)
+        {
+            fprintf(stderr, "ERROR: The pairs array has to start in the first %u bytes for -parser pipeline\n",
+                    PIPELINE_BLOCK_SIZE);
+            Pipeline->HadError = true;
+        }
+    }
+
+    u64 End = Window.Count;
+    if(!IsLast)
+    {
+        while((End > Start) && (Window.Data[End - 1] != '}'))
+        {
+            --End;
+        }
+    }
+
+    if(Pipeline->FoundPairs && (End > Start))
+    {
+        buffer Region = {End - Start, Window.Data + Start};
+        ParsePipelineRegion(Pipeline, Region);
+    }
+
+    u64 Result = Window.Count - End;
+    if(Result > PIPELINE_MAX_CARRY)
+    {
+        fprintf(stderr, "ERROR: Pair object longer than %u bytes\n", PIPELINE_MAX_CARRY);
+        Pipeline->HadError = true;
+    }
+
+    return Result;
+}
+
+static pipeline_result PipelineSumHaversineFile(char *FileName, haversine_kernel Kernel, haversine_pair_layout Layout,
+                                                f64 EarthRadius)
+{
+    pipeline_result Result = {};
+
+    pipeline_reader Reader = {};
+    haversine_pipeline Pipeline = {};
+    Pipeline.Kernel = Kernel;
+    Pipeline.EarthRadius = EarthRadius;
+    Pipeline.Batch = AllocatePairStorage(Layout, PIPELINE_BATCH_PAIRS);
+    buffer Distances = AllocateBuffer(PIPELINE_BATCH_PAIRS*sizeof(f64));
+    buffer Carry = AllocateBuffer(PIPELINE_MAX_CARRY);
+    Pipeline.Distances = (f64 *)Distances.Data;
+
+    b32 Allocated = (Pipeline.Batch.Memory.Data && Distances.Data && Carry.Data);
+    for(u32 BlockIndex = 0; BlockIndex < PIPELINE_BLOCK_COUNT; ++BlockIndex)
+    {
+        pipeline_block *Block = Reader.Blocks + BlockIndex;
+        Block->Memory = AllocateBuffer(PIPELINE_MAX_CARRY + PIPELINE_BLOCK_SIZE);
+        Block->Data = Block->Memory.Data + PIPELINE_MAX_CARRY;
+        Allocated = Allocated && Block->Memory.Data;
+    }
+
+    Reader.File = fopen(FileName, "rb");
+    if(!Reader.File)
+    {
+        fprintf(stderr, "ERROR: Unable to open \"%s\".\n", FileName);
+    }
+    else if(Allocated &&
+            InitOSSemaphore(&Reader.FreeBlocks, PIPELINE_BLOCK_COUNT, PIPELINE_BLOCK_COUNT) &&
+            InitOSSemaphore(&Reader.FilledBlocks, 0, PIPELINE_BLOCK_COUNT))
+    {
+        os_thread ReaderThread;
+        b32 Threaded = StartOSThread(&ReaderThread, ReadPipelineBlocks, &Reader);
+        if(!Threaded)
+        {
+            fprintf(stderr, "ERROR: Unable to start the reader thread\n");
+        }
+
+        u64 CarryCount = 0;
+        u64 ParseWaitTime = 0;
+        for(u64 BlockIndex = 0; Threaded; ++BlockIndex)
+        {
+            u64 WaitStart = ReadOSTimer();
+            WaitOSSemaphore(&Reader.FilledBlocks);
+            ParseWaitTime += ReadOSTimer() - WaitStart;
+
+            pipeline_block *Block = Reader.Blocks + (BlockIndex % PIPELINE_BLOCK_COUNT);
+            b32 IsLast = (Block->Count == 0);
+            Result.ByteCount += Block->Count;
+
+            if(!Pipeline.HadError && !Pipeline.Finished)
+            {
+                buffer Window = {CarryCount + Block->Count, Block->Data - CarryCount};
+                memcpy(Window.Data, Carry.Data, CarryCount);
+
+                CarryCount = ParsePipelineWindow(&Pipeline, Window, IsLast);
+                if(!Pipeline.HadError)
+                {
+                    memcpy(Carry.Data, Window.Data + Window.Count - CarryCount, CarryCount);
+                }
+            }
+
+            if(Pipeline.HadError || Pipeline.Finished)
+            {
+                Reader.Stop = true;
+            }
+
+            PostOSSemaphore(&Reader.FreeBlocks);
+
+            if(IsLast)
+            {
+                break;
+            }
+        }
+
+        if(Threaded)
+        {
+            JoinOSThread(&ReaderThread);
+        }
+
+        FlushPipelineBatch(&Pipeline);
+
+        if(Reader.ReadError)
+        {
+            fprintf(stderr, "ERROR: Unable to read \"%s\".\n", FileName);
+        }
+        else if(Threaded && !Pipeline.HadError && !Pipeline.Finished)
+        {
+            fprintf(stderr, "ERROR: Unexpected end of input in pairs\n");
+        }
+
+        Result.PairCount = Pipeline.PairCount;
+        Result.Sum = Pipeline.PairCount ? ((Pipeline.Sum.Sum + Pipeline.Sum.Compensation) / (f64)Pipeline.PairCount) : 0;
+        Result.Valid = (Threaded && !Reader.ReadError && !Pipeline.HadError && Pipeline.Finished);
+        Result.ParseWaitSeconds = SecondsFromOSTimer(ParseWaitTime);
+        Result.ReadWaitSeconds = SecondsFromOSTimer(Reader.WaitTime);
+
+        FreeOSSemaphore(&Reader.FreeBlocks);
+        FreeOSSemaphore(&Reader.FilledBlocks);
+    }
+
+    if(Reader.File)
+    {
+        fclose(Reader.File);
+    }
+
+    for(u32 BlockIndex = 0; BlockIndex < PIPELINE_BLOCK_COUNT; ++BlockIndex)
+    {
+        FreeBuffer(&Reader.Blocks[BlockIndex].Memory);
+    }
+    FreeBuffer(&Carry);
+    FreeBuffer(&Distances);
+    FreePairStorage(&Pipeline.Batch);
+
+    return Result;
+}
@@ -0,0 +1,366 @@
+/* ========================================================================
+   Platform memory: mapped input files and large page allocations
+   ======================================================================== */
+
+/* NOTE(ojf): Ways to get the input into memory, and pages to put the pairs
+   in, so their page fault cost can be measured against each other:
+
+     read      malloc + fread, every page faults once while fread fills it
+     mmap      map the file, hinted sequential and will-need, pages fault in
+               as the parser reaches them
+     populate  map the file with every page faulted in up front
+     prefault  map the file and have a helper thread touch pages ahead of
+               the parser, so the faults overlap with parsing
+
+     normal    ordinary 4k pages
+     thp       transparent huge pages, aligned to 2mb and madvise'd
+     huge      explicit huge pages (hugetlbfs, or large pages on Windows),
+               which need pages reserved up front by the admin
+
+   A page kind that isn't available falls back to the next one down, and
+   the kind actually used is reported.  On Windows there is no transparent
+   huge page equivalent and no populate flag, so those fall back to normal
+   pages and a touch loop.
+
+   DropFileFromPageCache is for cold runs of the repetition tester, so a
+   read has to go to the disk again.
+*/
+
+#define OS_HUGE_PAGE_SIZE (2*1024*1024)
+#define OS_PAGE_SIZE 4096
+
+enum input_strategy
+{
+    InputStrategy_read,
+    InputStrategy_mmap,
+    InputStrategy_populate,
+    InputStrategy_prefault,
+
+    InputStrategy_count,
+};
+
+static char const *InputStrategyNames[] = {"read", "mmap", "populate", "prefault"};
+
+enum page_kind
+{
+    PageKind_normal,
+    PageKind_thp,
+    PageKind_huge,
+
+    PageKind_count,
+};
+
+static char const *PageKindNames[] = {"normal", "thp", "huge"};
+
+struct mapped_file
+{
+    buffer Data;
+
+#if _WIN32
+    HANDLE File;
+    HANDLE Mapping;
+#endif
+
+    os_thread PrefaultThread;
+    b32 Prefaulting;
+    volatile b32 StopPrefault;
+};
+
+static u64 RoundUpToPage(u64 Size, u64 PageSize)
+{
+    u64 Result = (Size + PageSize - 1) & ~(PageSize - 1);
+    return Result;
+}
+
+// NOTE(ojf): Reads one byte per page so the OS has to fault every page in
+static void TouchPages(buffer Memory, volatile b32 *Stop)
+{
+    volatile u8 Sink = 0;
+    for(u64 At = 0; (At < Memory.Count) && !(Stop && *Stop); At += OS_PAGE_SIZE)
+    {
+        Sink += Memory.Data[At];
+    }
+}
+
+static void PrefaultMappedFile(void *Param)
+{
+    mapped_file *Mapped = (mapped_file *)Param;
+    TouchPages(Mapped->Data, &Mapped->StopPrefault);
+}
+
+#if _WIN32
+
+static buffer AllocateOSMemory(u64 Size, page_kind Kind, page_kind *UsedKind)
+{
+    buffer Result = {};
+    *UsedKind = PageKind_normal;
+
+    if(Kind == PageKind_huge)
+    {
+        // NOTE(ojf): Only works with SeLockMemoryPrivilege, which almost
+        // nobody has, so this usually falls through
+        SIZE_T LargePage = GetLargePageMinimum();
+        if(LargePage)
+        {
+            u64 Rounded = RoundUpToPage(Size, LargePage);
+            Result.Data = (u8 *)VirtualAlloc(0, Rounded, MEM_RESERVE|MEM_COMMIT|MEM_LARGE_PAGES, PAGE_READWRITE);
+            if(Result.Data)
+            {
+                Result.Count = Rounded;
+                *UsedKind = PageKind_huge;
+            }
+        }
+    }
+
+    if(!Result.Data)
+    {
+        Result.Data = (u8 *)VirtualAlloc(0, Size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+        if(Result.Data)
+        {
+            Result.Count = Size;
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: Unable to allocate %llu bytes.\n", Size);
+        }
+    }
+
+    return Result;
+}
+
+static void FreeOSMemory(buffer *Memory)
+{
+    if(Memory->Data)
+    {
+        VirtualFree(Memory->Data, 0, MEM_RELEASE);
+    }
+    *Memory = {};
+}
+
+static b32 MapInputFile(char *FileName, input_strategy Strategy, mapped_file *Mapped)
+{
+    *Mapped = {};
+
+    Mapped->File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if(Mapped->File != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER Size;
+        if(GetFileSizeEx(Mapped->File, &Size) && Size.QuadPart)
+        {
+            Mapped->Mapping = CreateFileMappingA(Mapped->File, 0, PAGE_READONLY, 0, 0, 0);
+            if(Mapped->Mapping)
+            {
+                Mapped->Data.Data = (u8 *)MapViewOfFile(Mapped->Mapping, FILE_MAP_READ, 0, 0, 0);
+                if(Mapped->Data.Data)
+                {
+                    Mapped->Data.Count = Size.QuadPart;
+                }
+            }
+        }
+    }
+
+    if(Mapped->Data.Data)
+    {
+        if(Strategy == InputStrategy_populate)
+        {
+            TouchPages(Mapped->Data, 0);
+        }
+        else if(Strategy == InputStrategy_prefault)
+        {
+            Mapped->Prefaulting = StartOSThread(&Mapped->PrefaultThread, PrefaultMappedFile, Mapped);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Unable to map \"%s\".\n", FileName);
+    }
+
+    b32 Result = (Mapped->Data.Data != 0);
+    return Result;
+}
+
+static void UnmapInputFile(mapped_file *Mapped)
+{
+    if(Mapped->Prefaulting)
+    {
+        Mapped->StopPrefault = true;
+        JoinOSThread(&Mapped->PrefaultThread);
+    }
+
+    if(Mapped->Data.Data) UnmapViewOfFile(Mapped->Data.Data);
+    if(Mapped->Mapping) CloseHandle(Mapped->Mapping);
+    if(Mapped->File && (Mapped->File != INVALID_HANDLE_VALUE)) CloseHandle(Mapped->File);
+
+    *Mapped = {};
+}
+
+// NOTE(ojf): Windows has no call to evict one file from the standby list,
+// so cold file runs aren't possible there
+static b32 DropFileFromPageCache(char *FileName)
+{
+    b32 Result = false;
+    return Result;
+}
+
+#else
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static buffer AllocateOSMemory(u64 Size, page_kind Kind, page_kind *UsedKind)
+{
+    buffer Result = {};
+    *UsedKind = PageKind_normal;
+
+#ifdef MAP_HUGETLB
+    if(Kind == PageKind_huge)
+    {
+        u64 Rounded = RoundUpToPage(Size, OS_HUGE_PAGE_SIZE);
+        void *Memory = mmap(0, Rounded, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if(Memory != MAP_FAILED)
+        {
+            Result.Data = (u8 *)Memory;
+            Result.Count = Rounded;
+            *UsedKind = PageKind_huge;
+        }
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    if(!Result.Data && (Kind >= PageKind_thp))
+    {
+        // NOTE(ojf): THP only backs 2mb aligned ranges, so the size is
+        // rounded up and the kernel is left to pick an aligned address,
+        // which it does for mappings this big
+        u64 Rounded = RoundUpToPage(Size, OS_HUGE_PAGE_SIZE);
+        void *Memory = mmap(0, Rounded, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if(Memory != MAP_FAILED)
+        {
+            Result.Data = (u8 *)Memory;
+            Result.Count = Rounded;
+            if(madvise(Memory, Rounded, MADV_HUGEPAGE) == 0)
+            {
+                *UsedKind = PageKind_thp;
+            }
+        }
+    }
+#endif
+
+    if(!Result.Data)
+    {
+        u64 Rounded = RoundUpToPage(Size ? Size : 1, OS_PAGE_SIZE);
+        void *Memory = mmap(0, Rounded, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if(Memory != MAP_FAILED)
+        {
+            Result.Data = (u8 *)Memory;
+            Result.Count = Rounded;
+        }
+        else
+        {
+            fprintf(stderr, "ERROR: Unable to allocate %llu bytes.\n", Size);
+        }
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Memory has to be exactly what AllocateOSMemory returned
+static void FreeOSMemory(buffer *Memory)
+{
+    if(Memory->Data)
+    {
+        munmap(Memory->Data, Memory->Count);
+    }
+    *Memory = {};
+}
+
+static b32 MapInputFile(char *FileName, input_strategy Strategy, mapped_file *Mapped)
+{
+    *Mapped = {};
+
+    int File = open(FileName, O_RDONLY);
+    if(File >= 0)
+    {
+        struct stat Stat;
+        if((fstat(File, &Stat) == 0) && (Stat.st_size > 0))
+        {
+            int Flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+            if(Strategy == InputStrategy_populate)
+            {
+                Flags |= MAP_POPULATE;
+            }
+#endif
+
+            void *Memory = mmap(0, Stat.st_size, PROT_READ, Flags, File, 0);
+            if(Memory != MAP_FAILED)
+            {
+                Mapped->Data.Data = (u8 *)Memory;
+                Mapped->Data.Count = Stat.st_size;
+                madvise(Memory, Stat.st_size, MADV_SEQUENTIAL);
+                madvise(Memory, Stat.st_size, MADV_WILLNEED);
+            }
+        }
+
+        // NOTE(ojf): The mapping keeps the file alive on its own
+        close(File);
+    }
+
+    if(Mapped->Data.Data)
+    {
+#ifndef MAP_POPULATE
+        if(Strategy == InputStrategy_populate)
+        {
+            TouchPages(Mapped->Data, 0);
+        }
+#endif
+        if(Strategy == InputStrategy_prefault)
+        {
+            Mapped->Prefaulting = StartOSThread(&Mapped->PrefaultThread, PrefaultMappedFile, Mapped);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Unable to map \"%s\".\n", FileName);
+    }
+
+    b32 Result = (Mapped->Data.Data != 0);
+    return Result;
+}
+
+static void UnmapInputFile(mapped_file *Mapped)
+{
+    if(Mapped->Prefaulting)
+    {
+        Mapped->StopPrefault = true;
+        JoinOSThread(&Mapped->PrefaultThread);
+    }
+
+    if(Mapped->Data.Data)
+    {
+        munmap(Mapped->Data.Data, Mapped->Data.Count);
+    }
+
+    *Mapped = {};
+}
+
+// NOTE(ojf): Only evicts clean pages nobody has mapped, which is all of
+// them for an input file between runs
+static b32 DropFileFromPageCache(char *FileName)
+{
+    b32 Result = false;
+
+    int File = open(FileName, O_RDONLY);
+    if(File >= 0)
+    {
+        Result = (posix_fadvise(File, 0, 0, POSIX_FADV_DONTNEED) == 0);
+        close(File);
+    }
+
+    return Result;
+}
+
+#endif
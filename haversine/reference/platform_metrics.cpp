@@ -0,0 +1,124 @@
+/* ========================================================================
+   Platform timers and process metrics
+   ======================================================================== */
+
+#if _WIN32
+
+#include <intrin.h>
+#include <windows.h>
+#include <psapi.h>
+
+#pragma comment (lib, "psapi.lib")
+
+static u64 GetOSTimerFreq(void)
+{
+    LARGE_INTEGER Freq;
+    QueryPerformanceFrequency(&Freq);
+    return Freq.QuadPart;
+}
+
+static u64 ReadOSTimer(void)
+{
+    LARGE_INTEGER Value;
+    QueryPerformanceCounter(&Value);
+    return Value.QuadPart;
+}
+
+static u64 ReadOSPageFaultCount(void)
+{
+    PROCESS_MEMORY_COUNTERS_EX MemoryCounters = {};
+    MemoryCounters.cb = sizeof(MemoryCounters);
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&MemoryCounters, sizeof(MemoryCounters));
+
+    u64 Result = MemoryCounters.PageFaultCount;
+    return Result;
+}
+
+static u64 ReadPeakMemoryUsage(void)
+{
+    PROCESS_MEMORY_COUNTERS_EX MemoryCounters = {};
+    MemoryCounters.cb = sizeof(MemoryCounters);
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&MemoryCounters, sizeof(MemoryCounters));
+
+    u64 Result = MemoryCounters.PeakWorkingSetSize;
+    return Result;
+}
+
+#else
+
+#include <x86intrin.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static u64 GetOSTimerFreq(void)
+{
+    return 1000000000ull;
+}
+
+static u64 ReadOSTimer(void)
+{
+    struct timespec Value;
+    clock_gettime(CLOCK_MONOTONIC, &Value);
+
+    u64 Result = GetOSTimerFreq()*(u64)Value.tv_sec + (u64)Value.tv_nsec;
+    return Result;
+}
+
+static u64 ReadOSPageFaultCount(void)
+{
+    struct rusage Usage = {};
+    getrusage(RUSAGE_SELF, &Usage);
+
+    u64 Result = Usage.ru_minflt + Usage.ru_majflt;
+    return Result;
+}
+
+static u64 ReadPeakMemoryUsage(void)
+{
+    struct rusage Usage = {};
+    getrusage(RUSAGE_SELF, &Usage);
+
+    // NOTE(ojf): ru_maxrss is in kilobytes on Linux
+    u64 Result = 1024ull*(u64)Usage.ru_maxrss;
+    return Result;
+}
+
+#endif
+
+inline u64 ReadCPUTimer(void)
+{
+    return __rdtsc();
+}
+
+static u64 EstimateCPUTimerFreq(u64 MillisecondsToWait)
+{
+    u64 OSFreq = GetOSTimerFreq();
+
+    u64 CPUStart = ReadCPUTimer();
+    u64 OSStart = ReadOSTimer();
+    u64 OSEnd = 0;
+    u64 OSElapsed = 0;
+    u64 OSWaitTime = OSFreq * MillisecondsToWait / 1000;
+    while(OSElapsed < OSWaitTime)
+    {
+        OSEnd = ReadOSTimer();
+        OSElapsed = OSEnd - OSStart;
+    }
+
+    u64 CPUEnd = ReadCPUTimer();
+    u64 CPUElapsed = CPUEnd - CPUStart;
+
+    u64 CPUFreq = 0;
+    if(OSElapsed)
+    {
+        CPUFreq = OSFreq * CPUElapsed / OSElapsed;
+    }
+
+    return CPUFreq;
+}
+
+static f64 SecondsFromOSTimer(u64 Elapsed)
+{
+    f64 Result = (f64)Elapsed / (f64)GetOSTimerFreq();
+    return Result;
+}
@@ -0,0 +1,169 @@
+/* ========================================================================
+   Platform threads
+   ======================================================================== */
+
+/* NOTE(ojf): Just enough to fan work out and wait for it.  Workers that
+   have to hand work to each other while they run do it through a counting
+   semaphore.
+*/
+
+#if _WIN32
+
+typedef void thread_proc(void *Param);
+
+struct os_thread
+{
+    HANDLE Handle;
+    thread_proc *Proc;
+    void *Param;
+};
+
+static DWORD WINAPI OSThreadEntry(LPVOID Param)
+{
+    os_thread *Thread = (os_thread *)Param;
+    Thread->Proc(Thread->Param);
+    return 0;
+}
+
+// NOTE(ojf): Thread has to stay put until JoinOSThread returns
+static b32 StartOSThread(os_thread *Thread, thread_proc *Proc, void *Param)
+{
+    Thread->Proc = Proc;
+    Thread->Param = Param;
+    Thread->Handle = CreateThread(0, 0, OSThreadEntry, Thread, 0, 0);
+
+    b32 Result = (Thread->Handle != 0);
+    return Result;
+}
+
+static void JoinOSThread(os_thread *Thread)
+{
+    WaitForSingleObject(Thread->Handle, INFINITE);
+    CloseHandle(Thread->Handle);
+    Thread->Handle = 0;
+}
+
+static u32 GetProcessorCount(void)
+{
+    SYSTEM_INFO Info;
+    GetSystemInfo(&Info);
+    return Info.dwNumberOfProcessors;
+}
+
+struct os_semaphore
+{
+    HANDLE Handle;
+};
+
+static b32 InitOSSemaphore(os_semaphore *Semaphore, u32 InitialCount, u32 MaxCount)
+{
+    Semaphore->Handle = CreateSemaphoreA(0, InitialCount, MaxCount, 0);
+
+    b32 Result = (Semaphore->Handle != 0);
+    return Result;
+}
+
+static void WaitOSSemaphore(os_semaphore *Semaphore)
+{
+    WaitForSingleObject(Semaphore->Handle, INFINITE);
+}
+
+static void PostOSSemaphore(os_semaphore *Semaphore)
+{
+    ReleaseSemaphore(Semaphore->Handle, 1, 0);
+}
+
+static void FreeOSSemaphore(os_semaphore *Semaphore)
+{
+    CloseHandle(Semaphore->Handle);
+    Semaphore->Handle = 0;
+}
+
+#else
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef void thread_proc(void *Param);
+
+struct os_thread
+{
+    pthread_t Handle;
+    thread_proc *Proc;
+    void *Param;
+};
+
+static void *OSThreadEntry(void *Param)
+{
+    os_thread *Thread = (os_thread *)Param;
+    Thread->Proc(Thread->Param);
+    return 0;
+}
+
+// NOTE(ojf): Thread has to stay put until JoinOSThread returns
+static b32 StartOSThread(os_thread *Thread, thread_proc *Proc, void *Param)
+{
+    Thread->Proc = Proc;
+    Thread->Param = Param;
+
+    b32 Result = (pthread_create(&Thread->Handle, 0, OSThreadEntry, Thread) == 0);
+    return Result;
+}
+
+static void JoinOSThread(os_thread *Thread)
+{
+    pthread_join(Thread->Handle, 0);
+}
+
+static u32 GetProcessorCount(void)
+{
+    long Count = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 Result = (Count > 0) ? (u32)Count : 1;
+    return Result;
+}
+
+// NOTE(ojf): Built from a mutex and a condition variable, since unnamed
+// POSIX semaphores don't exist on macOS
+struct os_semaphore
+{
+    pthread_mutex_t Mutex;
+    pthread_cond_t Condition;
+    u32 Count;
+};
+
+static b32 InitOSSemaphore(os_semaphore *Semaphore, u32 InitialCount, u32 MaxCount)
+{
+    Semaphore->Count = InitialCount;
+
+    b32 Result = ((MaxCount >= InitialCount) &&
+                  (pthread_mutex_init(&Semaphore->Mutex, 0) == 0) &&
+                  (pthread_cond_init(&Semaphore->Condition, 0) == 0));
+    return Result;
+}
+
+static void WaitOSSemaphore(os_semaphore *Semaphore)
+{
+    pthread_mutex_lock(&Semaphore->Mutex);
+    while(Semaphore->Count == 0)
+    {
+        pthread_cond_wait(&Semaphore->Condition, &Semaphore->Mutex);
+    }
+    --Semaphore->Count;
+    pthread_mutex_unlock(&Semaphore->Mutex);
+}
+
+static void PostOSSemaphore(os_semaphore *Semaphore)
+{
+    pthread_mutex_lock(&Semaphore->Mutex);
+    ++Semaphore->Count;
+    pthread_cond_signal(&Semaphore->Condition);
+    pthread_mutex_unlock(&Semaphore->Mutex);
+}
+
+static void FreeOSSemaphore(os_semaphore *Semaphore)
+{
+    pthread_cond_destroy(&Semaphore->Condition);
+    pthread_mutex_destroy(&Semaphore->Mutex);
+}
+
+#endif
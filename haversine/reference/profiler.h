@@ -0,0 +1,522 @@
+/* ========================================================================
+   rdtsc block profiler
+   ======================================================================== */
+
+/* NOTE(ojf): Header only, so every haversine tool can just include it.  It
+   expects the u32/u64/f64 typedefs they all have.  sim86 includes this same
+   file, decoder/build.bat puts this directory on its include path.
+
+   Put BeginProfile() at the start of main and EndAndPrintProfile() at the
+   end, and a TimeBlock("Name") (or TimeFunction) at the top of any scope
+   to time.  TimeBandwidth("Name", ByteCount) does the same and also
+   reports the bytes per second the block got through.
+
+   Every block has an anchor, picked at compile time with __COUNTER__, that
+   adds up its hits and time.  Exclusive time is the block's own, with any
+   block opened inside it taken out, inclusive time includes them.  A block
+   that ends up inside itself (recursion, or the same function called from
+   inside the block) puts back the inclusive time it had on entry before
+   adding its own, so the outer run isn't counted twice.
+
+   The TSC frequency comes from the profile window itself: BeginProfile and
+   EndAndPrintProfile read the OS timer (QueryPerformanceCounter or
+   CLOCK_MONOTONIC) next to the TSC, so there is no calibration wait before
+   or after the run.  The anchors aren't
+   per thread, so blocks only count on the thread that called BeginProfile
+   and are skipped anywhere else.  Build with -DPROFILER=0 to compile every
+   block out and only keep the total.
+
+   TimeDetailBlock and TimeDetailFunction are for blocks hit millions of
+   times (per token, per number), whose own rdtsc pair would skew the rest
+   of the profile.  They only exist with -DPROFILER_DETAIL=1.
+
+   With -DPROFILER_COUNTERS=1 on Linux, each block also reads cycles,
+   instructions, cache misses, branch misses, page faults and context
+   switches from perf_event_open at entry and exit, and the report adds
+   IPC and misses per kb / faults per mb for blocks that count bytes.  The
+   hardware counters are user mode only.  Counters that can't be opened
+   (VMs without a PMU, containers, perf_event_paranoid) read as zero and
+   are left out of the report, and with none at all the profile is the same
+   as without counters.  Each read is a syscall, a couple per block entry
+   and exit, so blocks with counters take longer, and the time a parent
+   shows includes its children's reads.  The counters themselves only see
+   user mode, so they aren't skewed by the syscalls.
+*/
+
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+#ifndef PROFILER_DETAIL
+#define PROFILER_DETAIL 0
+#endif
+
+#ifndef PROFILER_COUNTERS
+#define PROFILER_COUNTERS 0
+#endif
+
+#if PROFILER_COUNTERS && (_WIN32 || !PROFILER)
+#undef PROFILER_COUNTERS
+#define PROFILER_COUNTERS 0
+#endif
+
+#define PROFILER_MAX_ANCHORS 4096
+
+#include <stdio.h>
+
+#if _WIN32
+
+#include <intrin.h>
+#include <windows.h>
+
+static u64 ProfilerOSTimerFreq(void)
+{
+    LARGE_INTEGER Freq;
+    QueryPerformanceFrequency(&Freq);
+    return Freq.QuadPart;
+}
+
+static u64 ProfilerReadOSTimer(void)
+{
+    LARGE_INTEGER Value;
+    QueryPerformanceCounter(&Value);
+    return Value.QuadPart;
+}
+
+#else
+
+#include <x86intrin.h>
+#include <time.h>
+
+#if PROFILER_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
+static u64 ProfilerOSTimerFreq(void)
+{
+    return 1000000000ull;
+}
+
+static u64 ProfilerReadOSTimer(void)
+{
+    struct timespec Value;
+    clock_gettime(CLOCK_MONOTONIC, &Value);
+
+    u64 Result = ProfilerOSTimerFreq()*(u64)Value.tv_sec + (u64)Value.tv_nsec;
+    return Result;
+}
+
+#endif
+
+inline u64 ProfilerReadTSC(void)
+{
+    return __rdtsc();
+}
+
+#if PROFILER_COUNTERS
+
+enum profile_counter
+{
+    ProfileCounter_cycles,
+    ProfileCounter_instructions,
+    ProfileCounter_cache_misses,
+    ProfileCounter_branch_misses,
+    ProfileCounter_page_faults,
+    ProfileCounter_context_switches,
+
+    ProfileCounter_count,
+};
+
+static char const *ProfileCounterNames[] =
+{
+    "cycles", "instructions", "cache-misses", "branch-misses", "page-faults", "context-switches",
+};
+
+// NOTE(ojf): Hardware and software counters are opened as two groups, so
+// each side is one read() and a missing PMU doesn't take the software
+// counters down with it
+struct profile_counter_group
+{
+    int FD;
+    u32 Count;
+    u32 Counters[ProfileCounter_count];
+};
+
+struct profile_counters
+{
+    u32 Available[ProfileCounter_count];
+    profile_counter_group Groups[2];
+};
+
+static profile_counters GlobalProfilerCounters;
+
+static void OpenProfileCounters(void)
+{
+    struct
+    {
+        u32 Type;
+        u64 Config;
+    } Events[ProfileCounter_count] =
+    {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    };
+
+    profile_counters *Counters = &GlobalProfilerCounters;
+    Counters->Groups[0].FD = -1;
+    Counters->Groups[1].FD = -1;
+
+    for(u32 Counter = 0; Counter < ProfileCounter_count; ++Counter)
+    {
+        profile_counter_group *Group = Counters->Groups + ((Events[Counter].Type == PERF_TYPE_HARDWARE) ? 0 : 1);
+
+        struct perf_event_attr Attr;
+        memset(&Attr, 0, sizeof(Attr));
+        Attr.size = sizeof(Attr);
+        Attr.type = Events[Counter].Type;
+        Attr.config = Events[Counter].Config;
+        Attr.read_format = PERF_FORMAT_GROUP;
+
+        // NOTE(ojf): Context switches happen in the kernel, so only the
+        // hardware counters can be limited to user mode
+        Attr.exclude_kernel = (Events[Counter].Type == PERF_TYPE_HARDWARE);
+        Attr.exclude_hv = 1;
+
+        int FD = (int)syscall(__NR_perf_event_open, &Attr, 0, -1, Group->FD, 0);
+        if(FD >= 0)
+        {
+            if(Group->FD < 0)
+            {
+                Group->FD = FD;
+            }
+            Group->Counters[Group->Count++] = Counter;
+            Counters->Available[Counter] = 1;
+        }
+    }
+}
+
+inline void ReadProfileCounters(u64 *Values)
+{
+    for(u32 GroupIndex = 0; GroupIndex < 2; ++GroupIndex)
+    {
+        profile_counter_group *Group = GlobalProfilerCounters.Groups + GroupIndex;
+        if(Group->FD >= 0)
+        {
+            // NOTE(ojf): PERF_FORMAT_GROUP gives the count, then the values
+            // in the order the counters were added
+            u64 Buffer[1 + ProfileCounter_count];
+            if(read(Group->FD, Buffer, sizeof(Buffer)) > 0)
+            {
+                for(u32 Index = 0; (Index < Buffer[0]) && (Index < Group->Count); ++Index)
+                {
+                    Values[Group->Counters[Index]] = Buffer[1 + Index];
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+struct profile_anchor
+{
+    u64 TSCElapsedExclusive;
+    u64 TSCElapsedInclusive;
+    u64 HitCount;
+    u64 ProcessedByteCount;
+    char const *Label;
+
+#if PROFILER_COUNTERS
+    // NOTE(ojf): Inclusive, like the bandwidth
+    u64 Counters[ProfileCounter_count];
+#endif
+};
+
+struct profiler
+{
+    u64 StartTSC;
+    u64 EndTSC;
+    u64 StartOSTimer;
+    u64 EndOSTimer;
+};
+
+static profiler GlobalProfiler;
+
+#if PROFILER
+
+static profile_anchor GlobalProfilerAnchors[PROFILER_MAX_ANCHORS];
+static u32 GlobalProfilerParent;
+static thread_local u32 GlobalProfilerThread;
+
+struct profile_block
+{
+    profile_block(char const *Label_, u32 AnchorIndex_, u64 ByteCount)
+    {
+        Active = GlobalProfilerThread;
+        if(!Active)
+        {
+            return;
+        }
+
+        ParentIndex = GlobalProfilerParent;
+
+        AnchorIndex = AnchorIndex_;
+        Label = Label_;
+
+        profile_anchor *Anchor = GlobalProfilerAnchors + AnchorIndex;
+        OldTSCElapsedInclusive = Anchor->TSCElapsedInclusive;
+        Anchor->ProcessedByteCount += ByteCount;
+
+        GlobalProfilerParent = AnchorIndex;
+
+#if PROFILER_COUNTERS
+        for(u32 Counter = 0; Counter < ProfileCounter_count; ++Counter)
+        {
+            OldCountersInclusive[Counter] = Anchor->Counters[Counter];
+            StartCounters[Counter] = 0;
+        }
+        ReadProfileCounters(StartCounters);
+#endif
+
+        StartTSC = ProfilerReadTSC();
+    }
+
+    ~profile_block(void)
+    {
+        if(!Active)
+        {
+            return;
+        }
+
+        u64 Elapsed = ProfilerReadTSC() - StartTSC;
+        GlobalProfilerParent = ParentIndex;
+
+        profile_anchor *Parent = GlobalProfilerAnchors + ParentIndex;
+        profile_anchor *Anchor = GlobalProfilerAnchors + AnchorIndex;
+
+        // NOTE(ojf): Anchor 0 is the root, its exclusive time is never
+        // printed, so subtracting from it when there's no parent is harmless
+        Parent->TSCElapsedExclusive -= Elapsed;
+        Anchor->TSCElapsedExclusive += Elapsed;
+        Anchor->TSCElapsedInclusive = OldTSCElapsedInclusive + Elapsed;
+        ++Anchor->HitCount;
+
+#if PROFILER_COUNTERS
+        u64 EndCounters[ProfileCounter_count] = {};
+        ReadProfileCounters(EndCounters);
+        for(u32 Counter = 0; Counter < ProfileCounter_count; ++Counter)
+        {
+            Anchor->Counters[Counter] = OldCountersInclusive[Counter] + (EndCounters[Counter] - StartCounters[Counter]);
+        }
+#endif
+
+        Anchor->Label = Label;
+    }
+
+#if PROFILER_COUNTERS
+    u64 OldCountersInclusive[ProfileCounter_count];
+    u64 StartCounters[ProfileCounter_count];
+#endif
+
+    u32 Active;
+    char const *Label;
+    u64 OldTSCElapsedInclusive;
+    u64 StartTSC;
+    u32 ParentIndex;
+    u32 AnchorIndex;
+};
+
+#define ProfilerNameConcat2(A, B) A##B
+#define ProfilerNameConcat(A, B) ProfilerNameConcat2(A, B)
+#define TimeBandwidth(Name, ByteCount) profile_block ProfilerNameConcat(Block, __LINE__)(Name, __COUNTER__ + 1, ByteCount)
+#define ProfilerEndOfCompilationUnit \
+    static_assert(__COUNTER__ < PROFILER_MAX_ANCHORS, "Number of profile points exceeds PROFILER_MAX_ANCHORS")
+
+static void PrintTimeElapsed(FILE *Out, u64 TotalTSCElapsed, u64 TSCFreq, profile_anchor *Anchor)
+{
+    f64 Percent = 100.0*((f64)Anchor->TSCElapsedExclusive / (f64)TotalTSCElapsed);
+    fprintf(Out, "  %s[%llu]: %llu (%.2f%%", Anchor->Label, (unsigned long long)Anchor->HitCount,
+            (unsigned long long)Anchor->TSCElapsedExclusive, Percent);
+    if(Anchor->TSCElapsedInclusive != Anchor->TSCElapsedExclusive)
+    {
+        f64 PercentWithChildren = 100.0*((f64)Anchor->TSCElapsedInclusive / (f64)TotalTSCElapsed);
+        fprintf(Out, ", %.2f%% w/children", PercentWithChildren);
+    }
+    fprintf(Out, ")");
+
+    if(Anchor->ProcessedByteCount && TSCFreq)
+    {
+        f64 Megabyte = 1024.0*1024.0;
+        f64 Gigabyte = Megabyte*1024.0;
+
+        f64 Seconds = (f64)Anchor->TSCElapsedInclusive / (f64)TSCFreq;
+        f64 BytesPerSecond = (f64)Anchor->ProcessedByteCount / Seconds;
+        fprintf(Out, "  %.3fmb at %.2fgb/s", (f64)Anchor->ProcessedByteCount / Megabyte, BytesPerSecond / Gigabyte);
+    }
+
+    fprintf(Out, "\n");
+}
+
+#if PROFILER_COUNTERS
+
+static void PrintAnchorCounters(FILE *Out, profile_anchor *Anchor)
+{
+    u32 *Available = GlobalProfilerCounters.Available;
+    u64 *Counters = Anchor->Counters;
+    f64 Kilobytes = (f64)Anchor->ProcessedByteCount / 1024.0;
+    f64 Megabytes = Kilobytes / 1024.0;
+
+    fprintf(Out, "   ");
+    if(Available[ProfileCounter_instructions])
+    {
+        fprintf(Out, " %.3gm instructions", (f64)Counters[ProfileCounter_instructions] / 1000000.0);
+        if(Available[ProfileCounter_cycles] && Counters[ProfileCounter_cycles])
+        {
+            fprintf(Out, " (%.2f ipc)", (f64)Counters[ProfileCounter_instructions] / (f64)Counters[ProfileCounter_cycles]);
+        }
+    }
+
+    for(u32 Counter = ProfileCounter_cache_misses; Counter <= ProfileCounter_branch_misses; ++Counter)
+    {
+        if(Available[Counter])
+        {
+            fprintf(Out, " %llu %s", (unsigned long long)Counters[Counter], ProfileCounterNames[Counter]);
+            if(Anchor->ProcessedByteCount)
+            {
+                fprintf(Out, " (%.2f/kb)", (f64)Counters[Counter] / Kilobytes);
+            }
+        }
+    }
+
+    if(Available[ProfileCounter_page_faults])
+    {
+        fprintf(Out, " %llu page-faults", (unsigned long long)Counters[ProfileCounter_page_faults]);
+        if(Anchor->ProcessedByteCount)
+        {
+            fprintf(Out, " (%.2f/mb)", (f64)Counters[ProfileCounter_page_faults] / Megabytes);
+        }
+    }
+
+    if(Available[ProfileCounter_context_switches])
+    {
+        fprintf(Out, " %llu context-switches", (unsigned long long)Counters[ProfileCounter_context_switches]);
+    }
+
+    fprintf(Out, "\n");
+}
+
+static void PrintCounterAvailability(FILE *Out)
+{
+    u32 AvailableCount = 0;
+    fprintf(Out, "Counters:");
+    for(u32 Counter = 0; Counter < ProfileCounter_count; ++Counter)
+    {
+        if(GlobalProfilerCounters.Available[Counter])
+        {
+            fprintf(Out, " %s", ProfileCounterNames[Counter]);
+            ++AvailableCount;
+        }
+    }
+
+    if(AvailableCount < ProfileCounter_count)
+    {
+        fprintf(Out, "%s (unavailable:", AvailableCount ? "" : " none");
+        for(u32 Counter = 0; Counter < ProfileCounter_count; ++Counter)
+        {
+            if(!GlobalProfilerCounters.Available[Counter])
+            {
+                fprintf(Out, " %s", ProfileCounterNames[Counter]);
+            }
+        }
+        fprintf(Out, ")");
+    }
+    fprintf(Out, "\n");
+}
+
+#endif
+
+static void PrintAnchorData(FILE *Out, u64 TotalTSCElapsed, u64 TSCFreq)
+{
+#if PROFILER_COUNTERS
+    PrintCounterAvailability(Out);
+#endif
+
+    for(u32 AnchorIndex = 1; AnchorIndex < PROFILER_MAX_ANCHORS; ++AnchorIndex)
+    {
+        profile_anchor *Anchor = GlobalProfilerAnchors + AnchorIndex;
+        if(Anchor->TSCElapsedInclusive)
+        {
+            PrintTimeElapsed(Out, TotalTSCElapsed, TSCFreq, Anchor);
+
+#if PROFILER_COUNTERS
+            PrintAnchorCounters(Out, Anchor);
+#endif
+        }
+    }
+}
+
+#else
+
+#define TimeBandwidth(...)
+#define PrintAnchorData(...)
+#define ProfilerEndOfCompilationUnit
+
+#endif
+
+#define TimeBlock(Name) TimeBandwidth(Name, 0)
+#define TimeFunction TimeBlock(__func__)
+
+#if PROFILER_DETAIL
+#define TimeDetailBlock(Name) TimeBlock(Name)
+#define TimeDetailFunction TimeFunction
+#else
+#define TimeDetailBlock(...)
+#define TimeDetailFunction
+#endif
+
+static void BeginProfile(void)
+{
+#if PROFILER
+    GlobalProfilerThread = 1;
+#endif
+
+#if PROFILER_COUNTERS
+    OpenProfileCounters();
+#endif
+
+    GlobalProfiler.StartOSTimer = ProfilerReadOSTimer();
+    GlobalProfiler.StartTSC = ProfilerReadTSC();
+}
+
+// NOTE(ojf): Out is a parameter since sim86 writes its listing to stdout
+static void EndAndPrintProfile(FILE *Out)
+{
+    GlobalProfiler.EndTSC = ProfilerReadTSC();
+    GlobalProfiler.EndOSTimer = ProfilerReadOSTimer();
+
+    u64 TotalTSCElapsed = GlobalProfiler.EndTSC - GlobalProfiler.StartTSC;
+    u64 OSElapsed = GlobalProfiler.EndOSTimer - GlobalProfiler.StartOSTimer;
+
+    // NOTE(ojf): In f64, since OS ticks times TSC ticks overflows u64 after
+    // a few seconds
+    u64 TSCFreq = 0;
+    if(OSElapsed)
+    {
+        TSCFreq = (u64)((f64)ProfilerOSTimerFreq()*(f64)TotalTSCElapsed / (f64)OSElapsed);
+    }
+
+    fprintf(Out, "\nTotal time: %0.4fms (TSC freq %llu)\n",
+            TSCFreq ? (1000.0*(f64)TotalTSCElapsed / (f64)TSCFreq) : 0.0, (unsigned long long)TSCFreq);
+
+    if(TotalTSCElapsed)
+    {
+        PrintAnchorData(Out, TotalTSCElapsed, TSCFreq);
+    }
+}
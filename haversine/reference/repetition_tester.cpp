@@ -0,0 +1,245 @@
+/* ========================================================================
+   Repetition tester
+   ======================================================================== */
+
+/* NOTE(ojf): Runs a target over and over until no new minimum time has
+   shown up for a while, then reports the min, max and average per run.
+   The minimum is the number to compare, since everything that goes wrong
+   on a run (interrupts, other processes, a cold cache) only ever adds
+   time.  The max and average show how noisy the target is.
+
+   A test is written as a loop around the target:
+
+       fprintf(stdout, "\n--- Name ---\n");
+       NewTestWave(&Tester, ByteCount, CPUFreq, SecondsToTry);
+       while(IsTesting(&Tester))
+       {
+           ...setup that shouldn't be timed...
+           BeginTime(&Tester);
+           ...target...
+           EndTime(&Tester);
+           CountBytes(&Tester, ByteCount);
+       }
+       PrintResults(&Tester);
+
+   A run can be timed in several Begin/End pieces, and every run has to
+   count exactly the ByteCount the wave was started with, so a target that
+   silently did less work gets reported as an error instead of as fast.
+   Page faults are counted across the same timed pieces.
+*/
+
+enum test_mode
+{
+    TestMode_uninitialized,
+    TestMode_testing,
+    TestMode_completed,
+    TestMode_error,
+};
+
+struct repetition_value
+{
+    u64 TestCount;
+    u64 CPUTime;
+    u64 PageFaults;
+    u64 ByteCount;
+};
+
+struct repetition_test_results
+{
+    repetition_value Total;
+    repetition_value Min;
+    repetition_value Max;
+};
+
+struct repetition_tester
+{
+    u64 TargetProcessedByteCount;
+    u64 CPUTimerFreq;
+    u64 TryForTime;
+    u64 TestsStartedAt;
+
+    test_mode Mode;
+    b32 PrintNewMinimums;
+    u32 OpenBlockCount;
+    u32 CloseBlockCount;
+
+    repetition_value Accumulated;
+    repetition_test_results Results;
+};
+
+static void PrintRepetitionValue(char const *Label, repetition_value Value, u64 CPUTimerFreq)
+{
+    u64 TestCount = Value.TestCount ? Value.TestCount : 1;
+    f64 CPUTime = (f64)Value.CPUTime / (f64)TestCount;
+    f64 PageFaults = (f64)Value.PageFaults / (f64)TestCount;
+    f64 ByteCount = (f64)Value.ByteCount / (f64)TestCount;
+
+    fprintf(stdout, "%s: %.0f", Label, CPUTime);
+    if(CPUTimerFreq)
+    {
+        f64 Seconds = CPUTime / (f64)CPUTimerFreq;
+        fprintf(stdout, " (%.6fms)", 1000.0*Seconds);
+
+        if(ByteCount > 0)
+        {
+            fprintf(stdout, " %.3fgb/s", (ByteCount / (1024.0*1024.0*1024.0)) / Seconds);
+        }
+    }
+
+    if(PageFaults > 0)
+    {
+        fprintf(stdout, " PF: %.1f", PageFaults);
+        if(ByteCount > 0)
+        {
+            fprintf(stdout, " (%.3fkb/fault)", ByteCount / (PageFaults*1024.0));
+        }
+    }
+}
+
+// NOTE(ojf): Overwrites the running minimum IsTesting prints
+static void PrintResults(repetition_tester *Tester)
+{
+    repetition_test_results *Results = &Tester->Results;
+
+    if(Tester->Mode == TestMode_error)
+    {
+        fprintf(stdout, "(failed, see the error above)\n");
+    }
+    else
+    {
+        PrintRepetitionValue("Min", Results->Min, Tester->CPUTimerFreq);
+        fprintf(stdout, "\n");
+        PrintRepetitionValue("Max", Results->Max, Tester->CPUTimerFreq);
+        fprintf(stdout, "\n");
+        PrintRepetitionValue("Avg", Results->Total, Tester->CPUTimerFreq);
+        fprintf(stdout, "\n");
+        fprintf(stdout, "Runs: %llu\n", Results->Total.TestCount);
+    }
+}
+
+static void Error(repetition_tester *Tester, char const *Message)
+{
+    Tester->Mode = TestMode_error;
+    fprintf(stderr, "ERROR: %s\n", Message);
+}
+
+// NOTE(ojf): Results carry over between waves on the same tester, so the
+// same target can be run again after something else and only improve
+static void NewTestWave(repetition_tester *Tester, u64 TargetProcessedByteCount, u64 CPUTimerFreq,
+                        u32 SecondsToTry = 10)
+{
+    if(Tester->Mode == TestMode_uninitialized)
+    {
+        Tester->Mode = TestMode_testing;
+        Tester->TargetProcessedByteCount = TargetProcessedByteCount;
+        Tester->CPUTimerFreq = CPUTimerFreq;
+        Tester->PrintNewMinimums = true;
+        Tester->Results.Min.CPUTime = ~0ull;
+    }
+    else if(Tester->Mode == TestMode_completed)
+    {
+        Tester->Mode = TestMode_testing;
+
+        if(Tester->TargetProcessedByteCount != TargetProcessedByteCount)
+        {
+            Error(Tester, "TargetProcessedByteCount changed");
+        }
+
+        if(Tester->CPUTimerFreq != CPUTimerFreq)
+        {
+            Error(Tester, "CPU frequency changed");
+        }
+    }
+
+    Tester->TryForTime = SecondsToTry*CPUTimerFreq;
+    Tester->TestsStartedAt = ReadCPUTimer();
+}
+
+inline void BeginTime(repetition_tester *Tester)
+{
+    ++Tester->OpenBlockCount;
+
+    // NOTE(ojf): Faults first, so the getrusage call isn't in the time
+    Tester->Accumulated.PageFaults -= ReadOSPageFaultCount();
+    Tester->Accumulated.CPUTime -= ReadCPUTimer();
+}
+
+inline void EndTime(repetition_tester *Tester)
+{
+    Tester->Accumulated.CPUTime += ReadCPUTimer();
+    Tester->Accumulated.PageFaults += ReadOSPageFaultCount();
+
+    ++Tester->CloseBlockCount;
+}
+
+inline void CountBytes(repetition_tester *Tester, u64 ByteCount)
+{
+    Tester->Accumulated.ByteCount += ByteCount;
+}
+
+static b32 IsTesting(repetition_tester *Tester)
+{
+    if(Tester->Mode == TestMode_testing)
+    {
+        repetition_value Accumulated = Tester->Accumulated;
+        u64 CurrentTime = ReadCPUTimer();
+
+        // NOTE(ojf): Nothing timed yet means this is the first call of the
+        // wave, not the end of a run
+        if(Tester->OpenBlockCount)
+        {
+            if(Tester->OpenBlockCount != Tester->CloseBlockCount)
+            {
+                Error(Tester, "Unbalanced BeginTime/EndTime");
+            }
+
+            if(Accumulated.ByteCount != Tester->TargetProcessedByteCount)
+            {
+                Error(Tester, "Processed byte count mismatch");
+            }
+
+            if(Tester->Mode == TestMode_testing)
+            {
+                repetition_test_results *Results = &Tester->Results;
+
+                Accumulated.TestCount = 1;
+                Results->Total.TestCount += 1;
+                Results->Total.CPUTime += Accumulated.CPUTime;
+                Results->Total.PageFaults += Accumulated.PageFaults;
+                Results->Total.ByteCount += Accumulated.ByteCount;
+
+                if(Results->Max.CPUTime < Accumulated.CPUTime)
+                {
+                    Results->Max = Accumulated;
+                }
+
+                if(Results->Min.CPUTime > Accumulated.CPUTime)
+                {
+                    Results->Min = Accumulated;
+
+                    // NOTE(ojf): A new minimum restarts the clock
+                    Tester->TestsStartedAt = CurrentTime;
+
+                    if(Tester->PrintNewMinimums)
+                    {
+                        PrintRepetitionValue("Min", Results->Min, Tester->CPUTimerFreq);
+                        fprintf(stdout, "               \r");
+                        fflush(stdout);
+                    }
+                }
+
+                Tester->OpenBlockCount = 0;
+                Tester->CloseBlockCount = 0;
+                Tester->Accumulated = {};
+            }
+        }
+
+        if((CurrentTime - Tester->TestsStartedAt) > Tester->TryForTime)
+        {
+            Tester->Mode = TestMode_completed;
+        }
+    }
+
+    b32 Result = (Tester->Mode == TestMode_testing);
+    return Result;
+}
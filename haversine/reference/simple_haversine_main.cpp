@@ -27,12 +27,18 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
+#include <float.h>
+#include <assert.h>
+#include <string.h>
 #include <sys/stat.h>
 
 typedef uint8_t u8;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
+typedef int32_t i32;
+typedef int64_t i64;
+
 typedef int32_t b32;
 
 typedef float f32;
@@ -44,9 +50,26 @@ struct haversine_pair
     f64 X1, Y1;
 };
 
+#include "platform_metrics.cpp"
+#include "profiler.h"
 #include "haversine_formula.cpp"
 #include "buffer.cpp"
+#include "memory_arena.cpp"
+#include "platform_thread.cpp"
+#include "platform_memory.cpp"
+#include "json_number_conversion.cpp"
+#include "cpu_features.cpp"
+#include "haversine_math.cpp"
+#include "haversine_pair_soa.cpp"
+#include "haversine_simd.cpp"
+#include "haversine_pair_file.cpp"
+#include "structural_index.cpp"
 #include "lookup_json_parser.cpp"
+#include "streaming_haversine_parser.cpp"
+#include "chunked_haversine_parser.cpp"
+#include "parallel_haversine_sum.cpp"
+#include "pipelined_haversine_parser.cpp"
+#include "repetition_tester.cpp"
 
 static buffer ReadEntireFile(char *FileName)
 {
@@ -63,6 +86,7 @@ static buffer ReadEntireFile(char *FileName)
         stat(FileName, &Stat);
 #endif
         
+        TimeBandwidth("Read", Stat.st_size);
         Result = AllocateBuffer(Stat.st_size);
         if(Result.Data)
         {
@@ -83,48 +107,911 @@ static buffer ReadEntireFile(char *FileName)
     return Result;
 }
 
-static f64 SumHaversineDistances(u64 PairCount, haversine_pair *Pairs)
+#define EARTH_RADIUS 6372.8
+
+static f64 SumHaversineDistances(haversine_kernel Kernel, u64 PairCount, pair_storage *Pairs)
+{
+    f64 Sum = HaversineWithStorage(Kernel, PairCount, Pairs, EARTH_RADIUS, 0);
+    return Sum;
+}
+
+enum haversine_sum_kind
+{
+    HaversineSum_serial,
+    HaversineSum_parallel,
+};
+
+static char const *HaversineSumNames[] = {"serial", "parallel"};
+
+enum haversine_parser_kind
+{
+    HaversineParser_dom,
+    HaversineParser_stream,
+    HaversineParser_simd,
+    HaversineParser_chunked,
+    HaversineParser_pipeline,
+};
+
+static char const *HaversineParserNames[] = {"dom", "stream", "simd", "chunked", "pipeline"};
+
+// NOTE(ojf): What -repeat redoes before every run: file drops the input
+// from the page cache, alloc gets fresh buffers so their page faults are
+// in the time
+enum cold_mode
+{
+    ColdMode_none,
+    ColdMode_file,
+    ColdMode_alloc,
+    ColdMode_all,
+};
+
+static char const *ColdModeNames[] = {"none", "file", "alloc", "all"};
+
+struct haversine_options
+{
+    haversine_parser_kind Parser;
+    structural_index_isa ISA;
+    u32 ThreadCount;
+    b32 ReportScaling;
+    haversine_kernel Kernel;
+    b32 CompareKernels;
+    haversine_sum_kind SumKind;
+    haversine_pair_layout Layout;
+    input_strategy Input;
+    page_kind Pages;
+    b32 CompareInputs;
+    u32 RepeatSeconds;
+    cold_mode Cold;
+    char *ConvertFileName;
+    b32 VerifyPairs;
+    char *InputFileName;
+    char *AnswersFileName;
+};
+
+static b32 ParseOptions(int ArgCount, char **Args, haversine_options *Options)
+{
+    b32 Valid = true;
+    *Options = {};
+    Options->ISA = GetBestStructuralISA();
+    Options->ThreadCount = GetProcessorCount();
+    // NOTE(ojf): This is the reference tool, so the default answer is libm's.
+    // The vector kernels are only used when asked for
+    Options->Kernel = HaversineKernel_scalar;
+    
+    for(int ArgIndex = 1; Valid && (ArgIndex < ArgCount); ++ArgIndex)
+    {
+        char *Arg = Args[ArgIndex];
+        if((strcmp(Arg, "-parser") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 Kind = 0; Kind < ArrayCount(HaversineParserNames); ++Kind)
+            {
+                if(strcmp(Name, HaversineParserNames[Kind]) == 0)
+                {
+                    Options->Parser = (haversine_parser_kind)Kind;
+                    Found = true;
+                }
+            }
+            Valid = Found;
+        }
+        else if((strcmp(Arg, "-threads") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            Options->ThreadCount = atoi(Args[++ArgIndex]);
+            Valid = ((Options->ThreadCount >= 1) && (Options->ThreadCount <= MAX_PARSE_CHUNKS));
+        }
+        else if(strcmp(Arg, "-scaling") == 0)
+        {
+            Options->ReportScaling = true;
+        }
+        else if((strcmp(Arg, "-kernel") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 Kernel = 0; Kernel < HaversineKernel_count; ++Kernel)
+            {
+                if(strcmp(Name, HaversineKernelNames[Kernel]) == 0)
+                {
+                    Found = (Kernel <= (u32)GetBestHaversineKernel());
+                    Options->Kernel = (haversine_kernel)Kernel;
+                }
+            }
+            Valid = Found;
+        }
+        else if(strcmp(Arg, "-kernels") == 0)
+        {
+            Options->CompareKernels = true;
+        }
+        else if((strcmp(Arg, "-sum") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 Kind = 0; Kind < ArrayCount(HaversineSumNames); ++Kind)
+            {
+                if(strcmp(Name, HaversineSumNames[Kind]) == 0)
+                {
+                    Options->SumKind = (haversine_sum_kind)Kind;
+                    Found = true;
+                }
+            }
+            Valid = Found;
+        }
+        else if((strcmp(Arg, "-layout") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 Layout = 0; Layout < ArrayCount(PairLayoutNames); ++Layout)
+            {
+                if(strcmp(Name, PairLayoutNames[Layout]) == 0)
+                {
+                    Options->Layout = (haversine_pair_layout)Layout;
+                    Found = true;
+                }
+            }
+            Valid = Found;
+        }
+        else if((strcmp(Arg, "-input") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 Input = 0; Input < InputStrategy_count; ++Input)
+            {
+                if(strcmp(Name, InputStrategyNames[Input]) == 0)
+                {
+                    Options->Input = (input_strategy)Input;
+                    Found = true;
+                }
+            }
+            Valid = Found;
+        }
+        else if((strcmp(Arg, "-pages") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 Kind = 0; Kind < PageKind_count; ++Kind)
+            {
+                if(strcmp(Name, PageKindNames[Kind]) == 0)
+                {
+                    Options->Pages = (page_kind)Kind;
+                    Found = true;
+                }
+            }
+            Valid = Found;
+        }
+        else if(strcmp(Arg, "-inputs") == 0)
+        {
+            Options->CompareInputs = true;
+        }
+        else if((strcmp(Arg, "-repeat") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            int Seconds = atoi(Args[++ArgIndex]);
+            Options->RepeatSeconds = (Seconds > 0) ? (u32)Seconds : 0;
+            Valid = (Options->RepeatSeconds != 0);
+        }
+        else if((strcmp(Arg, "-cold") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 Mode = 0; Mode < ArrayCount(ColdModeNames); ++Mode)
+            {
+                if(strcmp(Name, ColdModeNames[Mode]) == 0)
+                {
+                    Options->Cold = (cold_mode)Mode;
+                    Found = true;
+                }
+            }
+            Valid = Found;
+        }
+        else if((strcmp(Arg, "-convert") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            Options->ConvertFileName = Args[++ArgIndex];
+        }
+        else if(strcmp(Arg, "-verify") == 0)
+        {
+            Options->VerifyPairs = true;
+        }
+        else if((strcmp(Arg, "-isa") == 0) && ((ArgIndex + 1) < ArgCount))
+        {
+            char *Name = Args[++ArgIndex];
+            b32 Found = false;
+            for(u32 ISA = 0; ISA < ArrayCount(StructuralISANames); ++ISA)
+            {
+                if(strcmp(Name, StructuralISANames[ISA]) == 0)
+                {
+                    // NOTE(ojf): Only allow going down from what the CPU has
+                    Found = (ISA <= (u32)GetBestStructuralISA());
+                    Options->ISA = (structural_index_isa)ISA;
+                }
+            }
+            Valid = Found;
+        }
+        else if(Arg[0] == '-')
+        {
+            Valid = false;
+        }
+        else if(!Options->InputFileName)
+        {
+            Options->InputFileName = Arg;
+        }
+        else if(!Options->AnswersFileName)
+        {
+            Options->AnswersFileName = Arg;
+        }
+        else
+        {
+            Valid = false;
+        }
+    }
+    
+    Valid = Valid && Options->InputFileName;
+    return Valid;
+}
+
+// NOTE(ojf): Every parser except pipeline, which never has the whole input
+static u64 ParsePairs(haversine_options *Options, buffer InputJSON, u64 MaxPairCount, pair_storage *Pairs,
+                      f64 *IndexSeconds)
+{
+    TimeBandwidth("Parse", InputJSON.Count);
+    
+    u64 ParseStart = ReadOSTimer();
+    u64 PairCount = 0;
+    if(Options->Parser == HaversineParser_simd)
+    {
+        structural_index Index;
+        b32 Indexed = BuildStructuralIndex(InputJSON, &Index, Options->ISA);
+        *IndexSeconds = SecondsFromOSTimer(ReadOSTimer() - ParseStart);
+        if(Indexed && Index.UnclosedString)
+        {
+            fprintf(stderr, "ERROR: Unterminated string in JSON\n");
+        }
+        else
+        {
+            PairCount = StreamParseHaversinePairs(InputJSON, MaxPairCount, Pairs, Indexed ? &Index : 0);
+        }
+        FreeStructuralIndex(&Index);
+    }
+    else if(Options->Parser == HaversineParser_chunked)
+    {
+        chunked_parse_result Chunked = ChunkedParseHaversinePairs(InputJSON, MaxPairCount, Pairs, Options->ThreadCount);
+        PairCount = Chunked.PairCount;
+        if(Chunked.FellBack)
+        {
+            fprintf(stderr, "WARNING: Unable to split the pairs array into chunks, parsed on a single thread instead.\n");
+        }
+    }
+    else if(Options->Parser == HaversineParser_stream)
+    {
+        PairCount = StreamParseHaversinePairs(InputJSON, MaxPairCount, Pairs, 0);
+    }
+    else
+    {
+        PairCount = ParseHaversinePairs(InputJSON, MaxPairCount, Pairs);
+    }
+    
+    return PairCount;
+}
+
+static buffer LoadInputJSON(char *FileName, input_strategy Input, mapped_file *Mapped)
+{
+    TimeBlock("Load");
+    
+    buffer Result = {};
+    if(Input == InputStrategy_read)
+    {
+        Result = ReadEntireFile(FileName);
+    }
+    else if(MapInputFile(FileName, Input, Mapped))
+    {
+        Result = Mapped->Data;
+    }
+    
+    return Result;
+}
+
+static void FreeInputJSON(buffer *InputJSON, mapped_file *Mapped)
 {
-    f64 Sum = 0;
+    if(Mapped->Data.Data)
+    {
+        UnmapInputFile(Mapped);
+        *InputJSON = {};
+    }
+    else
+    {
+        FreeBuffer(InputJSON);
+    }
+}
+
+// NOTE(ojf): Each combination loads and parses from scratch, so only one
+// input and one pair array are alive at a time.  After the first run the
+// file is in the page cache, so read and mmap are timed against memory,
+// not the disk.
+static void CompareInputStrategies(haversine_options *Options)
+{
+    fprintf(stdout, "Input     Pages   (used)     Load s   Parse s   Total s  Page faults\n");
     
-    f64 SumCoef = 1 / (f64)PairCount;
-    for(u64 PairIndex = 0; PairIndex < PairCount; ++PairIndex)
+    u64 FirstPairCount = 0;
+    for(u32 Input = 0; Input < InputStrategy_count; ++Input)
     {
-        haversine_pair Pair = Pairs[PairIndex];
-        f64 EarthRadius = 6372.8;
-        f64 Dist = ReferenceHaversine(Pair.X0, Pair.Y0, Pair.X1, Pair.Y1, EarthRadius);
-        Sum += SumCoef*Dist;
+        for(u32 Kind = 0; Kind < PageKind_count; ++Kind)
+        {
+            u64 Faults = ReadOSPageFaultCount();
+            u64 LoadStart = ReadOSTimer();
+            mapped_file Mapped = {};
+            buffer InputJSON = LoadInputJSON(Options->InputFileName, (input_strategy)Input, &Mapped);
+            u64 ParseStart = ReadOSTimer();
+            
+            u64 MaxPairCount = InputJSON.Count / (6*4);
+            pair_storage Pairs = AllocatePairStorage(Options->Layout, MaxPairCount ? MaxPairCount : 1, (page_kind)Kind);
+            
+            u64 PairCount = 0;
+            if(MaxPairCount && Pairs.Memory.Count)
+            {
+                f64 IndexSeconds = 0;
+                PairCount = ParsePairs(Options, InputJSON, MaxPairCount, &Pairs, &IndexSeconds);
+            }
+            u64 End = ReadOSTimer();
+            Faults = ReadOSPageFaultCount() - Faults;
+            
+            if((Input == 0) && (Kind == 0))
+            {
+                FirstPairCount = PairCount;
+            }
+            
+            fprintf(stdout, "%-9s %-7s (%-6s) %8.4f  %8.4f  %8.4f  %11llu%s\n",
+                    InputStrategyNames[Input], PageKindNames[Kind], PageKindNames[Pairs.Pages],
+                    SecondsFromOSTimer(ParseStart - LoadStart), SecondsFromOSTimer(End - ParseStart),
+                    SecondsFromOSTimer(End - LoadStart), Faults,
+                    (PairCount != FirstPairCount) ? " (pair count differs!)" : "");
+            
+            FreePairStorage(&Pairs);
+            FreeInputJSON(&InputJSON, &Mapped);
+        }
     }
+}
+
+// NOTE(ojf): Only the answers' sum and count are checked, so the answers
+// file isn't read into memory either
+static b32 ReadAnswersSum(char *FileName, u64 *PairCount, f64 *Sum)
+{
+    b32 Result = false;
     
-    return Sum;
+    FILE *File = fopen(FileName, "rb");
+    if(File)
+    {
+#if _WIN32
+        struct __stat64 Stat;
+        _stat64(FileName, &Stat);
+#else
+        struct stat Stat;
+        stat(FileName, &Stat);
+#endif
+        
+        if((Stat.st_size >= (i64)sizeof(f64)) &&
+           (fseek(File, -(long)sizeof(f64), SEEK_END) == 0) &&
+           (fread(Sum, sizeof(f64), 1, File) == 1))
+        {
+            *PairCount = (Stat.st_size - sizeof(f64)) / sizeof(f64);
+            Result = true;
+        }
+        
+        fclose(File);
+    }
+    
+    if(!Result)
+    {
+        fprintf(stderr, "ERROR: Unable to read \"%s\".\n", FileName);
+    }
+    
+    return Result;
+}
+
+static void RunHaversinePipeline(haversine_options *Options)
+{
+    TimeBlock("Pipeline");
+    
+    u64 Start = ReadOSTimer();
+    pipeline_result Pipeline = PipelineSumHaversineFile(Options->InputFileName, Options->Kernel, Options->Layout,
+                                                        EARTH_RADIUS);
+    f64 Seconds = SecondsFromOSTimer(ReadOSTimer() - Start);
+    
+    if(Pipeline.Valid)
+    {
+        fprintf(stdout, "Input size: %llu\n", Pipeline.ByteCount);
+        fprintf(stdout, "Pair count: %llu\n", Pipeline.PairCount);
+        fprintf(stdout, "Haversine sum: %.16f\n", Pipeline.Sum);
+        
+        fprintf(stdout, "\nPipeline (%s, %s): %.4fs, %.3fgb/s\n",
+                HaversineKernelNames[Options->Kernel], PairLayoutNames[Options->Layout], Seconds,
+                ((f64)Pipeline.ByteCount / (1024.0*1024.0*1024.0)) / Seconds);
+        fprintf(stdout, "  Parser waited %.4fs for reads, reader waited %.4fs for the parser\n",
+                Pipeline.ParseWaitSeconds, Pipeline.ReadWaitSeconds);
+        fprintf(stdout, "Peak memory: %.2fmb\n", (f64)ReadPeakMemoryUsage() / (1024.0*1024.0));
+        
+        TimeBlock("Validate");
+        u64 RefAnswerCount = 0;
+        f64 RefSum = 0;
+        if(Options->AnswersFileName && ReadAnswersSum(Options->AnswersFileName, &RefAnswerCount, &RefSum))
+        {
+            fprintf(stdout, "\nValidation:\n");
+            if(Pipeline.PairCount != RefAnswerCount)
+            {
+                fprintf(stdout, "FAILED - pair count doesn't match %llu.\n", RefAnswerCount);
+            }
+            
+            fprintf(stdout, "Reference sum: %.16f\n", RefSum);
+            fprintf(stdout, "Difference: %.16f\n", Pipeline.Sum - RefSum);
+            if(fabs(Pipeline.Sum - RefSum) > HAVERSINE_SUM_TOLERANCE)
+            {
+                fprintf(stdout, "FAILED - sum outside the %s kernel's tolerance.\n", HaversineKernelNames[Options->Kernel]);
+            }
+            fprintf(stdout, "\n");
+        }
+    }
+}
+
+// NOTE(ojf): A pair file is already the soa layout, so the kernels read
+// straight out of the mapping, and the only load cost is mapping it and
+// faulting in the pages the sum touches
+static void RunHaversinePairFile(haversine_options *Options)
+{
+    u64 MapStart = ReadOSTimer();
+    u64 MapFaults = ReadOSPageFaultCount();
+    pair_file File;
+    b32 Opened = OpenPairFile(Options->InputFileName, Options->Input, &File);
+    f64 MapSeconds = SecondsFromOSTimer(ReadOSTimer() - MapStart);
+    MapFaults = ReadOSPageFaultCount() - MapFaults;
+    
+    if(Opened)
+    {
+        pair_file_header *Header = File.Header;
+        u64 PairCount = Header->PairCount;
+        
+        b32 Verified = true;
+        f64 VerifySeconds = 0;
+        if(Options->VerifyPairs)
+        {
+            u64 VerifyStart = ReadOSTimer();
+            Verified = VerifyPairFile(&File);
+            VerifySeconds = SecondsFromOSTimer(ReadOSTimer() - VerifyStart);
+        }
+        
+        if(Verified)
+        {
+            u64 SumStart = ReadCPUTimer();
+            u64 SumOSStart = ReadOSTimer();
+            u64 SumFaults = ReadOSPageFaultCount();
+            f64 Sum = 0;
+            {
+                TimeBandwidth("Sum", PAIR_FILE_COLUMN_COUNT*PairCount*sizeof(f64));
+                if(Options->SumKind == HaversineSum_parallel)
+                {
+                    Sum = ParallelSumHaversineDistances(Options->Kernel, PairCount, &File.Pairs, EARTH_RADIUS, Options->ThreadCount);
+                }
+                else
+                {
+                    Sum = SumHaversineDistances(Options->Kernel, PairCount, &File.Pairs);
+                }
+            }
+            u64 SumCycles = ReadCPUTimer() - SumStart;
+            f64 SumSeconds = SecondsFromOSTimer(ReadOSTimer() - SumOSStart);
+            SumFaults = ReadOSPageFaultCount() - SumFaults;
+            
+            fprintf(stdout, "Input size: %llu\n", File.Mapped.Data.Count);
+            fprintf(stdout, "Pair count: %llu\n", PairCount);
+            fprintf(stdout, "Haversine sum: %.16f\n", Sum);
+            
+            fprintf(stdout, "\nPair file version %u, from %llu bytes of JSON with hash %016llx\n",
+                    Header->Version, Header->SourceSize, Header->SourceHash);
+            fprintf(stdout, "Map (%s): %.4fs, %llu page faults\n",
+                    InputStrategyNames[(Options->Input == InputStrategy_read) ? InputStrategy_mmap : Options->Input],
+                    MapSeconds, MapFaults);
+            if(Options->VerifyPairs)
+            {
+                fprintf(stdout, "Verify: %.4fs\n", VerifySeconds);
+            }
+            fprintf(stdout, "Sum (%s, %s): %.4fs, %.2fm pairs/s, %.2f cycles/pair, %llu page faults\n",
+                    HaversineKernelNames[Options->Kernel], HaversineSumNames[Options->SumKind], SumSeconds,
+                    ((f64)PairCount / 1000000.0) / SumSeconds, (f64)SumCycles / (f64)PairCount,
+                    SumFaults);
+            fprintf(stdout, "Peak memory: %.2fmb\n", (f64)ReadPeakMemoryUsage() / (1024.0*1024.0));
+            
+            TimeBlock("Validate");
+            u64 RefAnswerCount = 0;
+            f64 RefSum = 0;
+            if(Options->AnswersFileName && ReadAnswersSum(Options->AnswersFileName, &RefAnswerCount, &RefSum))
+            {
+                fprintf(stdout, "\nValidation:\n");
+                if(PairCount != RefAnswerCount)
+                {
+                    fprintf(stdout, "FAILED - pair count doesn't match %llu.\n", RefAnswerCount);
+                }
+                
+                fprintf(stdout, "Reference sum: %.16f\n", RefSum);
+                fprintf(stdout, "Difference: %.16f\n", Sum - RefSum);
+                if(fabs(Sum - RefSum) > HAVERSINE_SUM_TOLERANCE)
+                {
+                    fprintf(stdout, "FAILED - sum outside the %s kernel's tolerance.\n", HaversineKernelNames[Options->Kernel]);
+                }
+                fprintf(stdout, "\n");
+            }
+        }
+        
+        ClosePairFile(&File);
+    }
+}
+
+// NOTE(ojf): Every -input strategy is timed until its data is in memory,
+// so the mapped ones touch each page, and the prefault thread races that
+// touch the same way it races the parser.  Parse and sum then run on one
+// copy of the input read up front, with the -parser, -layout, -pages and
+// -sum options, and the sum over every kernel this CPU has.
+static void RunRepetitionTests(haversine_options *Options)
+{
+    b32 ColdFile = ((Options->Cold == ColdMode_file) || (Options->Cold == ColdMode_all));
+    b32 ColdAlloc = ((Options->Cold == ColdMode_alloc) || (Options->Cold == ColdMode_all));
+    if(ColdFile && !DropFileFromPageCache(Options->InputFileName))
+    {
+        fprintf(stderr, "WARNING: Unable to drop \"%s\" from the page cache, file runs will be warm.\n",
+                Options->InputFileName);
+        ColdFile = false;
+    }
+    
+    buffer InputJSON = ReadEntireFile(Options->InputFileName);
+    u64 MaxPairCount = InputJSON.Count / (6*4);
+    if(MaxPairCount)
+    {
+        u64 CPUFreq = EstimateCPUTimerFreq(100);
+        fprintf(stdout, "CPU timer: %llu, cold: %s, stops after %us without a new minimum\n",
+                CPUFreq, ColdModeNames[Options->Cold], Options->RepeatSeconds);
+        
+        buffer ReadBuffer = {};
+        if(!ColdAlloc)
+        {
+            ReadBuffer = AllocateBuffer(InputJSON.Count);
+        }
+        
+        for(u32 Input = 0; Input < InputStrategy_count; ++Input)
+        {
+            fprintf(stdout, "\n--- Load (%s%s) ---\n", InputStrategyNames[Input],
+                    ((Input == InputStrategy_read) && !ColdAlloc) ? ", reused buffer" : "");
+            
+            repetition_tester Tester = {};
+            NewTestWave(&Tester, InputJSON.Count, CPUFreq, Options->RepeatSeconds);
+            while(IsTesting(&Tester))
+            {
+                if(ColdFile)
+                {
+                    DropFileFromPageCache(Options->InputFileName);
+                }
+                
+                if((Input == InputStrategy_read) && ReadBuffer.Data)
+                {
+                    FILE *File = fopen(Options->InputFileName, "rb");
+                    if(File)
+                    {
+                        BeginTime(&Tester);
+                        b32 Read = (fread(ReadBuffer.Data, ReadBuffer.Count, 1, File) == 1);
+                        EndTime(&Tester);
+                        
+                        CountBytes(&Tester, Read ? ReadBuffer.Count : 0);
+                        fclose(File);
+                    }
+                    else
+                    {
+                        Error(&Tester, "Unable to open the input");
+                    }
+                }
+                else
+                {
+                    mapped_file Mapped = {};
+                    BeginTime(&Tester);
+                    buffer Loaded = LoadInputJSON(Options->InputFileName, (input_strategy)Input, &Mapped);
+                    if(Mapped.Data.Data)
+                    {
+                        TouchPages(Loaded, 0);
+                    }
+                    EndTime(&Tester);
+                    
+                    CountBytes(&Tester, Loaded.Count);
+                    FreeInputJSON(&Loaded, &Mapped);
+                }
+            }
+            PrintResults(&Tester);
+        }
+        
+        FreeBuffer(&ReadBuffer);
+        
+        pair_storage Pairs = {};
+        if(!ColdAlloc)
+        {
+            Pairs = AllocatePairStorage(Options->Layout, MaxPairCount, Options->Pages);
+        }
+        
+        if(Options->Parser == HaversineParser_pipeline)
+        {
+            fprintf(stdout, "\n--- Pipeline (%s, %s) ---\n", HaversineKernelNames[Options->Kernel],
+                    PairLayoutNames[Options->Layout]);
+            
+            repetition_tester Tester = {};
+            NewTestWave(&Tester, InputJSON.Count, CPUFreq, Options->RepeatSeconds);
+            while(IsTesting(&Tester))
+            {
+                if(ColdFile)
+                {
+                    DropFileFromPageCache(Options->InputFileName);
+                }
+                
+                BeginTime(&Tester);
+                pipeline_result Pipeline = PipelineSumHaversineFile(Options->InputFileName, Options->Kernel,
+                                                                    Options->Layout, EARTH_RADIUS);
+                EndTime(&Tester);
+                
+                CountBytes(&Tester, Pipeline.Valid ? Pipeline.ByteCount : 0);
+            }
+            PrintResults(&Tester);
+        }
+        else
+        {
+            fprintf(stdout, "\n--- Parse (%s, %s, %s pages) ---\n", HaversineParserNames[Options->Parser],
+                    PairLayoutNames[Options->Layout], PageKindNames[Options->Pages]);
+            
+            u64 PairCount = 0;
+            repetition_tester Tester = {};
+            NewTestWave(&Tester, InputJSON.Count, CPUFreq, Options->RepeatSeconds);
+            while(IsTesting(&Tester))
+            {
+                BeginTime(&Tester);
+                if(ColdAlloc)
+                {
+                    Pairs = AllocatePairStorage(Options->Layout, MaxPairCount, Options->Pages);
+                }
+                
+                f64 IndexSeconds = 0;
+                PairCount = Pairs.Memory.Count ? ParsePairs(Options, InputJSON, MaxPairCount, &Pairs, &IndexSeconds) : 0;
+                
+                if(ColdAlloc)
+                {
+                    FreePairStorage(&Pairs);
+                }
+                EndTime(&Tester);
+                
+                CountBytes(&Tester, PairCount ? InputJSON.Count : 0);
+            }
+            PrintResults(&Tester);
+            
+            // NOTE(ojf): The sum doesn't allocate, so alloc doesn't change
+            // it, and it needs the pairs parsed once more if they were freed
+            if(ColdAlloc)
+            {
+                Pairs = AllocatePairStorage(Options->Layout, MaxPairCount, Options->Pages);
+                f64 IndexSeconds = 0;
+                PairCount = Pairs.Memory.Count ? ParsePairs(Options, InputJSON, MaxPairCount, &Pairs, &IndexSeconds) : 0;
+            }
+            
+            f64 Checksum = 0;
+            for(u32 Kernel = 0; PairCount && (Kernel <= (u32)GetBestHaversineKernel()); ++Kernel)
+            {
+                fprintf(stdout, "\n--- Sum (%s, %s, %s) ---\n", HaversineSumNames[Options->SumKind],
+                        HaversineKernelNames[Kernel], PairLayoutNames[Options->Layout]);
+                
+                repetition_tester SumTester = {};
+                NewTestWave(&SumTester, PairCount*sizeof(haversine_pair), CPUFreq, Options->RepeatSeconds);
+                while(IsTesting(&SumTester))
+                {
+                    BeginTime(&SumTester);
+                    if(Options->SumKind == HaversineSum_parallel)
+                    {
+                        Checksum += ParallelSumHaversineDistances((haversine_kernel)Kernel, PairCount, &Pairs,
+                                                                 EARTH_RADIUS, Options->ThreadCount);
+                    }
+                    else
+                    {
+                        Checksum += SumHaversineDistances((haversine_kernel)Kernel, PairCount, &Pairs);
+                    }
+                    EndTime(&SumTester);
+                    
+                    CountBytes(&SumTester, PairCount*sizeof(haversine_pair));
+                }
+                PrintResults(&SumTester);
+            }
+            
+            // NOTE(ojf): Printed so the timed sums can't be thrown away
+            fprintf(stdout, "\n(checksum %g)\n", Checksum);
+        }
+        
+        FreePairStorage(&Pairs);
+    }
+    else
+    {
+        fprintf(stderr, "ERROR: Malformed input JSON\n");
+    }
+    
+    FreeBuffer(&InputJSON);
 }
 
 int main(int ArgCount, char **Args)
 {
+    BeginProfile();
+    
     int Result = 1;
     
-    if((ArgCount == 2) || (ArgCount == 3))
+    haversine_options Options;
+    b32 ValidOptions = ParseOptions(ArgCount, Args, &Options);
+    if(ValidOptions && IsPairFile(Options.InputFileName))
+    {
+        RunHaversinePairFile(&Options);
+        Result = 0;
+    }
+    else if(ValidOptions && Options.RepeatSeconds)
+    {
+        RunRepetitionTests(&Options);
+        Result = 0;
+    }
+    else if(ValidOptions && (Options.Parser == HaversineParser_pipeline))
     {
-        buffer InputJSON = ReadEntireFile(Args[1]);
+        RunHaversinePipeline(&Options);
+        Result = 0;
+    }
+    else if(ValidOptions && Options.CompareInputs)
+    {
+        CompareInputStrategies(&Options);
+        Result = 0;
+    }
+    else if(ValidOptions)
+    {
+        u64 LoadStart = ReadOSTimer();
+        u64 LoadFaults = ReadOSPageFaultCount();
+        mapped_file Mapped = {};
+        buffer InputJSON = LoadInputJSON(Options.InputFileName, Options.Input, &Mapped);
+        f64 LoadSeconds = SecondsFromOSTimer(ReadOSTimer() - LoadStart);
+        LoadFaults = ReadOSPageFaultCount() - LoadFaults;
         
         u32 MinimumJSONPairEncoding = 6*4;
         u64 MaxPairCount = InputJSON.Count / MinimumJSONPairEncoding;
         if(MaxPairCount)
         {
-            buffer ParsedValues = AllocateBuffer(MaxPairCount * sizeof(haversine_pair));
-            if(ParsedValues.Count)
-            {
-                haversine_pair *Pairs = (haversine_pair *)ParsedValues.Data;
-                u64 PairCount = ParseHaversinePairs(InputJSON, MaxPairCount, Pairs);
-                f64 Sum = SumHaversineDistances(PairCount, Pairs);
+            pair_storage Pairs = AllocatePairStorage(Options.Layout, MaxPairCount, Options.Pages);
+            if(Pairs.Memory.Count)
+            {                
+                u64 ParseStart = ReadOSTimer();
+                u64 ParseFaults = ReadOSPageFaultCount();
+                f64 IndexSeconds = 0;
+                u64 PairCount = ParsePairs(&Options, InputJSON, MaxPairCount, &Pairs, &IndexSeconds);
+                f64 ParseSeconds = SecondsFromOSTimer(ReadOSTimer() - ParseStart);
+                ParseFaults = ReadOSPageFaultCount() - ParseFaults;
+                
+                u64 SumStart = ReadCPUTimer();
+                u64 SumOSStart = ReadOSTimer();
+                f64 Sum = 0;
+                {
+                    TimeBandwidth("Sum", PairCount*sizeof(haversine_pair));
+                    if(Options.SumKind == HaversineSum_parallel)
+                    {
+                        Sum = ParallelSumHaversineDistances(Options.Kernel, PairCount, &Pairs, EARTH_RADIUS, Options.ThreadCount);
+                    }
+                    else
+                    {
+                        Sum = SumHaversineDistances(Options.Kernel, PairCount, &Pairs);
+                    }
+                }
+                u64 SumCycles = ReadCPUTimer() - SumStart;
+                f64 SumSeconds = SecondsFromOSTimer(ReadOSTimer() - SumOSStart);
                 
                 fprintf(stdout, "Input size: %llu\n", InputJSON.Count);
                 fprintf(stdout, "Pair count: %llu\n", PairCount);
                 fprintf(stdout, "Haversine sum: %.16f\n", Sum);
                 
-                if(ArgCount == 3)
+                f64 InputGB = (f64)InputJSON.Count / (1024.0*1024.0*1024.0);
+                fprintf(stdout, "\nLoad (%s): %.4fs, %llu page faults\n",
+                        InputStrategyNames[Options.Input], LoadSeconds, LoadFaults);
+                fprintf(stdout, "Parse (%s): %.4fs, %.3fgb/s, %llu page faults, pairs on %s pages\n",
+                        HaversineParserNames[Options.Parser], ParseSeconds, InputGB / ParseSeconds,
+                        ParseFaults, PageKindNames[Pairs.Pages]);
+                if(Options.Parser == HaversineParser_simd)
+                {
+                    fprintf(stdout, "  Structural index (%s): %.4fs, %.3fgb/s\n",
+                            StructuralISANames[Options.ISA], IndexSeconds, InputGB / IndexSeconds);
+                    fprintf(stdout, "  Tokens and numbers: %.4fs\n", ParseSeconds - IndexSeconds);
+                }
+                fprintf(stdout, "Sum (%s, %s): %.4fs, %.2fm pairs/s, %.2f cycles/pair\n",
+                        HaversineKernelNames[Options.Kernel], PairLayoutNames[Options.Layout], SumSeconds,
+                        ((f64)PairCount / 1000000.0) / SumSeconds, (f64)SumCycles / (f64)PairCount);
+                if(Options.SumKind == HaversineSum_parallel)
+                {
+                    f64 SerialSum = SumHaversineDistances(Options.Kernel, PairCount, &Pairs);
+                    f64 Bound = ParallelSumErrorBound(PairCount, SerialSum);
+                    fprintf(stdout, "  Parallel on %u threads, serial sum differs by %.3e (bound %.3e)%s\n",
+                            Options.ThreadCount, Sum - SerialSum, Bound,
+                            (fabs(Sum - SerialSum) > Bound) ? " - OUTSIDE BOUND" : "");
+                }
+                fprintf(stdout, "Peak memory: %.2fmb\n", (f64)ReadPeakMemoryUsage() / (1024.0*1024.0));
+                
+                if(Options.CompareKernels)
                 {
-                    buffer AnswersF64 = ReadEntireFile(Args[2]);
+                    // NOTE(ojf): Only this table turns cycles into pairs/s, so only
+                    // it pays for calibrating
+                    u64 CPUFreq = EstimateCPUTimerFreq(100);
+                    
+                    fprintf(stdout, "\nHaversine kernels:\n");
+                    fprintf(stdout, "  Kernel   m pairs/s  cycles/pair  Speedup  Sum difference\n");
+                    
+                    u64 ScalarCycles = 0;
+                    for(u32 Kernel = 0; Kernel <= (u32)GetBestHaversineKernel(); ++Kernel)
+                    {
+                        // NOTE(ojf): Best of a few runs so one interrupt doesn't decide it
+                        u64 BestCycles = ~0ull;
+                        f64 KernelSum = 0;
+                        for(u32 Run = 0; Run < 4; ++Run)
+                        {
+                            u64 Start = ReadCPUTimer();
+                            KernelSum = SumHaversineDistances((haversine_kernel)Kernel, PairCount, &Pairs);
+                            u64 Cycles = ReadCPUTimer() - Start;
+                            if(Cycles < BestCycles)
+                            {
+                                BestCycles = Cycles;
+                            }
+                        }
+                        
+                        if(Kernel == HaversineKernel_scalar)
+                        {
+                            ScalarCycles = BestCycles;
+                        }
+                        
+                        fprintf(stdout, "  %-7s %10.2f  %11.2f  %6.2fx  %.3e\n", HaversineKernelNames[Kernel],
+                                ((f64)PairCount / 1000000.0) / ((f64)BestCycles / (f64)CPUFreq),
+                                (f64)BestCycles / (f64)PairCount, (f64)ScalarCycles / (f64)BestCycles,
+                                KernelSum - Sum);
+                    }
+                }
+                
+                if(Options.ReportScaling)
+                {
+                    fprintf(stdout, "\nChunked parse scaling:\n");
+                    fprintf(stdout, "  Threads  Chunks   Seconds     gb/s  Speedup\n");
+                    
+                    f64 SingleSeconds = 0;
+                    for(u32 ThreadCount = 1; ThreadCount <= Options.ThreadCount; ++ThreadCount)
+                    {
+                        u64 ScalingStart = ReadOSTimer();
+                        chunked_parse_result Chunked = ChunkedParseHaversinePairs(InputJSON, MaxPairCount, &Pairs, ThreadCount);
+                        f64 Seconds = SecondsFromOSTimer(ReadOSTimer() - ScalingStart);
+                        if(ThreadCount == 1)
+                        {
+                            SingleSeconds = Seconds;
+                        }
+                        
+                        fprintf(stdout, "  %7u  %6u  %8.4f  %7.3f  %6.2fx%s\n", ThreadCount, Chunked.ChunkCount,
+                                Seconds, InputGB / Seconds, SingleSeconds / Seconds,
+                                (Chunked.PairCount != PairCount) ? " (pair count differs!)" : "");
+                    }
+                }
+                
+                if(Options.ReportScaling && (Options.SumKind == HaversineSum_parallel))
+                {
+                    fprintf(stdout, "\nParallel sum scaling:\n");
+                    fprintf(stdout, "  Threads   Seconds  Speedup  Sum\n");
+                    
+                    f64 SingleSeconds = 0;
+                    for(u32 ThreadCount = 1; ThreadCount <= Options.ThreadCount; ++ThreadCount)
+                    {
+                        u64 ScalingStart = ReadOSTimer();
+                        f64 ThreadSum = ParallelSumHaversineDistances(Options.Kernel, PairCount, &Pairs, EARTH_RADIUS, ThreadCount);
+                        f64 Seconds = SecondsFromOSTimer(ReadOSTimer() - ScalingStart);
+                        if(ThreadCount == 1)
+                        {
+                            SingleSeconds = Seconds;
+                        }
+                        
+                        fprintf(stdout, "  %7u  %8.4f  %6.2fx  %s\n", ThreadCount, Seconds, SingleSeconds / Seconds,
+                                (memcmp(&ThreadSum, &Sum, sizeof(Sum)) == 0) ? "identical" : "DIFFERS");
+                    }
+                }
+                
+                if(Options.AnswersFileName)
+                {
+                    TimeBlock("Validate");
+                    
+                    buffer AnswersF64 = ReadEntireFile(Options.AnswersFileName);
                     if(AnswersF64.Count >= sizeof(f64))
                     {
                         f64 *AnswerValues = (f64 *)AnswersF64.Data;
@@ -141,27 +1028,106 @@ int main(int ArgCount, char **Args)
                         fprintf(stdout, "Reference sum: %.16f\n", RefSum);
                         fprintf(stdout, "Difference: %.16f\n", Sum - RefSum);
                         
+                        if(Options.Kernel != HaversineKernel_scalar)
+                        {
+                            u64 CheckCount = (PairCount < RefAnswerCount) ? PairCount : RefAnswerCount;
+                            buffer Distances = AllocateBuffer(PairCount*sizeof(f64) + 1);
+                            if(Distances.Count)
+                            {
+                                f64 *Dist = (f64 *)Distances.Data;
+                                HaversineWithStorage(Options.Kernel, PairCount, &Pairs, EARTH_RADIUS, Dist);
+                                
+                                f64 MaxPairDifference = 0;
+                                u64 MaxPairIndex = 0;
+                                u64 FailedPairCount = 0;
+                                for(u64 PairIndex = 0; PairIndex < CheckCount; ++PairIndex)
+                                {
+                                    f64 PairDifference = fabs(Dist[PairIndex] - AnswerValues[PairIndex]);
+                                    if(PairDifference > MaxPairDifference)
+                                    {
+                                        MaxPairDifference = PairDifference;
+                                        MaxPairIndex = PairIndex;
+                                    }
+                                    
+                                    if(PairDifference > HaversinePairTolerance(AnswerValues[PairIndex], EARTH_RADIUS))
+                                    {
+                                        ++FailedPairCount;
+                                    }
+                                }
+                                
+                                fprintf(stdout, "Max pair difference (%s): %.3e at pair %llu\n",
+                                        HaversineKernelNames[Options.Kernel], MaxPairDifference, MaxPairIndex);
+                                if(FailedPairCount || (fabs(Sum - RefSum) > HAVERSINE_SUM_TOLERANCE))
+                                {
+                                    fprintf(stdout, "FAILED - %llu pairs outside the %s kernel's tolerance.\n",
+                                            FailedPairCount, HaversineKernelNames[Options.Kernel]);
+                                }
+                            }
+                            FreeBuffer(&Distances);
+                        }
+                        
                         fprintf(stdout, "\n");
                     }
                 }
+                
+                if(Options.ConvertFileName)
+                {
+                    TimeBlock("Convert");
+                    u64 ConvertStart = ReadOSTimer();
+                    if(WritePairFile(Options.ConvertFileName, &Pairs, PairCount, InputJSON))
+                    {
+                        fprintf(stdout, "Wrote %llu pairs to %s in %.4fs\n", PairCount, Options.ConvertFileName,
+                                SecondsFromOSTimer(ReadOSTimer() - ConvertStart));
+                    }
+                }
             }
             
-            FreeBuffer(&ParsedValues);
+            FreePairStorage(&Pairs);
         }
         else
         {
             fprintf(stderr, "ERROR: Malformed input JSON\n");
         }
 
-        FreeBuffer(&InputJSON);
+        FreeInputJSON(&InputJSON, &Mapped);
         
         Result = 0;
     }
     else
     {
-        fprintf(stderr, "Usage: %s [haversine_input.json]\n", Args[0]);
-        fprintf(stderr, "       %s [haversine_input.json] [answers.f64]\n", Args[0]);
+        fprintf(stderr, "Usage: %s [options] [haversine_input.json]\n", Args[0]);
+        fprintf(stderr, "       %s [options] [haversine_input.json] [answers.f64]\n", Args[0]);
+        fprintf(stderr, "       %s [options] [haversine_input.pairs] [answers.f64]\n", Args[0]);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  -parser dom|stream|simd|chunked|pipeline\n");
+        fprintf(stderr, "                            pipeline reads, parses and sums in constant memory\n");
+        fprintf(stderr, "  -isa scalar|sse4.2|avx2   structural index instructions for -parser simd\n");
+        fprintf(stderr, "  -threads n                threads for -parser chunked and -sum parallel, default is one per core\n");
+        fprintf(stderr, "  -scaling                  also time -parser chunked and -sum parallel on 1 to n threads\n");
+        fprintf(stderr, "  -kernel scalar|custom|avx2|avx512\n");
+        fprintf(stderr, "                            default is scalar, the libm reference\n");
+        fprintf(stderr, "  -kernels                  also time every haversine kernel this CPU has\n");
+        fprintf(stderr, "  -layout aos|soa           pair storage the parser writes and the kernels read\n");
+        fprintf(stderr, "  -input read|mmap|populate|prefault\n");
+        fprintf(stderr, "                            how the input gets into memory, default is read\n");
+        fprintf(stderr, "  -pages normal|thp|huge    page kind for the pair array, falls back when unavailable\n");
+        fprintf(stderr, "  -inputs                   only time loading and parsing with every -input and -pages\n");
+        fprintf(stderr, "  -sum serial|parallel      parallel gives the same bits for any thread count\n");
+        fprintf(stderr, "  -repeat seconds           only repetition test load, parse and sum, each until no new\n");
+        fprintf(stderr, "                            minimum for that many seconds\n");
+        fprintf(stderr, "  -cold none|file|alloc|all with -repeat, drop the input from the page cache and/or\n");
+        fprintf(stderr, "                            allocate buffers fresh before every run\n");
+        fprintf(stderr, "  -convert file.pairs       also write the parsed pairs as a binary pair file, which is\n");
+        fprintf(stderr, "                            then summed straight from its mapping when given as the input\n");
+        fprintf(stderr, "  -verify                   check a pair file's column checksums before summing\n");
+    }
+    
+    if(ValidOptions)
+    {
+        EndAndPrintProfile(stdout);
     }
     
     return Result;
 }
+
+ProfilerEndOfCompilationUnit;
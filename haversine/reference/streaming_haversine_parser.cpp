@@ -0,0 +1,224 @@
+/* ========================================================================
+   Streaming haversine pair parser
+   ======================================================================== */
+
+/* NOTE(ojf): This walks the token stream once and writes each pair as soon
+   as its object closes, in whichever layout Storage uses, so no
+   json_element tree is ever built.  It only
+   understands the {"pairs":[{"x0":..,"y0":..,"x1":..,"y1":..},...]} shape
+   the generator writes; anything else at the top level is skipped.
+*/
+
+enum haversine_pair_field
+{
+    PairField_x0 = (1 << 0),
+    PairField_y0 = (1 << 1),
+    PairField_x1 = (1 << 2),
+    PairField_y1 = (1 << 3),
+
+    PairField_all = 0xf,
+};
+
+static u32 GetPairField(buffer Label)
+{
+    u32 Result = 0;
+    if((Label.Count == 2) && ((Label.Data[0] == 'x') || (Label.Data[0] == 'y')))
+    {
+        u32 Index = Label.Data[1] - (u8)'0';
+        if(Index < 2)
+        {
+            Result = 1 << (2*Index + (Label.Data[0] == 'y'));
+        }
+    }
+
+    return Result;
+}
+
+static void SkipJSONValue(json_parser *Parser, json_token Value)
+{
+    if((Value.Type == Token_open_brace) || (Value.Type == Token_open_bracket))
+    {
+        u32 Depth = 1;
+        while(Depth && IsParsing(Parser))
+        {
+            json_token Token = GetJSONToken(Parser);
+            if((Token.Type == Token_open_brace) || (Token.Type == Token_open_bracket))
+            {
+                ++Depth;
+            }
+            else if((Token.Type == Token_close_brace) || (Token.Type == Token_close_bracket))
+            {
+                --Depth;
+            }
+            else if(Token.Type == Token_error)
+            {
+                Error(Parser, Token, "Unexpected token in JSON");
+            }
+        }
+    }
+    else if((Value.Type != Token_string_literal) &&
+            (Value.Type != Token_number) &&
+            (Value.Type != Token_true) &&
+            (Value.Type != Token_false) &&
+            (Value.Type != Token_null))
+    {
+        Error(Parser, Value, "Unexpected token in JSON");
+    }
+}
+
+// NOTE(ojf): Called after the opening brace has been consumed
+static b32 StreamParsePairObject(json_parser *Parser, haversine_pair *Pair)
+{
+    u32 FieldsSeen = 0;
+
+    json_token Token = GetJSONToken(Parser);
+    while(IsParsing(Parser) && (Token.Type != Token_close_brace))
+    {
+        if(Token.Type != Token_string_literal)
+        {
+            Error(Parser, Token, "Expected field name in pair");
+            break;
+        }
+
+        buffer Label = Token.Value;
+        json_token Colon = GetJSONToken(Parser);
+        if(Colon.Type != Token_colon)
+        {
+            Error(Parser, Colon, "Expected colon after field name");
+            break;
+        }
+
+        json_token Value = GetJSONToken(Parser);
+        u32 Field = GetPairField(Label);
+        if(Field && (Value.Type == Token_number))
+        {
+            f64 Number = ConvertJSONNumberToF64(Value.Value);
+            switch(Field)
+            {
+                case PairField_x0: {Pair->X0 = Number;} break;
+                case PairField_y0: {Pair->Y0 = Number;} break;
+                case PairField_x1: {Pair->X1 = Number;} break;
+                case PairField_y1: {Pair->Y1 = Number;} break;
+            }
+            FieldsSeen |= Field;
+        }
+        else
+        {
+            SkipJSONValue(Parser, Value);
+        }
+
+        Token = GetJSONToken(Parser);
+        if(Token.Type == Token_comma)
+        {
+            Token = GetJSONToken(Parser);
+        }
+        else if(Token.Type != Token_close_brace)
+        {
+            Error(Parser, Token, "Expected comma or closing brace in pair");
+        }
+    }
+
+    // NOTE(ojf): Missing fields read as 0, the same as the DOM parser
+    if(!(FieldsSeen & PairField_x0)) Pair->X0 = 0;
+    if(!(FieldsSeen & PairField_y0)) Pair->Y0 = 0;
+    if(!(FieldsSeen & PairField_x1)) Pair->X1 = 0;
+    if(!(FieldsSeen & PairField_y1)) Pair->Y1 = 0;
+
+    b32 Result = !Parser->HadError;
+    return Result;
+}
+
+// NOTE(ojf): Called after the opening bracket has been consumed
+static u64 StreamParsePairsArray(json_parser *Parser, u64 MaxPairCount, pair_storage *Storage)
+{
+    u64 PairCount = 0;
+
+    json_token Token = GetJSONToken(Parser);
+    while(IsParsing(Parser) && (Token.Type != Token_close_bracket))
+    {
+        if((Token.Type == Token_open_brace) && (PairCount < MaxPairCount))
+        {
+            haversine_pair Pair;
+            if(StreamParsePairObject(Parser, &Pair))
+            {
+                StorePair(Storage, PairCount++, Pair);
+            }
+        }
+        else
+        {
+            SkipJSONValue(Parser, Token);
+        }
+
+        Token = GetJSONToken(Parser);
+        if(Token.Type == Token_comma)
+        {
+            Token = GetJSONToken(Parser);
+        }
+        else if(Token.Type != Token_close_bracket)
+        {
+            Error(Parser, Token, "Expected comma or closing bracket in pairs");
+        }
+    }
+
+    return PairCount;
+}
+
+// NOTE(ojf): Index can be 0, in which case the input is tokenized byte by byte
+static u64 StreamParseHaversinePairs(buffer InputJSON, u64 MaxPairCount, pair_storage *Storage,
+                                     structural_index *Index)
+{
+    u64 PairCount = 0;
+
+    json_parser Parser = {};
+    Parser.Source = InputJSON;
+    Parser.Index = Index;
+
+    json_token Token = GetJSONToken(&Parser);
+    if(Token.Type == Token_open_brace)
+    {
+        Token = GetJSONToken(&Parser);
+        while(IsParsing(&Parser) && (Token.Type != Token_close_brace))
+        {
+            if(Token.Type != Token_string_literal)
+            {
+                Error(&Parser, Token, "Expected field name");
+                break;
+            }
+
+            buffer Label = Token.Value;
+            json_token Colon = GetJSONToken(&Parser);
+            if(Colon.Type != Token_colon)
+            {
+                Error(&Parser, Colon, "Expected colon after field name");
+                break;
+            }
+
+            json_token Value = GetJSONToken(&Parser);
+            if(AreEqual(Label, CONSTANT_STRING("pairs")) && (Value.Type == Token_open_bracket))
+            {
+                pair_storage Rest = OffsetPairStorage(Storage, PairCount);
+                PairCount += StreamParsePairsArray(&Parser, MaxPairCount - PairCount, &Rest);
+            }
+            else
+            {
+                SkipJSONValue(&Parser, Value);
+            }
+
+            Token = GetJSONToken(&Parser);
+            if(Token.Type == Token_comma)
+            {
+                Token = GetJSONToken(&Parser);
+            }
+            else if(Token.Type != Token_close_brace)
+            {
+                Error(&Parser, Token, "Expected comma or closing brace");
+            }
+        }
+    }
+    else
+    {
+        Error(&Parser, Token, "Expected top level object");
+    }
+
+    return PairCount;
+}
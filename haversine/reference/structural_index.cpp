@@ -0,0 +1,403 @@
+/* ========================================================================
+   Vectorized structural index for the JSON tokenizer
+   ======================================================================== */
+
+/* NOTE(ojf): Stage 1 of the two stage tokenizer.  The input is read 64
+   bytes at a time and turned into bitmasks - one bit per byte - of
+   whitespace, operators ({}[],:;), quotes and backslashes.  Escaped quotes
+   are removed with carry arithmetic on the backslash mask, and a prefix XOR
+   of the remaining quotes (a carry-less multiply by all ones) gives the
+   bytes that are inside strings.  Whatever is left - operators, opening
+   quotes and the first byte of every number or keyword - is written out as
+   a list of positions that GetIndexedJSONToken walks instead of the bytes.
+
+   The classification is done with two 16 entry nibble tables: every
+   interesting byte has a class bit set in both the table for its low
+   nibble and the table for its high nibble, so a PSHUFB of each nibble and
+   an AND classifies 16 or 32 bytes at once.
+*/
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+static u32 CountSetBits64(u64 Value)
+{
+    return (u32)__popcnt64(Value);
+}
+
+static u32 CountTrailingZeros64(u64 Value)
+{
+    unsigned long Index;
+    _BitScanForward64(&Index, Value);
+    return Index;
+}
+#else
+static u32 CountSetBits64(u64 Value)
+{
+    return __builtin_popcountll(Value);
+}
+
+static u32 CountTrailingZeros64(u64 Value)
+{
+    return __builtin_ctzll(Value);
+}
+#endif
+
+#define STRUCTURAL_BLOCK_SIZE 64
+
+enum structural_class
+{
+    StructuralClass_comma = (1 << 0),
+    StructuralClass_colon = (1 << 1),  // : and ;
+    StructuralClass_bracket = (1 << 2),  // [ ] { }
+    StructuralClass_space = (1 << 3),
+    StructuralClass_control = (1 << 4),  // \t \n \r
+
+    StructuralClass_op = StructuralClass_comma|StructuralClass_colon|StructuralClass_bracket,
+    StructuralClass_whitespace = StructuralClass_space|StructuralClass_control,
+};
+
+static u8 const StructuralLowNibbleClasses[16] =
+{
+    StructuralClass_space, 0, 0, 0, 0, 0, 0, 0,
+    0, StructuralClass_control,
+    StructuralClass_colon|StructuralClass_control,   // : \n
+    StructuralClass_colon|StructuralClass_bracket,   // ; [ {
+    StructuralClass_comma,                           // ,
+    StructuralClass_bracket|StructuralClass_control, // ] } \r
+    0, 0,
+};
+
+static u8 const StructuralHighNibbleClasses[16] =
+{
+    StructuralClass_control, 0,
+    StructuralClass_comma|StructuralClass_space,
+    StructuralClass_colon, 0,
+    StructuralClass_bracket, 0,
+    StructuralClass_bracket,
+    0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+enum structural_index_isa
+{
+    StructuralISA_scalar,
+    StructuralISA_sse42,
+    StructuralISA_avx2,
+};
+
+static char const *StructuralISANames[] = {"scalar", "sse4.2", "avx2"};
+
+struct structural_index
+{
+    memory_arena Arena;
+    u32 *Positions;
+    u64 Count;  // Not including the end of input sentinel after the last position
+    b32 UnclosedString;
+    structural_index_isa ISA;
+};
+
+struct structural_block_masks
+{
+    u64 Whitespace;
+    u64 Op;
+    u64 Quote;
+    u64 Backslash;
+};
+
+// NOTE(ojf): Everything that has to carry from one block into the next
+struct structural_scanner
+{
+    u64 PrevEscaped;
+    u64 PrevInString;
+    u64 PrevScalar;
+};
+
+static structural_index_isa GetBestStructuralISA(void)
+{
+    structural_index_isa Result = StructuralISA_scalar;
+
+    cpu_features Features = GetCPUFeatures();
+    if(Features.AVX2 && Features.PCLMUL)
+    {
+        Result = StructuralISA_avx2;
+    }
+    else if(Features.SSE42 && Features.PCLMUL)
+    {
+        Result = StructuralISA_sse42;
+    }
+
+    return Result;
+}
+
+// NOTE(ojf): Returns the bit of every quote that isn't escaped.  A quote is
+// escaped when it follows an odd length run of backslashes, which is found
+// by adding the start of each run to the run and looking at which parity of
+// bit the carry lands on.
+static u64 FindUnescapedQuotes(structural_scanner *Scanner, structural_block_masks *Masks)
+{
+    u64 const OddBits = 0xAAAAAAAAAAAAAAAAull;
+
+    u64 Escaped = Scanner->PrevEscaped;
+    Scanner->PrevEscaped = 0;
+    if(Masks->Backslash)
+    {
+        u64 Backslash = Masks->Backslash & ~Escaped;
+        u64 FollowsEscape = (Backslash << 1) | OddBits;
+        u64 EvenSeriesAndOddBits = FollowsEscape - Backslash;
+        u64 EscapeAndTerminal = EvenSeriesAndOddBits ^ OddBits;
+
+        Escaped = EscapeAndTerminal ^ (Masks->Backslash | Escaped);
+        Scanner->PrevEscaped = (EscapeAndTerminal & Masks->Backslash) >> 63;
+    }
+
+    u64 Result = Masks->Quote & ~Escaped;
+    return Result;
+}
+
+static u64 PrefixXorScalar(u64 Bits)
+{
+    Bits ^= Bits << 1;
+    Bits ^= Bits << 2;
+    Bits ^= Bits << 4;
+    Bits ^= Bits << 8;
+    Bits ^= Bits << 16;
+    Bits ^= Bits << 32;
+    return Bits;
+}
+
+// NOTE(ojf): InString has the opening quote of each string set and the
+// closing quote clear
+static u64 FindStructurals(structural_scanner *Scanner, structural_block_masks *Masks,
+                           u64 Quote, u64 InString)
+{
+    InString ^= Scanner->PrevInString;
+    Scanner->PrevInString = (u64)((i64)InString >> 63);
+
+    // NOTE(ojf): A scalar is anything that isn't an operator or whitespace,
+    // and it starts a token unless the byte before it was also part of one.
+    // Quotes don't continue a scalar, so "a""b" is two tokens.
+    u64 Scalar = ~(Masks->Op | Masks->Whitespace);
+    u64 NonQuoteScalar = Scalar & ~Quote;
+    u64 FollowsScalar = (NonQuoteScalar << 1) | Scanner->PrevScalar;
+    Scanner->PrevScalar = NonQuoteScalar >> 63;
+    u64 ScalarStart = Scalar & ~FollowsScalar;
+
+    // NOTE(ojf): The string body and its closing quote are never structural,
+    // but the opening quote is
+    u64 StringTail = InString ^ Quote;
+
+    u64 Result = (Masks->Op | ScalarStart) & ~StringTail;
+    return Result;
+}
+
+static void WriteStructurals(structural_index *Index, u32 BlockStart, u64 Bits)
+{
+    u32 *Out = Index->Positions + Index->Count;
+    Index->Count += CountSetBits64(Bits);
+
+    // NOTE(ojf): Writes in groups of four and lets the last group run past
+    // the real count, the block commit guarantees room for 64 more entries
+    while(Bits)
+    {
+        Out[0] = BlockStart + CountTrailingZeros64(Bits); Bits &= Bits - 1;
+        Out[1] = BlockStart + CountTrailingZeros64(Bits | (1ull << 63)); Bits &= Bits - 1;
+        Out[2] = BlockStart + CountTrailingZeros64(Bits | (1ull << 63)); Bits &= Bits - 1;
+        Out[3] = BlockStart + CountTrailingZeros64(Bits | (1ull << 63)); Bits &= Bits - 1;
+        Out += 4;
+    }
+}
+
+static void ClassifyBlockScalar(u8 *Block, structural_block_masks *Masks)
+{
+    *Masks = {};
+    for(u32 Index = 0; Index < STRUCTURAL_BLOCK_SIZE; ++Index)
+    {
+        u8 Val = Block[Index];
+        u8 Class = StructuralLowNibbleClasses[Val & 0xf] & StructuralHighNibbleClasses[Val >> 4];
+        u64 Bit = 1ull << Index;
+        if(Class & StructuralClass_whitespace) Masks->Whitespace |= Bit;
+        if(Class & StructuralClass_op) Masks->Op |= Bit;
+        if(Val == '"') Masks->Quote |= Bit;
+        if(Val == '\\') Masks->Backslash |= Bit;
+    }
+}
+
+static void ScanStructuralBlockScalar(structural_index *Index, structural_scanner *Scanner,
+                                      u8 *Block, u32 BlockStart)
+{
+    structural_block_masks Masks;
+    ClassifyBlockScalar(Block, &Masks);
+    u64 Quote = FindUnescapedQuotes(Scanner, &Masks);
+    u64 Structurals = FindStructurals(Scanner, &Masks, Quote, PrefixXorScalar(Quote));
+    WriteStructurals(Index, BlockStart, Structurals);
+}
+
+#if CPU_FEATURES_X64
+
+TARGET_FEATURES("pclmul")
+static u64 PrefixXorCLMUL(u64 Bits)
+{
+    __m128i AllOnes = _mm_set1_epi8((char)0xff);
+    __m128i Product = _mm_clmulepi64_si128(_mm_set_epi64x(0, (i64)Bits), AllOnes, 0);
+    u64 Result = (u64)_mm_cvtsi128_si64(Product);
+    return Result;
+}
+
+TARGET_FEATURES("sse4.2")
+static u64 Classify16(__m128i Bytes, __m128i LowTable, __m128i HighTable, u8 ClassMask)
+{
+    __m128i Low = _mm_shuffle_epi8(LowTable, _mm_and_si128(Bytes, _mm_set1_epi8(0xf)));
+    __m128i High = _mm_shuffle_epi8(HighTable, _mm_and_si128(_mm_srli_epi16(Bytes, 4), _mm_set1_epi8(0xf)));
+    __m128i Class = _mm_and_si128(_mm_and_si128(Low, High), _mm_set1_epi8((char)ClassMask));
+    u64 Result = (uint16_t)~_mm_movemask_epi8(_mm_cmpeq_epi8(Class, _mm_setzero_si128()));
+    return Result;
+}
+
+TARGET_FEATURES("sse4.2")
+static u64 Match16(__m128i Bytes, char Val)
+{
+    u64 Result = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Bytes, _mm_set1_epi8(Val)));
+    return Result;
+}
+
+TARGET_FEATURES("sse4.2,pclmul")
+static void ScanStructuralBlockSSE42(structural_index *Index, structural_scanner *Scanner,
+                                     u8 *Block, u32 BlockStart)
+{
+    __m128i LowTable = _mm_loadu_si128((__m128i *)StructuralLowNibbleClasses);
+    __m128i HighTable = _mm_loadu_si128((__m128i *)StructuralHighNibbleClasses);
+
+    structural_block_masks Masks = {};
+    for(u32 Lane = 0; Lane < 4; ++Lane)
+    {
+        __m128i Bytes = _mm_loadu_si128((__m128i *)(Block + 16*Lane));
+        Masks.Whitespace |= Classify16(Bytes, LowTable, HighTable, StructuralClass_whitespace) << (16*Lane);
+        Masks.Op |= Classify16(Bytes, LowTable, HighTable, StructuralClass_op) << (16*Lane);
+        Masks.Quote |= Match16(Bytes, '"') << (16*Lane);
+        Masks.Backslash |= Match16(Bytes, '\\') << (16*Lane);
+    }
+
+    u64 Quote = FindUnescapedQuotes(Scanner, &Masks);
+    u64 Structurals = FindStructurals(Scanner, &Masks, Quote, PrefixXorCLMUL(Quote));
+    WriteStructurals(Index, BlockStart, Structurals);
+}
+
+TARGET_FEATURES("avx2")
+static u64 Classify32(__m256i Bytes, __m256i LowTable, __m256i HighTable, u8 ClassMask)
+{
+    __m256i Low = _mm256_shuffle_epi8(LowTable, _mm256_and_si256(Bytes, _mm256_set1_epi8(0xf)));
+    __m256i High = _mm256_shuffle_epi8(HighTable, _mm256_and_si256(_mm256_srli_epi16(Bytes, 4), _mm256_set1_epi8(0xf)));
+    __m256i Class = _mm256_and_si256(_mm256_and_si256(Low, High), _mm256_set1_epi8((char)ClassMask));
+    u64 Result = (u32)~_mm256_movemask_epi8(_mm256_cmpeq_epi8(Class, _mm256_setzero_si256()));
+    return Result;
+}
+
+TARGET_FEATURES("avx2")
+static u64 Match32(__m256i Bytes, char Val)
+{
+    u64 Result = (u32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Bytes, _mm256_set1_epi8(Val)));
+    return Result;
+}
+
+TARGET_FEATURES("avx2,pclmul")
+static void ScanStructuralBlockAVX2(structural_index *Index, structural_scanner *Scanner,
+                                    u8 *Block, u32 BlockStart)
+{
+    __m256i LowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)StructuralLowNibbleClasses));
+    __m256i HighTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((__m128i *)StructuralHighNibbleClasses));
+
+    __m256i Lo = _mm256_loadu_si256((__m256i *)Block);
+    __m256i Hi = _mm256_loadu_si256((__m256i *)(Block + 32));
+
+    structural_block_masks Masks;
+    Masks.Whitespace = (Classify32(Lo, LowTable, HighTable, StructuralClass_whitespace) |
+                        (Classify32(Hi, LowTable, HighTable, StructuralClass_whitespace) << 32));
+    Masks.Op = (Classify32(Lo, LowTable, HighTable, StructuralClass_op) |
+                (Classify32(Hi, LowTable, HighTable, StructuralClass_op) << 32));
+    Masks.Quote = Match32(Lo, '"') | (Match32(Hi, '"') << 32);
+    Masks.Backslash = Match32(Lo, '\\') | (Match32(Hi, '\\') << 32);
+
+    u64 Quote = FindUnescapedQuotes(Scanner, &Masks);
+    u64 Structurals = FindStructurals(Scanner, &Masks, Quote, PrefixXorCLMUL(Quote));
+    WriteStructurals(Index, BlockStart, Structurals);
+}
+
+#endif
+
+typedef void scan_structural_block(structural_index *Index, structural_scanner *Scanner,
+                                   u8 *Block, u32 BlockStart);
+
+// NOTE(ojf): Positions are 32 bits, so inputs of 4gb and up return false and
+// should go through GetJSONToken instead
+static b32 BuildStructuralIndex(buffer Source, structural_index *Index, structural_index_isa ISA)
+{
+    *Index = {};
+    Index->ISA = ISA;
+
+    if(Source.Count >= 0xffffffffull)
+    {
+        return false;
+    }
+
+    // NOTE(ojf): Every byte could be structural in the worst case, but real
+    // input uses a small fraction, so the index is reserved at full size and
+    // committed as it fills
+    u64 MaxPositions = Source.Count + 2*STRUCTURAL_BLOCK_SIZE;
+    Index->Arena = ReserveArena(MaxPositions*sizeof(u32));
+    Index->Positions = (u32 *)Index->Arena.Base;
+    if(!Index->Positions)
+    {
+        return false;
+    }
+
+    scan_structural_block *ScanBlock = ScanStructuralBlockScalar;
+#if CPU_FEATURES_X64
+    if(ISA == StructuralISA_avx2) ScanBlock = ScanStructuralBlockAVX2;
+    if(ISA == StructuralISA_sse42) ScanBlock = ScanStructuralBlockSSE42;
+#endif
+
+    structural_scanner Scanner = {};
+    u64 Committed = 0;
+    u64 At = 0;
+    while(At < Source.Count)
+    {
+        u64 Needed = (Index->Count + 2*STRUCTURAL_BLOCK_SIZE)*sizeof(u32);
+        if(Needed > Committed)
+        {
+            if(!CommitArena(&Index->Arena, Needed))
+            {
+                ReleaseArena(&Index->Arena);
+                *Index = {};
+                return false;
+            }
+            Committed = Index->Arena.Committed;
+        }
+
+        if((Source.Count - At) >= STRUCTURAL_BLOCK_SIZE)
+        {
+            ScanBlock(Index, &Scanner, Source.Data + At, (u32)At);
+        }
+        else
+        {
+            // NOTE(ojf): Whitespace padding can't start or end a token
+            u8 Tail[STRUCTURAL_BLOCK_SIZE];
+            memset(Tail, ' ', sizeof(Tail));
+            memcpy(Tail, Source.Data + At, Source.Count - At);
+            ScanBlock(Index, &Scanner, Tail, (u32)At);
+        }
+
+        At += STRUCTURAL_BLOCK_SIZE;
+    }
+
+    // NOTE(ojf): The sentinel lets stage 2 find the end of the last token
+    // the same way as every other one
+    Index->Positions[Index->Count] = (u32)Source.Count;
+    Index->UnclosedString = (Scanner.PrevInString != 0);
+
+    return true;
+}
+
+static void FreeStructuralIndex(structural_index *Index)
+{
+    ReleaseArena(&Index->Arena);
+    *Index = {};
+}
@@ -1,41 +1,82 @@
 const std = @import("std");
+const root = @import("root");
 const print = std.debug.print;
 const win = std.os.windows;
 
-const NUM_TIMER_SLOTS = 64;
+//- ojf: `pub const perf_enabled = false;` in the root file compiles every
+// timer out (parser.zig takes it from the perf build option).  TimerFrame
+// is empty and timeBlock/stopTimer are empty, so instrumented code is
+// exactly what it would be without them, and only the total time gets
+// printed.
+pub const enabled: bool = if (@hasDecl(root, "perf_enabled")) root.perf_enabled else true;
+
+const NUM_TIMER_SLOTS = 1024;
 const MAX_STACK_DEPTH = 4096;
+const MAX_PROFILED_THREADS = 64;
 
 const TimerSlot = struct {
-    total_time: u64,
-    children_time: u64,
-    hits: u64,
-
-    name: []const u8,
-    is_func: bool,
+    total_time: u64 = 0,
+    children_time: u64 = 0,
+    hits: u64 = 0,
 };
 
-pub const TimerFrame = struct {
+//- ojf: one per finished block when tracing, the timeline gets written from
+// these at the end.  24 bytes, so a store and a compare is all recording
+// adds to stopTimer.
+const TraceEvent = struct {
     start_time: u64,
+    end_time: u64,
     index: u16,
-    name: []const u8,
-    is_func: bool,
 };
 
+const SlotInfo = struct {
+    name: []const u8 = "",
+    is_func: bool = false,
+};
+
+//- ojf: every thread that times anything gets one of these to itself, so
+// starting and stopping a timer never touches anything another thread
+// writes.  they're in a global pool and not threadlocal, so a worker's
+// timings are still there to merge after it exits.
+const ThreadTimers = struct {
+    slots: [NUM_TIMER_SLOTS]TimerSlot = [_]TimerSlot{.{}} ** NUM_TIMER_SLOTS,
+    callstack: [MAX_STACK_DEPTH]u16 = [_]u16{0} ** MAX_STACK_DEPTH,
+    callstack_depth: u16 = 1,
+
+    //- ojf: allocated once when the thread gets its table, never grown, so
+    // a full buffer just counts what it drops
+    events: []TraceEvent = &.{},
+    event_count: usize = 0,
+    dropped_events: u64 = 0,
+};
+
+pub const TimerFrame = if (enabled) struct {
+    start_time: u64,
+    index: u16,
+} else struct {};
+
 const PerfTimerState = struct {
     var cpu_timer_frequency: f64 = 0.0;
     var global_start: u64 = undefined;
-    var timer_slots = [_]TimerSlot{TimerSlot{
-        .total_time = 0,
-        .children_time = 0,
-        .hits = 0,
-        .name = "",
-        .is_func = false,
-    }} ** NUM_TIMER_SLOTS;
-
-    var callstack = [_]u16{0} ** MAX_STACK_DEPTH;
-    var callstack_depth: u16 = 1;
 
+    //- ojf: slot indices are per name, not per thread, so every thread's
+    // table lines up and merging is just adding slot by slot
+    var slot_info = [_]SlotInfo{.{}} ** NUM_TIMER_SLOTS;
     var next_slot: u16 = 1;
+
+    var threads = [_]ThreadTimers{.{}} ** (if (enabled) MAX_PROFILED_THREADS else 0);
+    var thread_count: u16 = 0;
+
+    //- ojf: only taken the first time a name or a thread shows up
+    var mutex = std.Thread.Mutex{};
+
+    threadlocal var this_thread: ?*ThreadTimers = null;
+
+    //- ojf: a copy, since the caller's path is usually freed before the
+    // deferred stopTimersAndLog gets to it
+    var trace_path_buffer: [std.fs.MAX_PATH_BYTES]u8 = undefined;
+    var trace_path: ?[]const u8 = null;
+    var trace_capacity: usize = 0;
 };
 
 const TimerOptions = struct {
@@ -74,22 +115,42 @@ pub fn calibrateTimer(calibrationMilliseconds: u64) void {
     PerfTimerState.cpu_timer_frequency = @floatFromInt(cpu_time * os_timer_frequency / os_time);
 }
 
+///- ojf: only call this while no other thread is timing anything.  threads
+// keep their tables, only the timings in them are cleared.
 pub fn resetTimers(options: TimerOptions) void {
     if (@abs(PerfTimerState.cpu_timer_frequency) < std.math.floatEps(f64)) {
         calibrateTimer(options.calibration_millis);
     }
 
-    PerfTimerState.timer_slots = [_]TimerSlot{TimerSlot{
-        .total_time = 0,
-        .children_time = 0,
-        .hits = 0,
-        .name = "",
-        .is_func = false,
-    }} ** NUM_TIMER_SLOTS;
-    PerfTimerState.next_slot = 1;
+    for (&PerfTimerState.threads) |*timers| {
+        timers.slots = [_]TimerSlot{.{}} ** NUM_TIMER_SLOTS;
+        timers.callstack_depth = 1;
+        timers.event_count = 0;
+        timers.dropped_events = 0;
+    }
     PerfTimerState.global_start = getCpuTime();
 }
 
+///- ojf: from here on every block that finishes is also recorded as an
+// event, and stopTimersAndLog writes them to `path` as chrome trace-event
+// json, which chrome://tracing and ui.perfetto.dev both open.  like
+// resetTimers, only call this while no other thread is timing anything.
+pub fn startTrace(path: []const u8, events_per_thread: usize) void {
+    if (!enabled) {
+        return;
+    }
+
+    std.debug.assert(path.len <= PerfTimerState.trace_path_buffer.len);
+    const length = @min(path.len, PerfTimerState.trace_path_buffer.len);
+    @memcpy(PerfTimerState.trace_path_buffer[0..length], path[0..length]);
+
+    PerfTimerState.trace_path = PerfTimerState.trace_path_buffer[0..length];
+    PerfTimerState.trace_capacity = events_per_thread;
+    for (PerfTimerState.threads[0..PerfTimerState.thread_count]) |*timers| {
+        allocateTraceEvents(timers);
+    }
+}
+
 pub fn timeFunction(comptime src_location: std.builtin.SourceLocation) TimerFrame {
     const name = comptime n: {
         const file = src_location.file;
@@ -97,11 +158,57 @@ pub fn timeFunction(comptime src_location: std.builtin.SourceLocation) TimerFram
 
         break :n file[0..ext_index] ++ "." ++ src_location.fn_name;
     };
-    return timeBlock_internal(name, true);
+    return if (enabled) timeBlock_internal(name, true) else .{};
 }
 
 pub fn timeBlock(comptime name: []const u8) TimerFrame {
-    return timeBlock_internal(name, false);
+    return if (enabled) timeBlock_internal(name, false) else .{};
+}
+
+pub const stopTimer = if (enabled) stopTimer_internal else stopTimer_disabled;
+
+fn allocateTraceEvents(timers: *ThreadTimers) void {
+    if (timers.events.len < PerfTimerState.trace_capacity) {
+        if (timers.events.len != 0) {
+            std.heap.page_allocator.free(timers.events);
+        }
+        timers.events = std.heap.page_allocator.alloc(TraceEvent, PerfTimerState.trace_capacity) catch &.{};
+    }
+}
+
+fn threadTimers() *ThreadTimers {
+    if (PerfTimerState.this_thread) |timers| {
+        return timers;
+    }
+
+    PerfTimerState.mutex.lock();
+    defer PerfTimerState.mutex.unlock();
+
+    std.debug.assert(PerfTimerState.thread_count < PerfTimerState.threads.len);
+    const timers = &PerfTimerState.threads[PerfTimerState.thread_count];
+    PerfTimerState.thread_count += 1;
+    PerfTimerState.this_thread = timers;
+    allocateTraceEvents(timers);
+
+    return timers;
+}
+
+fn assignSlot(idx: *u16, comptime name: []const u8, is_func: bool) u16 {
+    PerfTimerState.mutex.lock();
+    defer PerfTimerState.mutex.unlock();
+
+    //- ojf: another thread may have got the lock first with the same name
+    if (idx.* == 0) {
+        std.debug.assert(PerfTimerState.next_slot < NUM_TIMER_SLOTS);
+        PerfTimerState.slot_info[PerfTimerState.next_slot] = .{
+            .name = name,
+            .is_func = is_func,
+        };
+        @atomicStore(u16, idx, PerfTimerState.next_slot, .release);
+        PerfTimerState.next_slot += 1;
+    }
+
+    return idx.*;
 }
 
 fn timeBlock_internal(comptime name: []const u8, is_func: bool) TimerFrame {
@@ -139,51 +246,52 @@ fn timeBlock_internal(comptime name: []const u8, is_func: bool) TimerFrame {
     }.idx;
 
     //- ojf: if it's 0, we know that this is a unique invocation of the function
-    if (fucked_idx.* == 0) {
-        std.debug.assert(PerfTimerState.next_slot < PerfTimerState.timer_slots.len);
-        fucked_idx.* = PerfTimerState.next_slot;
-        PerfTimerState.next_slot += 1;
+    var index = @atomicLoad(u16, fucked_idx, .acquire);
+    if (index == 0) {
+        index = assignSlot(fucked_idx, name, is_func);
     }
 
-    const index = fucked_idx.*;
-
-    PerfTimerState.callstack[PerfTimerState.callstack_depth] = index;
-    PerfTimerState.callstack_depth += 1;
+    const timers = threadTimers();
+    timers.callstack[timers.callstack_depth] = index;
+    timers.callstack_depth += 1;
 
     return TimerFrame{
         .start_time = getCpuTime(),
         .index = index,
-        .name = name,
-        .is_func = is_func,
     };
 }
 
-///- ojf: old function to check hack overhead
-fn timeBlock_internal_old(comptime name: []const u8, is_func: bool) u16 {
-    const index = PerfTimerState.next_slot;
-
-    PerfTimerState.timer_slots[index].name = name;
-    PerfTimerState.timer_slots[index].end_time = 0;
-    PerfTimerState.timer_slots[index].start_time = getCpuTime();
-    PerfTimerState.timer_slots[index].is_func = is_func;
-
-    return index;
-}
-
-pub fn stopTimer(frame: TimerFrame) void {
-    PerfTimerState.callstack_depth -= 1;
-
+fn stopTimer_internal(frame: TimerFrame) void {
     const end_time = getCpuTime();
 
-    const index = frame.index;
+    //- ojf: this thread started the timer, so it already has a table
+    const timers = PerfTimerState.this_thread.?;
+    timers.callstack_depth -= 1;
+
     const total_time = @subWithOverflow(end_time, frame.start_time)[0];
-    PerfTimerState.timer_slots[index].name = frame.name;
-    PerfTimerState.timer_slots[index].is_func = frame.is_func;
-    PerfTimerState.timer_slots[index].total_time += total_time;
-    PerfTimerState.timer_slots[index].hits += 1;
+    const slot = &timers.slots[frame.index];
+    slot.total_time += total_time;
+    slot.hits += 1;
+
+    const parent_index = timers.callstack[timers.callstack_depth - 1];
+    timers.slots[parent_index].children_time += total_time;
+
+    if (PerfTimerState.trace_capacity != 0) {
+        if (timers.event_count < timers.events.len) {
+            timers.events[timers.event_count] = .{
+                .start_time = frame.start_time,
+                .end_time = end_time,
+                .index = frame.index,
+            };
+            timers.event_count += 1;
+        } else {
+            timers.dropped_events += 1;
+        }
+    }
+}
 
-    const parent_index = PerfTimerState.callstack[PerfTimerState.callstack_depth - 1];
-    PerfTimerState.timer_slots[parent_index].children_time += total_time;
+fn stopTimer_disabled(frame: TimerFrame) void {
+    _ = frame;
 }
 
 fn printTimerResults(name: []const u8, is_func: bool, hits: u64, clocks: f64, percent: f64) void {
@@ -207,6 +315,9 @@ fn printTimerResults(name: []const u8, is_func: bool, hits: u64, clocks: f64, pe
     }
 }
 
+///- ojf: each slot is the sum over every thread that hit it, so with
+// workers running at the same time the percentages can add up to more
+// than 100 - they're cpu time against wall time.
 pub fn stopTimersAndLog() void {
     const global_end = getCpuTime();
     const total_time: f64 = @floatFromInt(@subWithOverflow(
@@ -214,12 +325,81 @@ pub fn stopTimersAndLog() void {
         PerfTimerState.global_start,
     )[0]);
 
-    print("Total Time: {d:.3} seconds\n", .{total_time / PerfTimerState.cpu_timer_frequency});
+    print("Total Time: {d:.3} seconds ({d} threads timed)\n", .{
+        total_time / PerfTimerState.cpu_timer_frequency,
+        PerfTimerState.thread_count,
+    });
+    if (win.GetProcessMemoryInfo(win.self_process_handle)) |counters| {
+        print("Peak Working Set: {d:.2} MB\n", .{
+            @as(f64, @floatFromInt(counters.PeakWorkingSetSize)) / (1024.0 * 1024.0),
+        });
+    } else |_| {}
     for (1..PerfTimerState.next_slot) |timer_index| {
-        const slot: *TimerSlot = &PerfTimerState.timer_slots[timer_index];
-        const time_elapsed: f64 = @floatFromInt(slot.total_time - slot.children_time);
+        var merged = TimerSlot{};
+        for (PerfTimerState.threads[0..PerfTimerState.thread_count]) |*timers| {
+            const slot = &timers.slots[timer_index];
+            merged.total_time += slot.total_time;
+            merged.children_time += slot.children_time;
+            merged.hits += slot.hits;
+        }
+
+        const info = &PerfTimerState.slot_info[timer_index];
+        const time_elapsed: f64 = @floatFromInt(merged.total_time - merged.children_time);
         const percentage = time_elapsed / total_time;
 
-        printTimerResults(slot.name, slot.is_func, slot.hits, time_elapsed, percentage);
+        printTimerResults(info.name, info.is_func, merged.hits, time_elapsed, percentage);
+    }
+
+    if (PerfTimerState.trace_path) |path| {
+        writeTrace(path) catch |err| {
+            print("Unable to write trace to {s}: {s}\n", .{ path, @errorName(err) });
+        };
+    }
+}
+
+//- ojf: complete ("X") events, one per block, with timestamps in
+// microseconds since resetTimers.  tid is the thread's table index, so
+// the main thread is usually 0.  names go through std.json.fmt, since a
+// function's name includes its file path, which can have a backslash in it.
+fn writeTrace(path: []const u8) !void {
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+
+    var buffered = std.io.bufferedWriter(file.writer());
+    const writer = buffered.writer();
+
+    const micros_per_clock = 1_000_000.0 / PerfTimerState.cpu_timer_frequency;
+
+    var event_count: u64 = 0;
+    var dropped_events: u64 = 0;
+    try writer.writeAll("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (PerfTimerState.threads[0..PerfTimerState.thread_count], 0..) |*timers, thread_index| {
+        try writer.print("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{d},\"args\":{{\"name\":\"thread {d}\"}}}}", .{
+            thread_index,
+            thread_index,
+        });
+
+        for (timers.events[0..timers.event_count]) |event| {
+            const start: f64 = @floatFromInt(@subWithOverflow(event.start_time, PerfTimerState.global_start)[0]);
+            const duration: f64 = @floatFromInt(@subWithOverflow(event.end_time, event.start_time)[0]);
+            try writer.print(",\n{{\"name\":{},\"ph\":\"X\",\"pid\":1,\"tid\":{d},\"ts\":{d:.3},\"dur\":{d:.3}}}", .{
+                std.json.fmt(PerfTimerState.slot_info[event.index].name, .{}),
+                thread_index,
+                start * micros_per_clock,
+                duration * micros_per_clock,
+            });
+        }
+
+        event_count += timers.event_count;
+        dropped_events += timers.dropped_events;
+        try writer.writeAll(if (thread_index + 1 < PerfTimerState.thread_count) ",\n" else "\n");
+    }
+    try writer.writeAll("]}\n");
+    try buffered.flush();
+
+    print("Wrote {d} trace events to {s}", .{ event_count, path });
+    if (dropped_events != 0) {
+        print(" ({d} dropped, raise events_per_thread in startTrace)", .{dropped_events});
     }
+    print("\n", .{});
 }